@@ -232,21 +232,19 @@ void CalibrateDlg::calculationComplete()
 {
 	// calibration loop
 	QString status_msg = QLatin1String("%3   [ calibration loop: %2, iteration count: %1 ]");
-	ModelCalcList results = model_runner->output();
-	const int n_iter = results.first().first;
+	const ModelSummary result = model_runner->summaries().at(0);
+	const int n_iter = result.iterations;
 
 	calibration_loop_no++;
 	status_msg = status_msg
 	             .arg(n_iter < 50 ? QString::number(n_iter) : QString("NOT converging"))
 	             .arg(calibration_loop_no);
 
-	const Model *m = results.first().second;
-
-	const double pap = m->getResult(Model::PAP_value);
-	const double pvr = m->getResult(Model::TotalR_value);
-	const double rus = m->getResult(Model::Rus_value);
-	const double rm = m->getResult(Model::Rm_value);
-	const double rds = m->getResult(Model::Rds_value);
+	const double pap = result.result(Model::PAP_value);
+	const double pvr = result.result(Model::TotalR_value);
+	const double rus = result.result(Model::Rus_value);
+	const double rm = result.result(Model::Rm_value);
+	const double rds = result.result(Model::Rds_value);
 
 	double pa_diam = base_model.getResult(Model::PA_Diam_value);
 	double pv_diam = base_model.getResult(Model::PV_Diam_value);
@@ -51,6 +51,25 @@ const QLatin1String settings_db("settings_db");
 const QLatin1String app_name("BshoutyLungModel");
 
 const QLatin1String settings_opencl_enabled("/settings/opencl_enabled"); // bool
+const QLatin1String settings_soa_storage("/settings/soa_storage"); // bool
+const QLatin1String settings_simd_enabled("/settings/simd_enabled"); // bool
+const QLatin1String settings_solver_precision("/settings/solver_precision"); // int, Model::Precision
+const QLatin1String settings_precision_tolerance("/settings/precision_tolerance"); // double, relative
+const QLatin1String settings_precision_checked("/settings/precision_checked"); // int, Model::Precision passing PrecisionCheck
+const QLatin1String settings_solver_threads("/settings/solver_threads"); // int, 0 = auto
+const QLatin1String settings_fused_sweep("/settings/fused_sweep"); // bool
+const QLatin1String settings_anderson_acceleration("/settings/anderson_acceleration"); // bool
+const QLatin1String settings_active_set("/settings/active_set"); // bool
+const QLatin1String settings_local_capillary_solve("/settings/local_capillary_solve"); // bool
+const QLatin1String settings_coarse_generations("/settings/coarse_generations"); // int, 0 = off
+const QLatin1String settings_range_warm_start("/settings/range_warm_start"); // bool
+const QLatin1String settings_morphometry_file("/settings/morphometry_file"); // string, empty = built-in
+const QLatin1String settings_range_streaming("/settings/range_streaming"); // bool
+const QLatin1String settings_range_lanes("/settings/range_lanes"); // int, 0 = auto
+const QLatin1String settings_model_memory_budget("/settings/model_memory_budget"); // int, MB, 0 = auto
+const QLatin1String settings_sweep_journal("/settings/sweep_journal"); // bool
+const QLatin1String settings_sweep_journal_states("/settings/sweep_journal_states"); // bool, with resistances
+const QLatin1String settings_solution_cache_size("/settings/solution_cache_size"); // int, MB, 0 = off
 const QLatin1String show_wizard_on_start("/settings/show_on_start"); // bool
 
 // calibratino parameters
@@ -18,8 +18,12 @@
  */
 
 #include "common.h"
+#include "dbsettings.h"
 #include "mainwindow.h"
 #include "opencl.h"
+#include "model/integrationhelper/cpuhelper.h"
+#include "model/precisioncheck.h"
+#include "model/solutioncache.h"
 #include <QApplication>
 #include <QDir>
 #include <QDebug>
@@ -181,6 +185,33 @@ int main( int argc, char *argv[])
 	}
 	updateSettingsDb(db);
 
+	/* Regression check of the reduced precision solver modes, without
+	 * the user interface. Exits with 0 when all cases pass.
+	 */
+	if (app.arguments().contains("--verify-precision")) {
+		const bool passed = PrecisionCheck().run();
+		delete cl;
+		db.close();
+		return passed ? 0 : 3;
+	}
+
+	// accuracy of the vector kernels, also without the user interface
+	if (app.arguments().contains("--verify-kernels")) {
+		const bool passed = CpuIntegrationHelper::verifyKernels();
+		delete cl;
+		db.close();
+		return passed ? 0 : 3;
+	}
+
+	// before any model uses a reduced precision mode
+	if (!PrecisionCheck::checkPrecisionSetting())
+		QMessageBox::warning(0, "Solver precision",
+		                     "The reduced solver precision failed the precision check. "
+		                     "Double precision is used instead.");
+
+	SolutionCache::instance()->open(d.absoluteFilePath("solutions"),
+	        static_cast<qint64>(DbSettings::value(settings_solution_cache_size, 256).toInt()) << 20);
+
 	// QDir::setCurrent(app.applicationDirPath());
 	qDebug("%s", qPrintable(QDir::currentPath()));
 
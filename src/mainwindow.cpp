@@ -30,6 +30,7 @@
 #include "modelscene.h"
 #include "multimodeloutput.h"
 #include "model/compromisemodel.h"
+#include "model/modelbufferpool.h"
 #include "opencldlg.h"
 #include "opencl.h"
 #include "overlaymapwidget.h"
@@ -84,6 +85,7 @@ MainWindow::MainWindow(QWidget *parent)
 	: QMainWindow(parent)
 {
 	calc_thread = 0;
+	point_thread = 0;
 	mres = 0;
 
 	baseline = new Model(Model::Middle, Model::SegmentedVesselFlow);
@@ -112,6 +114,7 @@ MainWindow::MainWindow(QWidget *parent)
 
 	QActionGroup *integral_type = new QActionGroup(this);
 	integral_type->addAction(ui->actionSegmentedVessels);
+	integral_type->addAction(ui->actionAdaptiveVessels);
 	integral_type->addAction(ui->actionRigidVessels);
 	integral_type->addAction(ui->actionNavierStokes);
 	integral_type->setExclusive(true);
@@ -287,6 +290,9 @@ void MainWindow::restoreSettings()
 	case Model::RigidVesselFlow:
 		integral_type = ui->actionRigidVessels;
 		break;
+	case Model::AdaptiveVesselFlow:
+		integral_type = ui->actionAdaptiveVessels;
+		break;
 	default:
 		// nothing
 		break;
@@ -420,6 +426,7 @@ MainWindow::~MainWindow()
 		calc_thread->waitForCompletion();
 		delete calc_thread;
 	}
+	terminatePointCalculation();
 	if (mres)
 		delete mres;
 	delete ui;
@@ -442,14 +449,13 @@ void MainWindow::updateResults()
 			delete calc_thread;
 		}
 	}
+	terminatePointCalculation();
 
 	QList<QPair<Model::DataType, Range> > data_ranges = fetchModelInputs();
 	unsigned long long n_models = 1;
 	unsigned long long total_memory = 0xFFFFFFFFFFFFFFFFULL;
 	unsigned long long total_ram = total_memory;
-	const unsigned long long memory_per_model =
-	                (baseline->numArteries() + baseline->numVeins())*sizeof(Vessel) +
-	                baseline->numCapillaries()*sizeof(Capillary); // 19 elemnts+capilaries
+	const unsigned long long memory_per_model = baseline->memoryFootprint();
 
 	for(QList<QPair<Model::DataType, Range> >::const_iterator i=data_ranges.begin();
 	    i!=data_ranges.end();
@@ -505,18 +511,31 @@ void MainWindow::updateResults()
 		return;
 	}
 
-	if (memory_per_model*n_models > total_memory) {
+	// model buffers are limited to half of RAM, unless configured
+	ModelBufferPool *buffer_pool = ModelBufferPool::instance();
+	if (DbSettings::value(settings_model_memory_budget, 0).toInt() <= 0)
+		buffer_pool->setBudget(total_ram/2);
+
+	// fewer concurrent points if their models would not fit in the budget
+	int lanes = AsyncRangeModelHelper::defaultLanes();
+	while (lanes > 1 &&
+	       memory_per_model*AsyncRangeModelHelper::residentModels(n_models, lanes) >
+	       static_cast<unsigned long long>(buffer_pool->budget()))
+		lanes /= 2;
+
+	const unsigned long long n_resident = AsyncRangeModelHelper::residentModels(n_models, lanes);
+	if (memory_per_model*n_resident > total_memory) {
 		QString oom_msg(QLatin1String("Current settings will require %1 MB of RAM while only %2 MB available"));
-		QMessageBox::critical(this, "Out of Memory", oom_msg.arg((memory_per_model*n_models)>>20).arg(total_memory>>20));
+		QMessageBox::critical(this, "Out of Memory", oom_msg.arg((memory_per_model*n_resident)>>20).arg(total_memory>>20));
 		return;
 	}
 
-	if (memory_per_model*n_models > total_ram*3/4) {
+	if (memory_per_model*n_resident > total_ram*3/4) {
 		QString oom_msg(QLatin1String("Current settings will require %1 MB of RAM while you have %2 MB installed.\n"
 		                              "Continuing may cause excessive slowdown of your system.\n\n"
 		                              "Do you wish to continue?"));
 		int ret = QMessageBox::question(this, "Out of Memory",
-		                                oom_msg.arg((memory_per_model*n_models)>>20).arg(total_ram>>20),
+		                                oom_msg.arg((memory_per_model*n_resident)>>20).arg(total_ram>>20),
 		                                QMessageBox::Yes | QMessageBox::No,
 		                                QMessageBox::No);
 
@@ -556,6 +575,9 @@ void MainWindow::updateResults()
 	*model = *baseline;
 	calc_thread = new AsyncRangeModelHelper(*model, this);
 	calc_thread->setRangeData(data_ranges);
+	calc_thread->setMaxLanes(lanes);
+	calc_thread->setJournaled(n_models > 1 &&
+	                          DbSettings::value(settings_sweep_journal, true).toBool());
 
 	QProgressDialog *progress = new QProgressDialog(this);
 	progress->setRange(0, 10000);
@@ -825,6 +847,8 @@ void MainWindow::setIntegralType(QAction *ac)
 {
 	if (ac == ui->actionSegmentedVessels)
 		baseline->setIntegralType(Model::SegmentedVesselFlow);
+	else if (ac == ui->actionAdaptiveVessels)
+		baseline->setIntegralType(Model::AdaptiveVesselFlow);
 	else if (ac == ui->actionRigidVessels)
 		baseline->setIntegralType(Model::RigidVesselFlow);
 	else if (ac == ui->actionNavierStokes)
@@ -1167,13 +1191,18 @@ void MainWindow::animateLabelVisibility(QWidget *label, bool fVisible)
 
 void MainWindow::calculationCompleted()
 {
-	ModelCalcList res = calc_thread->output();
-	if (res.size() < 1)
+	if (calc_thread->outOfMemory()) {
+		QMessageBox::warning(this, "Out of memory",
+		                     "The calculation ran out of memory and its results are incomplete.");
+	}
+
+	const ModelSummaryList res = calc_thread->summaries();
+	if (res.validCount() < 1)
 		return;
 
 	int calculation_errors = 0;
-	for (ModelCalcList::const_iterator i=res.begin(); i!=res.end(); ++i) {
-		calculation_errors = i->second->calculationErrors();
+	for (int i=0; i<res.size(); ++i) {
+		calculation_errors = res.at(i).calculation_errors;
 
 		if (calculation_errors != 0)
 			break;
@@ -1190,11 +1219,16 @@ void MainWindow::calculationCompleted()
 	activateWindow();
 
 	if (res.size() == 1) {
-		const Model *m = res.first().second;
-		modelSelected(res.first().second, res.first().first);
+		int n_iters;
+		Model *m = calc_thread->pointModel(0, &n_iters);
 
 		calc_thread->deleteLater();
 		calc_thread = 0;
+		ui->recalc->setEnabled(true);
+
+		if (!m)
+			return;
+		modelSelected(m, n_iters);
 
 		/* Diagnostic messages for out of bounds calculations */
 		if (ui->actionDiseaseProgression->isChecked()) {
@@ -1213,8 +1247,6 @@ void MainWindow::calculationCompleted()
 				          "for the maximum level of disease possible.");
 			}
 		}
-
-		ui->recalc->setEnabled(true);
 		return;
 	}
 
@@ -1223,15 +1255,69 @@ void MainWindow::calculationCompleted()
 		delete mres;
 
 	mres = new MultiModelOutput(this);
-	mres->setModels(res);
+	mres->setSummaries(res);
 	mres->show();
 
 	connect(mres, SIGNAL(finished(int)), SLOT(multiModelWindowClosed()));
-	connect(mres, SIGNAL(doubleClicked(Model*,int)), SLOT(modelSelected(Model*,int)));
+	connect(mres, SIGNAL(pointDoubleClicked(int)), SLOT(pointSelected(int)));
+}
+
+void MainWindow::pointSelected(int point)
+{
+	if (!calc_thread || point_thread)
+		return;
+
+	int n_iters;
+	Model *m = calc_thread->pointModel(point, &n_iters);
+	if (m) {
+		modelSelected(m, n_iters);
+		return;
+	}
+
+	// models of points that were not kept are recalculated
+	Model *inputs = calc_thread->pointInputModel(point);
+	if (!inputs)
+		return;
+
+	point_thread = new AsyncRangeModelHelper(*inputs, this);
+	delete inputs;
+
+	connect(point_thread, SIGNAL(calculationComplete()), SLOT(pointCalculationCompleted()));
+	QApplication::setOverrideCursor(Qt::BusyCursor);
+	point_thread->beginCalculation();
+}
+
+void MainWindow::pointCalculationCompleted()
+{
+	QApplication::restoreOverrideCursor();
+
+	int n_iters;
+	Model *m = point_thread->pointModel(0, &n_iters);
+	if (m)
+		modelSelected(m, n_iters);
+
+	point_thread->deleteLater();
+	point_thread = 0;
+}
+
+void MainWindow::terminatePointCalculation()
+{
+	if (!point_thread)
+		return;
+
+	point_thread->terminateCalculation();
+	point_thread->waitForCompletion();
+	delete point_thread;
+	point_thread = 0;
+
+	QApplication::restoreOverrideCursor();
 }
 
 void MainWindow::modelSelected(Model *new_model, int n_iters)
 {
+	if (!new_model)
+		return;
+
 	const QString iter_msg("Iterations: %1");
 	ui->statusbar->showMessage(iter_msg.arg(n_iters));
 
@@ -1323,6 +1409,8 @@ void MainWindow::allocateNewModel(bool propagate_diseases_to_new_model)
 
 	if (ui->actionSegmentedVessels->isChecked())
 		type = Model::SegmentedVesselFlow;
+	else if(ui->actionAdaptiveVessels->isChecked())
+		type = Model::AdaptiveVesselFlow;
 	else if(ui->actionRigidVessels->isChecked())
 		type = Model::RigidVesselFlow;
 	else if(ui->actionNavierStokes->isChecked())
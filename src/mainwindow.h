@@ -114,9 +114,13 @@ protected:
 	// animation general setup function
 	void animateLabelVisibility(QWidget *label, bool fVisible);
 
+	void terminatePointCalculation();
+
 protected slots:
 	void calculationCompleted();
 	void modelSelected(Model *model, int n_iters);
+	void pointSelected(int point);
+	void pointCalculationCompleted();
 	void multiModelWindowClosed();
 
 	void diseaseActionTriggered(bool);
@@ -148,6 +152,7 @@ private:
 	ModelScene *scene;
 
 	AsyncRangeModelHelper *calc_thread;
+	AsyncRangeModelHelper *point_thread; // recalculates a point of calc_thread
 	QString save_filename;
 	MultiModelOutput *mres;
 
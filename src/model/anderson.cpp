@@ -0,0 +1,189 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "anderson.h"
+
+static inline bool isFinite(double v)
+{
+	return v - v == 0.0;
+}
+
+AndersonMixer::AndersonMixer(int depth)
+        : max_depth(depth)
+{
+	f_prev_norm = 0.0;
+	n_steps = 0;
+	n_restarts = 0;
+}
+
+void AndersonMixer::reset()
+{
+	f_prev.clear();
+	g_prev.clear();
+	valid_prev.clear();
+	dF.clear();
+	dG.clear();
+}
+
+bool AndersonMixer::step(const std::vector<double> &x, std::vector<double> &g)
+{
+	const int n = g.size();
+
+	f.resize(n);
+	valid.resize(n);
+	for (int j=0; j<n; ++j) {
+		valid[j] = isFinite(x[j]) && isFinite(g[j]);
+		f[j] = valid[j] ? g[j] - x[j] : 0.0;
+	}
+
+	const double f_norm = std::sqrt(dot(f, f));
+	n_steps++;
+
+	bool restart = f_prev.size() != f.size();
+	if (!restart && f_norm > f_prev_norm) {
+		restart = true;
+		n_restarts++;
+	}
+
+	if (restart) {
+		dF.clear();
+		dG.clear();
+	}
+	else {
+		// newest differences, dropping the oldest beyond depth
+		if ((int)dF.size() == max_depth) {
+			dF.erase(dF.begin());
+			dG.erase(dG.begin());
+		}
+
+		dF.push_back(std::vector<double>(n));
+		dG.push_back(std::vector<double>(n));
+		std::vector<double> &df = dF.back();
+		std::vector<double> &dg = dG.back();
+
+		for (int j=0; j<n; ++j) {
+			const bool both = valid[j] && valid_prev[j];
+			df[j] = both ? f[j] - f_prev[j] : 0.0;
+			dg[j] = both ? g[j] - g_prev[j] : 0.0;
+		}
+	}
+
+	f_prev = f;
+	g_prev = g;
+	valid_prev = valid;
+	f_prev_norm = f_norm;
+
+	if (dF.empty())
+		return false;
+
+	// least squares fit, dropping the oldest differences if singular
+	std::vector<double> gamma;
+	while (!solve(dF.size(), gamma)) {
+		dF.erase(dF.begin());
+		dG.erase(dG.begin());
+		if (dF.empty())
+			return false;
+	}
+
+	const int m = dF.size();
+	std::vector<double> mixed(g);
+	for (int j=0; j<n; ++j) {
+		if (!valid[j])
+			continue;
+
+		double correction = 0.0;
+		for (int i=0; i<m; ++i)
+			correction += gamma[i] * dG[i][j];
+
+		if (!(std::fabs(correction) <= maxCorrection())) {
+			dF.clear();
+			dG.clear();
+			n_restarts++;
+			return false;
+		}
+
+		mixed[j] -= correction;
+	}
+
+	g.swap(mixed);
+	return true;
+}
+
+/* Solves normal equations of min |f - dF*gamma|, with Gaussian elimination.
+ * Returns false if the system is numerically singular.
+ */
+bool AndersonMixer::solve(int m, std::vector<double> &gamma) const
+{
+	std::vector<double> A(m*m), b(m);
+
+	for (int i=0; i<m; ++i) {
+		b[i] = dot(dF[i], f);
+		for (int k=0; k<=i; ++k)
+			A[i*m+k] = A[k*m+i] = dot(dF[i], dF[k]);
+	}
+
+	double scale = 0.0;
+	for (int i=0; i<m; ++i)
+		scale = std::max(scale, A[i*m+i]);
+	if (!(scale > 0.0))
+		return false;
+
+	for (int c=0; c<m; ++c) {
+		int pivot = c;
+		for (int r=c+1; r<m; ++r)
+			if (std::fabs(A[r*m+c]) > std::fabs(A[pivot*m+c]))
+				pivot = r;
+
+		if (std::fabs(A[pivot*m+c]) < 1e-12*scale)
+			return false;
+
+		if (pivot != c) {
+			for (int k=0; k<m; ++k)
+				std::swap(A[c*m+k], A[pivot*m+k]);
+			std::swap(b[c], b[pivot]);
+		}
+
+		for (int r=c+1; r<m; ++r) {
+			const double factor = A[r*m+c] / A[c*m+c];
+			for (int k=c; k<m; ++k)
+				A[r*m+k] -= factor * A[c*m+k];
+			b[r] -= factor * b[c];
+		}
+	}
+
+	gamma.resize(m);
+	for (int c=m-1; c>=0; --c) {
+		double sum = b[c];
+		for (int k=c+1; k<m; ++k)
+			sum -= A[c*m+k] * gamma[k];
+		gamma[c] = sum / A[c*m+c];
+	}
+
+	return true;
+}
+
+double AndersonMixer::dot(const std::vector<double> &a, const std::vector<double> &b) const
+{
+	double sum = 0.0;
+	for (unsigned j=0; j<a.size(); ++j)
+		sum += a[j]*b[j];
+	return sum;
+}
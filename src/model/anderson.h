@@ -0,0 +1,73 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANDERSON_H
+#define ANDERSON_H
+
+#include <vector>
+
+/* Anderson acceleration of a fixed point iteration x = G(x).
+ *
+ * Each step takes the current iterate x and g = G(x), and replaces g by a
+ * combination of the last depth() G values that minimizes the combined
+ * residual G(x) - x in the least squares sense. Components that are not
+ * finite, in either x or g, are left as they are and do not take part in
+ * the mixing.
+ *
+ * Safeguards: the history is cleared, and g used unchanged, when the
+ * residual grows from the previous step or when the mixing would move any
+ * component by more than maxCorrection() from g.
+ */
+class AndersonMixer
+{
+public:
+	explicit AndersonMixer(int depth=5);
+
+	int depth() const { return max_depth; }
+	static double maxCorrection() { return 0.5; }
+
+	void reset();
+
+	// returns true if g was changed
+	bool step(const std::vector<double> &x, std::vector<double> &g);
+
+	// statistics since construction
+	int steps() const { return n_steps; }
+	int restarts() const { return n_restarts; }
+
+private:
+	bool solve(int n, std::vector<double> &gamma) const;
+	double dot(const std::vector<double> &a, const std::vector<double> &b) const;
+
+	const int max_depth;
+
+	// previous residual and G value, empty after reset()
+	std::vector<double> f_prev, g_prev;
+	std::vector<bool> valid_prev;
+	double f_prev_norm;
+
+	// differences of consecutive residuals and G values, oldest first
+	std::vector<std::vector<double> > dF, dG;
+
+	std::vector<double> f;
+	std::vector<bool> valid;
+	int n_steps, n_restarts;
+};
+
+#endif // ANDERSON_H
@@ -17,40 +17,178 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QDataStream>
+#include <QDebug>
+#include <QElapsedTimer>
 #include <QtConcurrentRun>
 #include <QFuture>
 #include <QThread>
 #include <QTimerEvent>
+#include <QVector>
 #include "asyncrangemodelhelper.h"
+#include "common.h"
+#include "dbsettings.h"
+#include "modelbufferpool.h"
+#include "opencl.h"
+#include "solutioncache.h"
+#include "sweepjournal.h"
+#include "sweepscheduler.h"
+#include <algorithm>
+#include <new>
 #include <stdexcept>
 
+/* Points of a range calculation. Point numbers are in row-major order of
+ * the ranges, with the first range outermost.
+ */
+class RangeGrid
+{
+public:
+	RangeGrid(const QList<QPair<Model::DataType, Range> > &data_ranges)
+	{
+		n_points = 1;
+		for (int d=0; d<data_ranges.size(); ++d) {
+			types << data_ranges[d].first;
+			counts << data_ranges[d].second.sequenceCount();
+			values << data_ranges[d].second.sequence();
+			n_points *= counts.back();
+		}
+	}
+
+	int pointCount() const { return n_points; }
+	int dimensions() const { return counts.size(); }
+	const QList<Model::DataType>& inputTypes() const { return types; }
+	double value(int d, int pos) const { return values[d][pos]; }
+
+	QVector<int> position(int point) const
+	{
+		QVector<int> pos(counts.size());
+		for (int d=counts.size()-1; d>=0; --d) {
+			pos[d] = point % counts[d];
+			point /= counts[d];
+		}
+
+		return pos;
+	}
+
+	int point(const QVector<int> &pos) const
+	{
+		int idx = 0;
+		for (int d=0; d<counts.size(); ++d)
+			idx = idx*counts[d] + pos[d];
+
+		return idx;
+	}
+
+	/* Grid position of the n-th point in serpentine order. Each range
+	 * reverses direction whenever the enclosing range steps, so
+	 * consecutive points differ by a single step of a single range.
+	 */
+	QVector<int> serpentinePosition(int n) const
+	{
+		QVector<int> pos(counts.size());
+		int stride = n_points;
+
+		for (int d=0; d<counts.size(); ++d) {
+			const int passes = n / stride;
+			stride /= counts[d];
+
+			const int step = (n / stride) % counts[d];
+			pos[d] = (passes % 2) ? counts[d]-1-step : step;
+		}
+
+		return pos;
+	}
+
+	void setPoint(Model &model, const QVector<int> &pos) const
+	{
+		for (int d=0; d<counts.size(); ++d)
+			model.setData(types[d], values[d][pos[d]]);
+	}
+
+private:
+	QList<Model::DataType> types;
+	QVector<int> counts;
+	QVector<QList<double> > values;
+	int n_points;
+};
+
+class AsyncRangeModelHelper_p;
+
+// lanes other than the first, which runs in AsyncRangeModelHelper_p
+class SweepLane : public QThread
+{
+public:
+	SweepLane(AsyncRangeModelHelper_p *p, int lane) : p(p), lane(lane) {}
+
+protected:
+	virtual void run();
+
+private:
+	AsyncRangeModelHelper_p *p;
+	int lane;
+};
+
 class AsyncRangeModelHelper_p : public QThread
 {
 public:
+	typedef QMap<int, QPair<int, Model*> > PointModels;
+
 	AsyncRangeModelHelper_p(QList<QPair<Model::DataType, Range> > dr,
 	                        const Model &bm,
+	                        bool warm_start,
+	                        bool streaming,
+	                        const QSet<int> &pinned,
+	                        int lanes,
+	                        SweepJournal *journal,
 	                        QObject *parent)
-	        :QThread(parent), data_ranges(dr), base_model(bm)
+	        :QThread(parent), ranges(dr), grid(dr), base_model(bm), journal(journal),
+	          warm_start(warm_start),
+	          keep_all(!streaming), pinned(pinned),
+	          scheduler(grid.pointCount(), lanes,
+	                    bm.solverThreads() > 0 ? bm.solverThreads() : QThread::idealThreadCount()),
+	          summaries(bm, grid.inputTypes(), grid.pointCount())
 	{
-		total_models = 1;
+		total_models = grid.pointCount();
 		completed_models = 0;
-		op_model = 0;
+		total_iterations = 0;
+		abort_flag = 0;
+		out_of_memory = 0;
+		op_models = QVector<Model*>(scheduler.laneCount(), 0);
+		restored = QVector<bool>(total_models, false);
+		duplicate_of = QVector<int>(total_models, -1);
+		point_keys = QVector<QByteArray>(total_models);
+
+		// point being calculated and, with warm start, two previous points
+		scheduler.setLaneMemory((warm_start ? 3 : 1)*bm.memoryFootprint());
+
+		if (total_models == 1)
+			this->pinned.insert(0);
+	}
+
+	~AsyncRangeModelHelper_p()
+	{
+		for (PointModels::const_iterator i=models.begin(); i!=models.end(); ++i)
+			delete i.value().second;
 	}
 
 	/* Thread safe */
 	void setAbort() {
 		abort_flag = 1;
+		scheduler.abort();
 
 		QMutexLocker lock(&op_model_locker);
-		if (op_model != NULL) {
-			op_model->setAbort();
-		}
+		for (int i=0; i<op_models.size(); ++i)
+			if (op_models[i] != NULL)
+				op_models[i]->setAbort();
 	}
 
 	/* Thread safe */
 	int completedAmount() {
+		int model_progress = 0;
 		op_model_locker.lock();
-		int model_progress = (op_model==NULL) ? 0 : op_model->progress();
+		for (int i=0; i<op_models.size(); ++i)
+			if (op_models[i] != NULL)
+				model_progress += op_models[i]->progress();
 		op_model_locker.unlock();
 
 		int n_models = total_models;
@@ -60,84 +198,327 @@ public:
 		return 10000*comp/n_models + model_progress/n_models;
 	}
 
-	ModelCalcList getResults() const {
-		return results;
+	// ownership of the models passes to the caller
+	PointModels takeModels() {
+		PointModels r = models;
+		models.clear();
+		return r;
 	}
 
-protected:
-	virtual void run() {
-		abort_flag = 0;
+	ModelSummaryList getSummaries() const {
+		return summaries;
+	}
+
+	/* Calculates the points of the scheduler lane one at a time. Models of
+	 * points that are not kept are reused for later points once summarised
+	 * and no longer needed as a warm start, so a lane uses at most three
+	 * models besides the kept ones.
+	 */
+	void calculateLane(int lane)
+	{
+		QList<Model*> spare;
+		QVector<int> prev_pos, prev2_pos;
+		Model *prev = 0, *prev2 = 0;
+		int prev_n = -1, threads;
+
+		for (int n; (n = scheduler.nextPoint(lane, threads)) >= 0 && !abort_flag; ) {
+			QElapsedTimer timer;
+			timer.start();
+
+			const QVector<int> pos = warm_start ? grid.serpentinePosition(n) : grid.position(n);
+			const int idx = grid.point(pos);
+
+			// already calculated, in the journal or the solution cache, or
+			// the same as another point
+			if (restored[idx] || duplicate_of[idx] >= 0) {
+				scheduler.pointSkipped();
+				continue;
+			}
+
+			// only the previous point of the sweep order is a warm start
+			if (n != prev_n+1) {
+				release(prev, prev_pos, spare);
+				release(prev2, prev2_pos, spare);
+				prev = prev2 = 0;
+			}
 
-		// Allocate memory
-		Model *run_clone = base_model.clone();
+			Model *model = 0;
+			int n_iter;
+			try {
+				if (spare.isEmpty())
+					model = base_model.clone();
+				else {
+					model = spare.takeLast();
+					*model = base_model;
+				}
+				model->setSolverThreads(threads);
+				grid.setPoint(*model, pos);
+
+				if (warm_start && prev) {
+					// range that changed from the previous point
+					int d = 0;
+					while (pos[d] == prev_pos[d])
+						++d;
+
+					double step_ratio = 0.0;
+					if (prev2 && sameLine(prev2_pos, prev_pos, pos, d)) {
+						const double v0 = grid.value(d, prev2_pos[d]);
+						const double v1 = grid.value(d, prev_pos[d]);
+						const double v2 = grid.value(d, pos[d]);
+						step_ratio = (v2 - v1) / (v1 - v0);
+					}
+
+					if (step_ratio > 0.0)
+						model->warmStart(*prev, prev2, step_ratio);
+					else
+						model->warmStart(*prev);
+				}
+
+				// kept points in the journal converge from its resistances
+				if (journal && isKept(idx))
+					model->restoreResistanceState(journal->state(idx));
+
+				op_model_locker.lock();
+				op_models[lane] = model;
+				op_model_locker.unlock();
+
+				n_iter = model->calc();
+
+				op_model_locker.lock();
+				op_models[lane] = 0;
+				op_model_locker.unlock();
+			}
+			catch (std::bad_alloc &) {
+				// the pool budget is not a hard limit, continue in fewer lanes
+				op_model_locker.lock();
+				op_models[lane] = 0;
+				op_model_locker.unlock();
+
+				delete model;
+				release(prev, prev_pos, spare);
+				release(prev2, prev2_pos, spare);
+				while (!spare.isEmpty())
+					delete spare.takeFirst();
+				prev = prev2 = 0;
+				prev_n = -1;
+
+				if (ModelBufferPool::instance())
+					ModelBufferPool::instance()->trim();
+
+				if (!scheduler.pointFailed(lane)) {
+					qWarning() << "Range calculation: out of memory";
+					out_of_memory = 1;
+					abort_flag = 1;
+				}
+				continue;
+			}
 
-		try {
-			total_models = 1;
-			for (QList<QPair<Model::DataType, Range> >::const_iterator i=data_ranges.begin(); i!=data_ranges.end(); ++i)
-				total_models = total_models * i->second.sequenceCount();
-			completed_models = 0;
-			recursiveDataSet(data_ranges, *run_clone);
+			scheduler.pointDone(threads, timer.nsecsElapsed(), model->solverStatistics());
+
+			const ModelSummary summary = ModelSummary::fromModel(*model, n_iter, idx);
+			const bool kept = isKept(idx);
+			const QByteArray state = (journal && journal->storesStates() && n_iter > 0) ?
+			                                 model->resistanceState() : QByteArray();
+			const bool done = !model->isAbort();
+			QList<QPair<int, QByteArray> > records; // point records of idx and its duplicates
+
+			results_locker.lock();
+			summaries.set(summary, *model);
+			if (done)
+				records << qMakePair(idx, summaries.pointRecord(idx));
+			if (kept)
+				models.insert(idx, QPair<int, Model*>(n_iter, model));
+			total_iterations += n_iter;
+			++completed_models;
+
+			const QList<int> same_points = duplicates.value(idx);
+			for (int i=0; done && i<same_points.size(); ++i) {
+				summaries.setPointRecord(records.front().second, same_points[i]);
+				records << qMakePair(same_points[i], summaries.pointRecord(same_points[i]));
+				++completed_models;
+			}
+			results_locker.unlock();
+
+			// written without the lock, lanes do not wait for each other's disk writes
+			for (int i=0; journal && i<records.size(); ++i)
+				journal->append(records[i].first, records[i].second, i == 0 ? state : QByteArray());
+
+			if (!records.isEmpty() && n_iter > 0 && SolutionCache::instance())
+				SolutionCache::instance()->insert(point_keys[idx], records.front().second);
+
+			// points that did not calculate are not used as a start
+			if (warm_start && n_iter > 0) {
+				release(prev2, prev2_pos, spare);
+				prev2 = prev;
+				prev2_pos = prev_pos;
+				prev = model;
+				prev_pos = pos;
+			}
+			else
+				release(model, pos, spare);
+			prev_n = n;
 		}
-		catch(std::bad_alloc *error) {
-			// cleanup memory
-			while (!results.isEmpty()) {
-				delete results.front().second;
-				results.pop_front();
+
+		release(prev, prev_pos, spare);
+		release(prev2, prev2_pos, spare);
+		while (!spare.isEmpty())
+			delete spare.takeFirst();
+
+		scheduler.laneStopped(lane);
+	}
+
+	bool outOfMemory() const {
+		return out_of_memory;
+	}
+
+protected:
+	virtual void run() {
+		const QByteArray base_hash = base_model.inputHash();
+
+		if (journal && journal->open(SweepJournal::key(base_hash, ranges, warm_start), summaries)) {
+			// kept points need their model, see calculateLane()
+			for (int i=0; i<total_models; ++i) {
+				restored[i] = summaries.at(i).isValid() && !isKept(i);
+				if (restored[i])
+					++completed_models;
 			}
 		}
-		delete run_clone;
+		findSolutions(base_hash);
 
-		// Calculate
-		for (ModelCalcList::iterator i=results.begin(); i!=results.end(); ++i) {
-			op_model_locker.lock();
-			op_model = i->second;
-			op_model_locker.unlock();
+		QList<SweepLane*> lanes;
+		for (int i=1; i<scheduler.laneCount(); ++i) {
+			lanes << new SweepLane(this, i);
+			lanes.back()->start();
+		}
 
-			i->first = op_model->calc();
-			++completed_models; // inc completed models
+		calculateLane(0);
 
-			if (abort_flag)
-				break;
+		while (!lanes.isEmpty()) {
+			lanes.front()->wait();
+			delete lanes.takeFirst();
 		}
-	}
 
-	void recursiveDataSet(QList<QPair<Model::DataType, Range> > data,
-	                      Model &model) {
-		if (abort_flag)
-			return;
+		if (journal && !abort_flag && completed_models == total_models)
+			journal->setComplete();
 
-		if (data.size() > 0) {
-			QPair<Model::DataType, Range> range = data.takeFirst();
-			QList<double> value_list = range.second.sequence();
+		if (warm_start || scheduler.laneCount() > 1)
+			qDebug() << "Range calculation:" << total_iterations << "iterations for"
+			         << completed_models << "points in" << scheduler.laneCount() << "lanes";
 
-			foreach (double value, value_list) {
-				if (abort_flag)
-					return;
+		if (ModelBufferPool::instance())
+			ModelBufferPool::instance()->logStatistics();
+		if (SolutionCache::instance() && SolutionCache::instance()->isOpen())
+			SolutionCache::instance()->logStatistics();
+	}
 
-				model.setData(range.first, value);
-				recursiveDataSet(data, model);
+	/* Keys the points by their inputs, restores points in the solution
+	 * cache and maps points with the same inputs as an earlier point to
+	 * that point, so they are calculated once. Kept points are always
+	 * calculated, as the cache has no models.
+	 */
+	void findSolutions(const QByteArray &base_hash)
+	{
+		SolutionCache *cache = SolutionCache::instance();
+		QMap<QByteArray, int> first_points;
+
+		for (int idx=0; idx<total_models; ++idx) {
+			const QVector<int> pos = grid.position(idx);
+			QByteArray data;
+			QDataStream out(&data, QIODevice::WriteOnly);
+			out.setVersion(QDataStream::Qt_4_6);
+
+			out << warm_start;
+			for (int d=0; d<grid.dimensions(); ++d)
+				out << static_cast<qint32>(grid.inputTypes()[d]) << grid.value(d, pos[d]);
+			point_keys[idx] = SolutionCache::key("range point", base_hash, data);
+
+			QMap<QByteArray, int>::const_iterator first = first_points.find(point_keys[idx]);
+			if (first != first_points.end()) {
+				if (!isKept(idx))
+					duplicate_of[idx] = first.value();
+				continue;
 			}
+			first_points.insert(point_keys[idx], idx);
+
+			QByteArray record;
+			if (restored[idx] || isKept(idx) || cache == 0 || !cache->find(point_keys[idx], record) ||
+			    summaries.setPointRecord(record, idx) != idx)
+				continue;
+
+			restored[idx] = true;
+			++completed_models;
+			if (journal)
+				journal->append(idx, summaries.pointRecord(idx), QByteArray());
 		}
-		else {
-			op_model_locker.lock();
-			op_model = model.clone();
-			op_model_locker.unlock();
-			results.append(QPair<int,Model*>(0, op_model));
+
+		for (int idx=0; idx<total_models; ++idx) {
+			const int first = duplicate_of[idx];
+			if (first < 0 || restored[idx])
+				continue;
+
+			if (restored[first]) {
+				summaries.setPointRecord(summaries.pointRecord(first), idx);
+				restored[idx] = true;
+				++completed_models;
+				if (journal)
+					journal->append(idx, summaries.pointRecord(idx), QByteArray());
+			}
+			else
+				duplicates[first] << idx;
 		}
 	}
 
+	// a, b and c are consecutive points along range d, in one direction
+	static bool sameLine(const QVector<int> &a, const QVector<int> &b,
+	                     const QVector<int> &c, int d)
+	{
+		for (int i=0; i<a.size(); ++i)
+			if (i != d && (a[i] != b[i] || b[i] != c[i]))
+				return false;
 
-	QList<QPair<Model::DataType, Range> > data_ranges;
+		return b[d] != a[d] && (b[d]-a[d] > 0) == (c[d]-b[d] > 0);
+	}
+
+	bool isKept(int idx) const {
+		return keep_all || pinned.contains(idx);
+	}
+
+	// returns a model that is no longer in use for reuse, unless it is kept
+	void release(Model *model, const QVector<int> &pos, QList<Model*> &spare) {
+		if (model && !isKept(grid.point(pos)))
+			spare << model;
+	}
+
+
+	const QList<QPair<Model::DataType, Range> > ranges;
+	const RangeGrid grid;
 	const Model &base_model;
-	ModelCalcList results;
+	SweepJournal *journal;
+	QVector<bool> restored; // points read from the journal or the solution cache
+	QVector<QByteArray> point_keys; // SolutionCache keys
+	QVector<int> duplicate_of; // earlier point with the same inputs, or -1
+	QMap<int, QList<int> > duplicates; // later points with the same inputs
+	bool warm_start, keep_all;
+	QSet<int> pinned;
+	SweepScheduler scheduler;
+
+	QMutex results_locker;
+	PointModels models;
+	ModelSummaryList summaries;
+	int total_iterations;
 
 	QMutex op_model_locker;
-	Model *op_model;
+	QVector<Model*> op_models; // per lane
 
 	int completed_models, total_models;
-	volatile int abort_flag;
+	volatile int abort_flag, out_of_memory;
 };
 
+void SweepLane::run()
+{
+	p->calculateLane(lane);
+}
+
 
 
 
@@ -147,14 +528,19 @@ AsyncRangeModelHelper::AsyncRangeModelHelper(const Model &bm, QObject *parent)
 	p = 0;
 	timer_id = -1;
 	label = QString::fromLatin1("Calculating ...");
+	warm_start = DbSettings::value(settings_range_warm_start, true).toBool();
+	streaming = DbSettings::value(settings_range_streaming, true).toBool();
+	max_lanes = defaultLanes();
+	journaled = false;
+	journal = 0;
+	out_of_memory = false;
 }
 
 AsyncRangeModelHelper::~AsyncRangeModelHelper()
 {
-	while (!results.isEmpty())
-		delete results.takeFirst().second;
-
+	deleteModels();
 	cleanupHelper();
+	delete journal;
 	delete base_model;
 }
 
@@ -185,33 +571,91 @@ void AsyncRangeModelHelper::setRangeData(QList<QPair<Model::DataType, Range> > r
 
 ModelCalcList AsyncRangeModelHelper::output()
 {
-	if (p && p->isFinished()) {
-		results = p->getResults();
+	collectResults();
+	return models.values();
+}
 
-		if (timer_id >= 0)
-			killTimer(timer_id);
-		timer_id = -1;
+ModelSummaryList AsyncRangeModelHelper::summaries()
+{
+	collectResults();
+	return point_summaries;
+}
 
-		delete p;
-		p = 0;
-	}
-	return results;
+int AsyncRangeModelHelper::pointCount() const
+{
+	return RangeGrid(data_ranges).pointCount();
+}
+
+Model* AsyncRangeModelHelper::pointModel(int point, int *n_iterations)
+{
+	collectResults();
+
+	PointModels::const_iterator i = models.find(point);
+	if (i == models.end())
+		return 0;
+
+	if (n_iterations)
+		*n_iterations = i.value().first;
+	return i.value().second;
+}
+
+Model* AsyncRangeModelHelper::pointInputModel(int point) const
+{
+	const RangeGrid grid(data_ranges);
+	if (p || point < 0 || point >= grid.pointCount())
+		return 0;
+
+	Model *model = base_model->clone();
+	grid.setPoint(*model, grid.position(point));
+	if (journal)
+		model->restoreResistanceState(journal->state(point));
+
+	return model;
+}
+
+bool AsyncRangeModelHelper::outOfMemory()
+{
+	collectResults();
+	return out_of_memory;
+}
+
+int AsyncRangeModelHelper::defaultLanes()
+{
+	// concurrent models would only queue on the OpenCL device
+	if (cl && cl->isAvailable() && DbSettings::value(settings_opencl_enabled, true).toBool())
+		return 1;
+
+	const int lanes = DbSettings::value(settings_range_lanes, 0).toInt();
+	return lanes > 0 ? lanes : std::max(1, QThread::idealThreadCount());
+}
+
+unsigned long long AsyncRangeModelHelper::residentModels(unsigned long long n_points, int lanes)
+{
+	if (!DbSettings::value(settings_range_streaming, true).toBool())
+		return n_points;
+
+	// per lane, point being calculated and two warm start points
+	return std::min(n_points, 3ULL*std::max(1, lanes));
 }
 
 bool AsyncRangeModelHelper::beginCalculation()
 {
 	// clear results, if any
-	while (!results.isEmpty())
-		delete results.takeFirst().second;
+	deleteModels();
+	point_summaries = ModelSummaryList();
+	out_of_memory = false;
 
 	cleanupHelper();
-	p = new AsyncRangeModelHelper_p(data_ranges, *base_model, parent());
+	delete journal;
+	journal = journaled ? new SweepJournal : 0;
+
+	p = new AsyncRangeModelHelper_p(data_ranges, *base_model, warm_start,
+	                                streaming, pinned_points, max_lanes, journal, parent());
 	connect(p, SIGNAL(finished()), SLOT(calcThreadDone()));
 	p->start();
 	startTimer(2000);
 	return true;
 }
-
 bool AsyncRangeModelHelper::isCalculationCompleted() const
 {
 	return p ? p->isFinished() : false;
@@ -263,10 +707,31 @@ void AsyncRangeModelHelper::cleanupHelper()
 			killTimer(timer_id);
 		timer_id = -1;
 
-		ModelCalcList r = p->getResults();
-		while (r.isEmpty())
-			delete r.takeFirst().second;
 		delete p;
 		p = 0;
 	}
 }
+
+void AsyncRangeModelHelper::collectResults()
+{
+	if (p && p->isFinished()) {
+		deleteModels();
+		models = p->takeModels();
+		point_summaries = p->getSummaries();
+		out_of_memory = p->outOfMemory();
+
+		if (timer_id >= 0)
+			killTimer(timer_id);
+		timer_id = -1;
+
+		delete p;
+		p = 0;
+	}
+}
+
+void AsyncRangeModelHelper::deleteModels()
+{
+	for (PointModels::const_iterator i=models.begin(); i!=models.end(); ++i)
+		delete i.value().second;
+	models.clear();
+}
@@ -21,9 +21,12 @@
 #define ASYNCRANGEHELPER_H
 
 #include <QList>
+#include <QMap>
 #include <QPair>
 #include <QObject>
+#include <QSet>
 #include "model/model.h"
+#include "model/modelsummary.h"
 #include "range.h"
 
 /* The primary purpose of this class is to facilitate asynchronous, interruptable
@@ -34,6 +37,7 @@
  */
 
 class AsyncRangeModelHelper_p;
+class SweepJournal;
 class AsyncRangeModelHelper : public QObject
 {
 	Q_OBJECT
@@ -45,7 +49,59 @@ public:
 	/* Not thread safe, must not be called if calculation is running */
 	void setRangeData(Model::DataType type, const Range &range);
 	void setRangeData(QList<QPair<Model::DataType, Range> > ranges);
-	ModelCalcList output();
+	ModelCalcList output(); // calculated models, in range order
+	ModelSummaryList summaries();
+	int pointCount() const;
+
+	/* Calculates range points in serpentine order, each starting from
+	 * the converged state of the previous point. See Model::warmStart()
+	 */
+	void setWarmStart(bool enabled) { warm_start = enabled; }
+	bool warmStart() const { return warm_start; }
+
+	/* Streaming keeps only a ModelSummary of each point. Models are reused
+	 * for later points once summarised, so memory is bounded by the models
+	 * in use at a time and not by the number of points. output() only
+	 * returns models of pinned points. A single point is always pinned.
+	 */
+	void setStreaming(bool enabled) { streaming = enabled; }
+	bool isStreaming() const { return streaming; }
+	void pinPoint(int point) { pinned_points.insert(point); }
+
+	/* Writes calculated points to a SweepJournal, and only calculates the
+	 * points not in it already. Journals of interrupted calculations are
+	 * kept, so calculating the same ranges again resumes them. The journal
+	 * of a completed calculation is removed with the next calculation or
+	 * the helper.
+	 */
+	void setJournaled(bool enabled) { journaled = enabled; }
+	bool isJournaled() const { return journaled; }
+
+	/* Model of a calculated point, owned by the helper, or 0 if it was
+	 * not kept or calculation is running.
+	 */
+	Model* pointModel(int point, int *n_iterations=0);
+
+	/* New model with the inputs of a point, to recalculate a point that
+	 * was not kept, with the resistances in the journal if it has them.
+	 * Owned by the caller. Returns 0 while calculation is running.
+	 */
+	Model* pointInputModel(int point) const;
+
+	/* Points are calculated concurrently in up to lanes models, with the
+	 * solver threads split between them. See SweepScheduler.
+	 */
+	void setMaxLanes(int lanes) { max_lanes = lanes; }
+	int maxLanes() const { return max_lanes; }
+	static int defaultLanes();
+
+	// models resident during calculation of n_points with current settings
+	static unsigned long long residentModels(unsigned long long n_points, int lanes);
+
+	/* Whether the calculation stopped because it ran out of memory with a
+	 * single lane left. The results are incomplete.
+	 */
+	bool outOfMemory();
 
 	/* Thread safe */
 	bool beginCalculation();
@@ -63,10 +119,19 @@ protected slots:
 
 private:
 	void cleanupHelper();
+	void collectResults();
+	void deleteModels();
+
+	typedef QMap<int, QPair<int, Model*> > PointModels;
 
 	QList<QPair<Model::DataType, Range> > data_ranges;
-	ModelCalcList results;
+	PointModels models;
+	ModelSummaryList point_summaries;
+	QSet<int> pinned_points;
 	const Model *base_model;
+	bool warm_start, streaming, journaled, out_of_memory;
+	int max_lanes;
+	SweepJournal *journal;
 
 	AsyncRangeModelHelper_p *p;
 	int timer_id;
@@ -17,7 +17,10 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QCryptographicHash>
+#include <QDataStream>
 #include "compromisemodel.h"
+#include "solutioncache.h"
 #include "math.h"
 
 CompromiseModel::CompromiseModel(Model::Transducer trans,
@@ -80,6 +83,13 @@ int CompromiseModel::calc(int max_iter)
 	if (!validInputs())
 		return 0;
 
+	// same inputs bisect to the same parameter value
+	const QByteArray cache_key = SolutionCache::key("compromise", inputHash(),
+	                                                QByteArray::number(max_iter));
+	int ret;
+	if (restoreSolution(cache_key, max_iter, ret))
+		return ret;
+
 	double param_value;
 	Range r = dis.at(slew_disease_idx).paramRange(param_no);
 	const double orig_range = r.max() - r.min();
@@ -91,6 +101,7 @@ int CompromiseModel::calc(int max_iter)
 
 	double new_pap = Model::getResult(Model::PAP_value);
 	if (fabs(new_pap - target_pap) < Model::getResult(Model::Tlrns_value)) {
+		storeSolution(cache_key, 1);
 		return 1;
 	}
 
@@ -126,9 +137,67 @@ int CompromiseModel::calc(int max_iter)
 	}
 
 	n_iterations = i; // override n_iterations set by Model::calc()
+	storeSolution(cache_key, i);
 	return i;
 }
 
+QByteArray CompromiseModel::inputHash() const
+{
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_6);
+
+	out << Model::inputHash() << target_pap
+	    << static_cast<qint32>(slew_disease_idx) << static_cast<quint32>(param_no);
+	return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+bool CompromiseModel::restoreSolution(const QByteArray &key, int max_iter, int &ret)
+{
+	SolutionCache *cache = SolutionCache::instance();
+	QByteArray value;
+	if (cache == 0 || !cache->find(key, value))
+		return false;
+
+	QDataStream in(value);
+	in.setVersion(QDataStream::Qt_4_6);
+	qint32 iterations;
+	double param_value;
+	QByteArray state;
+	in >> iterations >> param_value >> state;
+
+	// corrupt entries are dropped
+	if (in.status() != QDataStream::Ok || !restoreResistanceState(state)) {
+		cache->remove(key);
+		return false;
+	}
+
+	// converges within the first iteration from the stored resistances
+	dis[slew_disease_idx].setParameter(param_no, param_value);
+	Model::calc(max_iter);
+
+	com_prog = 10000;
+	n_iterations = iterations;
+	ret = iterations;
+	return true;
+}
+
+void CompromiseModel::storeSolution(const QByteArray &key, int ret)
+{
+	SolutionCache *cache = SolutionCache::instance();
+	if (cache == 0 || !cache->isOpen() || isAbort())
+		return;
+
+	QByteArray value;
+	QDataStream out(&value, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_6);
+
+	out << static_cast<qint32>(ret)
+	    << dis.at(slew_disease_idx).parameterValue(param_no)
+	    << resistanceState();
+	cache->insert(key, value);
+}
+
 void CompromiseModel::setCalculatedParameter(const Disease &d, int p)
 {
 	for (DiseaseList::const_iterator i=dis.begin(); i!=dis.end(); ++i) {
@@ -35,6 +35,7 @@ public:
 
 	virtual CompromiseModel* clone() const;
 	virtual int calc(int max_iter);
+	virtual QByteArray inputHash() const;
 
 	void setCalculatedParameter(const Disease &d, int param_no);
 	int targetParameterNo() const { return param_no; }
@@ -42,6 +43,10 @@ public:
 	virtual int progress() const { return com_prog.fetchAndAddRelaxed(0); }
 
 private:
+	// converged parameter and resistances from SolutionCache, see calc()
+	bool restoreSolution(const QByteArray &key, int max_iter, int &ret);
+	void storeSolution(const QByteArray &key, int ret);
+
 	int slew_disease_idx;
 	double target_pap;
 	unsigned param_no;
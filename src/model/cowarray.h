@@ -0,0 +1,333 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef COWARRAY_H
+#define COWARRAY_H
+
+#include <QAtomicInt>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "modelbufferpool.h"
+
+/* Copy-on-write array of plain structures (vessels, capillaries), shared
+ * between copies in blocks of BlockSize elements.
+ *
+ * A copy references the blocks of its source and costs O(blocks). The first
+ * write() to a shared block copies only that block, to a buffer of its own,
+ * so the memory of an array grows with the blocks written to.
+ * materialize() moves all blocks to one private buffer, after which the
+ * array is contiguous, as needed before bulk updates like a solve.
+ *
+ * data() is the contiguous array, or 0 if blocks are in different buffers.
+ * It is always readable, but only writable after materialize(), until the
+ * array is copied again.
+ *
+ * Buffers are reference counted atomically, once per block referencing
+ * them, so arrays sharing blocks can be used from different threads. An
+ * array must not be copied while it is modified.
+ */
+template<class T>
+class CowArray
+{
+public:
+	enum { BlockShift = 10, BlockSize = 1 << BlockShift };
+
+	explicit CowArray(int n);
+	CowArray(const CowArray &other);
+	~CowArray();
+
+	CowArray& operator=(const CowArray &other);
+
+	int size() const { return n; }
+
+	const T& at(int i) const { return blocks[i >> BlockShift][i & (BlockSize-1)]; }
+	T& write(int i);
+
+	T* materialize();
+	T* data() const { return contiguous; }
+
+	// blocks also referenced by other arrays
+	int sharedBlocks() const;
+
+private:
+	struct Buffer
+	{
+		Buffer() : ref(0), data(0), bytes(0) {}
+
+		QAtomicInt ref; // blocks of all arrays in the buffer
+		T *data;
+		qint64 bytes;
+	};
+
+	Buffer* allocateBuffer(int elements);
+	Buffer* takeSpare();
+	static void release(Buffer *b);
+	static void free(Buffer *b);
+	void releaseBlock(int block);
+	void releaseBlocks();
+	bool isPrivate(int block) const;
+	void updateContiguous();
+	int blockLength(int block) const;
+
+	int n;
+	std::vector<T*> blocks;      // start of each block
+	std::vector<Buffer*> owners; // buffer of each block
+	Buffer *own;                 // buffer of the last materialize(), or 0
+	int own_blocks;              // blocks of this array in own
+	Buffer *spare;               // unreferenced, reused by the next materialize()
+	T *contiguous;
+};
+
+template<class T>
+CowArray<T>::CowArray(int n)
+        : n(n), blocks((n + BlockSize - 1) >> BlockShift),
+          owners(blocks.size()), spare(0)
+{
+	own = allocateBuffer(n);
+	memset(own->data, 0, n*sizeof(T));
+
+	for (unsigned b=0; b<blocks.size(); ++b) {
+		blocks[b] = own->data + (b << BlockShift);
+		owners[b] = own;
+		own->ref.ref();
+	}
+	own_blocks = blocks.size();
+	contiguous = own->data;
+}
+
+template<class T>
+CowArray<T>::CowArray(const CowArray &other)
+        : n(other.n), blocks(other.blocks), owners(other.owners), own(0),
+          own_blocks(0), spare(0), contiguous(other.contiguous)
+{
+	for (unsigned b=0; b<owners.size(); ++b)
+		owners[b]->ref.ref();
+}
+
+template<class T>
+CowArray<T>::~CowArray()
+{
+	releaseBlocks();
+	free(spare);
+}
+
+template<class T>
+CowArray<T>& CowArray<T>::operator=(const CowArray &other)
+{
+	if (this == &other)
+		return *this;
+
+	// reference the new blocks first, they may be in our buffers
+	for (unsigned b=0; b<other.owners.size(); ++b)
+		other.owners[b]->ref.ref();
+
+	// keep an unshared buffer for the next materialize()
+	if (spare == 0 && own != 0 && own->ref.fetchAndAddOrdered(0) == own_blocks) {
+		for (unsigned b=0; b<owners.size(); ++b)
+			if (owners[b] == own)
+				owners[b] = 0;
+
+		own->ref.fetchAndStoreOrdered(0);
+		spare = own;
+	}
+	releaseBlocks();
+
+	blocks = other.blocks;
+	owners = other.owners;
+	own = 0;
+	own_blocks = 0;
+	contiguous = other.contiguous;
+	return *this;
+}
+
+template<class T>
+T& CowArray<T>::write(int i)
+{
+	const int b = i >> BlockShift;
+
+	if (!isPrivate(b)) {
+		Buffer *copy = allocateBuffer(BlockSize);
+		memcpy(copy->data, blocks[b], blockLength(b)*sizeof(T));
+		copy->ref.ref();
+
+		releaseBlock(b);
+		owners[b] = copy;
+		blocks[b] = copy->data;
+		updateContiguous();
+	}
+
+	return blocks[b][i & (BlockSize-1)];
+}
+
+template<class T>
+T* CowArray<T>::materialize()
+{
+	const int n_blocks = blocks.size();
+
+	// a contiguous buffer only this array uses is its own
+	if (own == 0 && contiguous != 0 && n_blocks > 0 &&
+	    owners[0]->bytes >= static_cast<qint64>(n)*sizeof(T) &&
+	    owners[0]->ref.fetchAndAddOrdered(0) == n_blocks) {
+		own = owners[0];
+		own_blocks = n_blocks;
+	}
+
+	if (own == 0 || own->ref.fetchAndAddOrdered(0) != own_blocks) {
+		Buffer *target = takeSpare();
+		for (int b=0; b<n_blocks; ++b)
+			memcpy(target->data + (b << BlockShift), blocks[b], blockLength(b)*sizeof(T));
+
+		releaseBlocks();
+		for (int b=0; b<n_blocks; ++b) {
+			blocks[b] = target->data + (b << BlockShift);
+			owners[b] = target;
+			target->ref.ref();
+		}
+		own = target;
+		own_blocks = n_blocks;
+	}
+	else if (own_blocks != n_blocks) {
+		// own is private, move the blocks written elsewhere back
+		for (int b=0; b<n_blocks; ++b) {
+			if (owners[b] == own)
+				continue;
+
+			T *own_block = own->data + (b << BlockShift);
+			memcpy(own_block, blocks[b], blockLength(b)*sizeof(T));
+			release(owners[b]);
+			blocks[b] = own_block;
+			owners[b] = own;
+			own->ref.ref();
+			own_blocks++;
+		}
+	}
+
+	contiguous = own->data;
+	return contiguous;
+}
+
+template<class T>
+int CowArray<T>::sharedBlocks() const
+{
+	int n_shared = 0;
+
+	for (unsigned b=0; b<blocks.size(); ++b)
+		if (!isPrivate(b))
+			n_shared++;
+
+	return n_shared;
+}
+
+template<class T>
+typename CowArray<T>::Buffer* CowArray<T>::allocateBuffer(int elements)
+{
+	Buffer *b = new Buffer;
+	b->bytes = static_cast<qint64>(elements)*sizeof(T);
+	b->data = static_cast<T*>(ModelBufferPool::allocate(b->bytes));
+
+	if (b->data == 0) {
+		delete b;
+		throw std::bad_alloc();
+	}
+
+	return b;
+}
+
+template<class T>
+typename CowArray<T>::Buffer* CowArray<T>::takeSpare()
+{
+	Buffer *b = spare;
+	spare = 0;
+
+	return b != 0 ? b : allocateBuffer(n);
+}
+
+template<class T>
+void CowArray<T>::release(Buffer *b)
+{
+	if (b != 0 && b->ref.deref() == false)
+		free(b);
+}
+
+template<class T>
+void CowArray<T>::free(Buffer *b)
+{
+	if (b != 0) {
+		ModelBufferPool::release(b->data, b->bytes);
+		delete b;
+	}
+}
+
+template<class T>
+void CowArray<T>::releaseBlock(int block)
+{
+	if (owners[block] == own && --own_blocks == 0)
+		own = 0;
+
+	release(owners[block]);
+	owners[block] = 0;
+}
+
+template<class T>
+void CowArray<T>::releaseBlocks()
+{
+	for (unsigned b=0; b<owners.size(); ++b)
+		release(owners[b]);
+
+	std::fill(owners.begin(), owners.end(), static_cast<Buffer*>(0));
+	own = 0;
+	own_blocks = 0;
+}
+
+/* Whether no other array references the buffer of block. Only own counts
+ * the blocks of this array in it, so other buffers referenced by more than
+ * one of its blocks are treated as shared, and are copied by write().
+ */
+template<class T>
+bool CowArray<T>::isPrivate(int block) const
+{
+	const Buffer *b = owners[block];
+	const int refs = const_cast<Buffer*>(b)->ref.fetchAndAddOrdered(0);
+
+	return b == own ? refs == own_blocks : refs == 1;
+}
+
+template<class T>
+void CowArray<T>::updateContiguous()
+{
+	contiguous = blocks.empty() ? 0 : blocks[0];
+	for (unsigned b=1; b<blocks.size(); ++b) {
+		if (owners[b] != owners[0] || blocks[b] != contiguous + (b << BlockShift)) {
+			contiguous = 0;
+			return;
+		}
+	}
+}
+
+template<class T>
+int CowArray<T>::blockLength(int block) const
+{
+	const int begin = block << BlockShift;
+	return std::min(static_cast<int>(BlockSize), n - begin);
+}
+
+#endif // COWARRAY_H
@@ -20,6 +20,7 @@
 #include <QScriptEngine>
 #include <QScriptValueIterator>
 #include <QSqlQuery>
+#include <QThreadStorage>
 #include "common.h"
 #include "disease.h"
 #include "model.h"
@@ -30,7 +31,19 @@ namespace {
 bool diseases_loaded = false;
 int int_disease_id = 0;
 DiseaseList all_diseases;
-QScriptEngine *e = NULL;
+
+/* Models of a range are processed concurrently, so each thread has its
+ * own script engine.
+ */
+QThreadStorage<QScriptEngine*> engines;
+
+QScriptEngine* scriptEngine()
+{
+	if (!engines.hasLocalData())
+		engines.setLocalData(new QScriptEngine);
+
+	return engines.localData();
+}
 
 }
 
@@ -51,10 +64,7 @@ Disease::Disease(const QString &s)
 	is_readonly = false;
 
 	/* Parse the script and extract name, description, and paramters */
-	if (e == NULL) {
-		e = new QScriptEngine;
-	}
-	QScriptValue prog = e->evaluate(program);
+	QScriptValue prog = scriptEngine()->evaluate(program);
 	QScriptValue v = prog.property("name");
 	if (v.isFunction()) {
 		v = v.call();
@@ -208,7 +218,11 @@ Range Disease::paramRange(int n) const
 #define SET_GLOBAL_PROPERTY(a) global.setProperty("lung_"#a, model.getResult(Model::a##_value))
 void Disease::processModel(Model &model)
 {
-	QScriptValue p = e->evaluate(program);
+	/* Copies of the program share its compiled form, which is per engine,
+	 * so concurrent models evaluate the source.
+	 */
+	QScriptEngine *e = scriptEngine();
+	QScriptValue p = e->evaluate(program.sourceCode());
 
 	QScriptValue global = e->globalObject();
 	QScriptValue artery_function = p.property("artery", QScriptValue::ResolveLocal);
@@ -31,6 +31,27 @@ AbstractIntegrationHelper::~AbstractIntegrationHelper()
 
 }
 
+void AbstractIntegrationHelper::pressure0()
+{
+	Vessel *a = arteries();
+	for (int i=0; i<nArteries(); ++i)
+		a[i].pressure_0 = calculatePressure0(a[i]);
+
+	Vessel *v = veins();
+	for (int i=0; i<nVeins(); ++i)
+		v[i].pressure_0 = calculatePressure0(v[i]);
+}
+
+void AbstractIntegrationHelper::setVessel(Vessel::Type t, int i, const Vessel &v)
+{
+	if (t == Vessel::Artery)
+		model->art_store.write(i) = v;
+	else
+		model->vein_store.write(i) = v;
+
+	model->updateVesselPointers();
+}
+
 double AbstractIntegrationHelper::integrate()
 {
 	switch (solver_type) {
@@ -38,6 +59,8 @@ double AbstractIntegrationHelper::integrate()
 		return multiSegmentedVessels();
 	case Model::RigidVesselFlow:
 		return singleSegmentVessels();
+	case Model::AdaptiveVesselFlow:
+		return adaptiveSegmentedVessels();
 	}
 
 	return 0.0;
@@ -35,22 +35,103 @@ public:
 	virtual double multiSegmentedVessels() = 0;
 	virtual double singleSegmentVessels() = 0;
 
+	// helpers without adaptive integration use nSums segments
+	virtual double adaptiveSegmentedVessels() { return multiSegmentedVessels(); }
+
 	virtual double capillaryResistances() = 0;
 
+	/* Sets pressure_0 of all arteries and veins from their perivascular
+	 * pressure parameters, see Model::calculatePressure0(). Called by
+	 * Model::calc() after a model reset.
+	 */
+	virtual void pressure0();
+
+	/* Called by Model::calc() before the first iteration, once model
+	 * parameters are final. Used to precalculate per-model data.
+	 */
+	virtual void beginCalculation() {}
+
+	// Called by Model::calc() after the last iteration
+	virtual void endCalculation() {}
+
 	virtual bool isAvailable() const { return true; }
 	virtual int hasErrors() const { return 0; }
 
+	/* Helpers that can integrate directly from the Model's solver arrays
+	 * return true here. Other helpers always see the Vessel structures.
+	 */
+	virtual bool supportsStructureOfArrays() const { return false; }
+
+	/* Range versions of integrate() and capillaryResistances(), used by
+	 * the Model's fused sweep. They return the maximum deviation within
+	 * [begin, end) and can be called concurrently for disjoint ranges,
+	 * by different workers of the solver pool. Helpers implementing them
+	 * return true from supportsRanges().
+	 */
+	virtual bool supportsRanges() const { return false; }
+	virtual double integrateRange(int, Vessel::Type, int, int) { return 0.0; }
+	virtual double capillaryResistanceRange(int, int, int) { return 0.0; }
+
+	/* Like capillaryResistanceRange(), but solves all capillaries in
+	 * [begin, end), including those left out by the active set. Used by
+	 * the Model's local capillary solve.
+	 */
+	virtual double resolveCapillaryRange(int, int, int) { return 0.0; }
+
+	/* Active set. The select functions choose the elements integrated by
+	 * the following integration calls and record their flow and pressures.
+	 * Elements are left out when they have nothing to integrate, or when
+	 * their last deltaR and the change of flow and pressures since their
+	 * last integration are below activeSetTolerance(). With all, every
+	 * element is selected. Returns the largest last deltaR of the elements
+	 * left out. beginCalculation() selects all elements.
+	 */
+	virtual bool supportsActiveSet() const { return false; }
+	virtual double selectActiveVessels(bool all) { Q_UNUSED(all); return 0.0; }
+	virtual double selectActiveCapillaries(bool all) { Q_UNUSED(all); return 0.0; }
+	double activeSetTolerance() const { return 0.1*Tlrns(); }
+
+	/* Largest estimated relative error of a segment's pressure drop
+	 * accepted by adaptive vessel integration. The estimate is that of the
+	 * embedded lower order result, the actual error is much smaller.
+	 */
+	double adaptiveTolerance() const { return Tlrns(); }
+
+	/* Restricts the following integration calls to the given elements,
+	 * in ascending order, for the Model's coarse solve. Null selects all
+	 * elements. Requires supportsActiveSet().
+	 */
+	virtual void selectElements(const std::vector<int> *arteries,
+	                            const std::vector<int> *veins,
+	                            const std::vector<int> *capillaries)
+	{ Q_UNUSED(arteries); Q_UNUSED(veins); Q_UNUSED(capillaries); }
+
 protected:
 	bool isOutsideLung(int vessel_idx) const { return model->isOutsideLung(vessel_idx); }
 	Vessel* arteries() { return model->arteries; }
 	Vessel* veins() { return model->veins; }
 	Capillary* capillaries() { return model->caps; }
+	/* A vessel outside of calc(), when the arrays above may be shared
+	 * with other models, see CowArray. setVessel() writes through the
+	 * copy-on-write storage.
+	 */
+	const Vessel& vessel(Vessel::Type t, int i) const
+	{ return t == Vessel::Artery ? model->art_store.at(i) : model->vein_store.at(i); }
+	void setVessel(Vessel::Type t, int i, const Vessel &v);
+	bool structureOfArrays() const { return model->soa_active; }
+	VesselArrays& arteryArrays() { return model->art_arrays; }
+	VesselArrays& veinArrays() { return model->vein_arrays; }
+	CapillaryArrays& capillaryArrays() { return model->cap_arrays; }
+	SolverPool& solverPool() { return model->solverPool(); }
 	int nArteries() const { return model->numArteries(); }
 	int nVeins() const { return model->numVeins(); }
 	int nCaps() const { return model->numCapillaries(); }
 	int index(int gen, int idx) const { return model->startIndex(gen)+idx; }
 	double Hct() const { return model->Hct; }
 	double Tlrns() const { return model->Tlrns; }
+	static double calculatePressure0(const Vessel &v) { return Model::calculatePressure0(v); }
+	Model::IntegralType integralType() const { return solver_type; }
+	Model::Precision precision() const { return model->precision(); }
 
 	double arteryRatio(int idx) const {
 		const int gen = model->gen_no(idx);
@@ -0,0 +1,111 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAPILLARY_SOLVER_H
+#define CAPILLARY_SOLVER_H
+
+#include "model/vmath.h"
+
+enum {
+	capillary_max_iterations = 60
+};
+
+const double capillary_tolerance = 1e-10; // relative change of Ptma
+
+/* Sheet height of a capillary at transmural pressure p, and its derivative
+ * dH/dp. The height rises from Ho to Hmax = Ho + plr*Alpha, where plr is the
+ * pressure range over which the curve is linear.
+ */
+template<class T>
+VMATH_INLINE T capillarySheetHeight(T p, T Ho, T Alpha, T &dH_dp)
+{
+	const double plr = 16.0;
+	const double d = plr/4.0;
+
+	const T Hmax = Ho + plr*Alpha;
+	const T H = Hmax/(1.0 + (Hmax/Ho-1.0)*vmath::exp(-p/d));
+
+	dH_dp = H*(1.0 - H/Hmax)/d;
+	return H;
+}
+
+/* Solves for the capillary inlet pressure Ptma at constant flow,
+ *
+ *   F(Ptma) = Ptma - P0 - c/S(Hin(Ptma), Hout) = 0
+ *   S(Hin, Hout) = Hin^3 + Hin^2*Hout + Hin*Hout^2 + Hout^3
+ *
+ * where P0 is the outlet pressure plus the Starling resistor pressure drop
+ * and c = flow*Krc/Alpha. F' >= 1 and Hin >= Hout, so the root lies in
+ * [P0, P0 + c/(4*Hout^3)]. Newton steps use the analytic dH/dp and fall back
+ * to bisection when they leave the bracket.
+ *
+ * Returns Ptma, and Hin, S and the number of iterations at Ptma. T is double
+ * or one of the SIMD kernel vector types. Lanes converge independently and
+ * are frozen once converged.
+ */
+template<class T>
+VMATH_INLINE T capillaryInletPressure(T P0, T c, T Ho, T Alpha, T Hout,
+                                      T &Hin, T &S, T &iterations)
+{
+	typedef vmath::Traits<T> tr;
+
+	const T Hout2 = Hout*Hout;
+	const T Hout3 = Hout2*Hout;
+
+	T lo = P0;
+	T hi = P0 + c/(4.0*Hout3);
+	T x = hi;
+
+	typename tr::Int done = x < x; // none
+	Hin = Hout;
+	S = 4.0*Hout3;
+	iterations = tr::splat(0.0);
+
+	for (int i=0; i<capillary_max_iterations; ++i) {
+		T dH;
+		const T H = capillarySheetHeight(x, Ho, Alpha, dH);
+		const T s = ((H + Hout)*H + Hout2)*H + Hout3;
+		const T q = c/s;
+		const T F = x - P0 - q;
+		const T dF = 1.0 + q/s*((3.0*H + 2.0*Hout)*H + Hout2)*dH;
+
+		lo = tr::select(F < 0.0, x, lo);
+		hi = tr::select(F < 0.0, hi, x);
+
+		T next = x - F/dF;
+		next = tr::select((next >= lo) & (next <= hi), next, 0.5*(lo+hi));
+
+		Hin = tr::select(done, Hin, H);
+		S = tr::select(done, S, s);
+		iterations = tr::select(done, iterations, iterations+1.0);
+
+		const T step = next - x;
+		const typename tr::Int converged =
+		        tr::select(step < 0.0, -step, step) <= capillary_tolerance*next;
+
+		x = tr::select(done, x, next);
+		done = done | converged;
+		if (tr::all(done))
+			break;
+	}
+
+	return x;
+}
+
+#endif // CAPILLARY_SOLVER_H
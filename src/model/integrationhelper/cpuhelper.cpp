@@ -17,51 +17,168 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QtConcurrentRun>
-#include <QtConcurrentMap>
-#include <QFuture>
-#include <QFutureSynchronizer>
-#include <QThread>
+#include <QMutex>
+#include <QString>
 #include "common.h"
+#include "dbsettings.h"
+#include <algorithm>
 #include <limits>
+#include "capillarysolver.h"
 #include "cpuhelper.h"
+#include "model/solverpool.h"
 #include <vector>
 
 extern const double K1;
 extern const double K2;
 extern const int nSums;
 
-const double Kr = 1.2501e8; // cP/um**3 => mmHg*min/l
+static QMutex simd_lock;
+static int simd_selected_isa = -1;
 
-namespace {
-// helper functions
+CpuIntegrationHelper::CpuIntegrationHelper(Model *model, Model::IntegralType type)
+        : AbstractIntegrationHelper(model, type)
+{
+	use_simd = DbSettings::value(settings_simd_enabled, true).toBool();
+	simd_isa = SimdVesselKernel::Scalar;
+	kernel_precision = Model::DoublePrecision;
+}
 
-inline double viscosityFactor(double D, double Hct)
+void CpuIntegrationHelper::beginCalculation()
 {
-	const double C = (0.8+exp(-0.075*D)) * ((1/(1 + 1e-11*pow(D, 12)))-1.0) + (1/(1+1e-11*pow(D,12)));
-	const double Mi45 = 220 * exp(-1.3*D) - 2.44*exp(-0.06*pow(D, 0.645)) + 3.2;
-	const double bb = (C<-0.01 || C>0.01) ?
-	                          (pow(1-Hct, C)-1)/(pow(1.0-0.45, C)-1) :
-	                          std::log(1-Hct)/std::log(1.0-0.45);
-	return (1.0 + (Mi45-1.0)*bb) / 3.2;
+	buildViscosityTable();
+
+	simd_isa = use_simd ? selectSimdIsa() : SimdVesselKernel::Scalar;
+	kernel_precision = selectPrecision(simd_isa, precision());
+
+	art_active.active = false;
+	vein_active.active = false;
+	cap_active.active = false;
+
+	const int n_workers = solverPool().threadCount();
+	worker_cap_stats.assign(n_workers, CapillaryStatistics());
+	worker_vessel_stats.assign(n_workers, VesselStatistics());
+
+	QMutexLocker lock(&stats_lock);
+	cap_stats = CapillaryStatistics();
+	vessel_stats = VesselStatistics();
 }
 
+// once the pool is idle, after each pass
+void CpuIntegrationHelper::mergeStatistics()
+{
+	QMutexLocker lock(&stats_lock);
+
+	for (unsigned i=0; i<worker_cap_stats.size(); ++i) {
+		cap_stats.merge(worker_cap_stats[i]);
+		worker_cap_stats[i] = CapillaryStatistics();
+	}
+
+	for (unsigned i=0; i<worker_vessel_stats.size(); ++i) {
+		vessel_stats.merge(worker_vessel_stats[i]);
+		worker_vessel_stats[i] = VesselStatistics();
+	}
 }
 
-CpuIntegrationHelper::CpuIntegrationHelper(Model *model, Model::IntegralType type)
-        : AbstractIntegrationHelper(model, type)
+void CpuIntegrationHelper::buildViscosityTable()
 {
+	if (!viscosity.isBuilt() || viscosity.hct() != Hct())
+		viscosity.build(Hct());
+}
 
+void CpuIntegrationHelper::endCalculation()
+{
+	// passes of the Model's fused sweep and local capillary solve
+	mergeStatistics();
+
+	const VesselStatistics v_stats = vesselStatistics();
+	if (v_stats.vessels > 0)
+		qDebug() << "Adaptive vessel integration:" << v_stats.vessels << "vessels, mean"
+		         << v_stats.meanSegments() << "segments and" << v_stats.meanEvaluations()
+		         << "diameter evaluations, fixed" << nSums;
+
+	const CapillaryStatistics stats = capillaryStatistics();
+	if (stats.solves == 0)
+		return;
+
+	QString histogram;
+	for (int i=0; i<CapillaryStatistics::n_bins; ++i)
+		if (stats.histogram[i] > 0)
+			histogram += QString(histogram.isEmpty() ? "%1%2:%3" : " %1%2:%3").arg(i)
+			             .arg(i == CapillaryStatistics::n_bins-1 ? "+" : "")
+			             .arg(stats.histogram[i]);
+
+	qDebug() << "Capillary solver:" << stats.solves << "solves, mean"
+	         << stats.mean() << "max" << stats.max_iterations
+	         << "Newton iterations, histogram" << qPrintable(histogram);
+}
+
+CpuIntegrationHelper::CapillaryStatistics CpuIntegrationHelper::capillaryStatistics() const
+{
+	QMutexLocker lock(&stats_lock);
+	return cap_stats;
+}
+
+CpuIntegrationHelper::VesselStatistics CpuIntegrationHelper::vesselStatistics() const
+{
+	QMutexLocker lock(&stats_lock);
+	return vessel_stats;
+}
+
+CpuIntegrationHelper::VesselStatistics::VesselStatistics()
+        : vessels(0), segments(0), evaluations(0)
+{
+}
+
+void CpuIntegrationHelper::VesselStatistics::add(int n_segments, int n_evaluations)
+{
+	vessels++;
+	segments += n_segments;
+	evaluations += n_evaluations;
+}
+
+void CpuIntegrationHelper::VesselStatistics::merge(const VesselStatistics &other)
+{
+	vessels += other.vessels;
+	segments += other.segments;
+	evaluations += other.evaluations;
+}
+
+CpuIntegrationHelper::CapillaryStatistics::CapillaryStatistics()
+        : solves(0), iterations(0), max_iterations(0)
+{
+	std::fill(histogram, histogram+n_bins, 0);
+}
+
+void CpuIntegrationHelper::CapillaryStatistics::add(int n)
+{
+	solves++;
+	iterations += n;
+	max_iterations = std::max(max_iterations, n);
+	histogram[std::min(n, int(n_bins-1))]++;
+}
+
+void CpuIntegrationHelper::CapillaryStatistics::merge(const CapillaryStatistics &other)
+{
+	solves += other.solves;
+	iterations += other.iterations;
+	max_iterations = std::max(max_iterations, other.max_iterations);
+	for (int i=0; i<n_bins; ++i)
+		histogram[i] += other.histogram[i];
 }
 
 double CpuIntegrationHelper::multiSegmentedVessels()
 {
-	return vesselIntegration(&CpuIntegrationHelper::multiSegmentedFlowVessel);
+	return vesselIntegration(Model::SegmentedVesselFlow);
 }
 
 double CpuIntegrationHelper::singleSegmentVessels()
 {
-	return vesselIntegration(&CpuIntegrationHelper::singleSegmentVessel);
+	return vesselIntegration(Model::RigidVesselFlow);
+}
+
+double CpuIntegrationHelper::adaptiveSegmentedVessels()
+{
+	return vesselIntegration(Model::AdaptiveVesselFlow);
 }
 
 void CpuIntegrationHelper::integrateWithDimentions(Vessel::Type t,
@@ -69,48 +186,48 @@ void CpuIntegrationHelper::integrateWithDimentions(Vessel::Type t,
                                                    int idx,
                                                    std::vector<double> &calc_dim)
 {
+	// only the table, the calculation state may be of a calc() in progress
+	buildViscosityTable();
+
 	calc_dim.clear();
 	calc_dim.reserve(nSums);
-	Vessel *v_ptr = (t==Vessel::Artery) ? arteries() : veins();
-	multiSegmentedFlowVessel(v_ptr[index(gen, idx)], &calc_dim);
+
+	// the model's storage may be shared with other models
+	const int i = index(gen, idx);
+	Vessel v = vessel(t, i);
+	multiSegmentedFlowVessel(v, &calc_dim);
+	setVessel(t, i, v);
 }
 
 double CpuIntegrationHelper::capillaryResistances()
 {
-	QFutureSynchronizer<double> threads;
-	int thread_count = QThread::idealThreadCount();
-	if (thread_count < 1)
-		thread_count = 4;
+	SolverPool &pool = solverPool();
+	worker_deviation.assign(pool.threadCount(), 0.0);
+	worker_cap_stats.resize(pool.threadCount());
 
-	cap_no = 0;
+	SolverMemberTask<CpuIntegrationHelper, bool> task(
+	        this, &CpuIntegrationHelper::capillaryRange, structureOfArrays());
+	pool.run(task, 0, cap_active.size(nCaps()), 1024);
+	mergeStatistics();
 
-	while (thread_count--)
-		threads.addFuture(
-		        QtConcurrent::run(this,
-		                &CpuIntegrationHelper::capillaryThread));
-
-	threads.waitForFinished();
-
-	double max_deviation = 0;
-	foreach (QFuture<double> future, threads.futures())
-		max_deviation = qMax(max_deviation, future.result());
-
-	return max_deviation;
+	return *std::max_element(worker_deviation.begin(), worker_deviation.end());
 }
 
-double CpuIntegrationHelper::capillaryResistance(Capillary &cap)
+template<class C>
+double CpuIntegrationHelper::capillaryResistance(C &cap, CapillaryStatistics &stats)
 {
 	const double Ri = cap.R;
 	const double & Ptmv = cap.pressure_out;
 
 	switch (cap.open_state) {
 	case Capillary_Closed:
-		cap.last_delta_R = 0.0;
-
-		if (isinf(cap.R))
+		if (isinf(cap.R)) {
+			cap.last_delta_R = 0.0;
 			return 0.0;
+		}
 
 		cap.R = std::numeric_limits<double>::infinity();
+		cap.last_delta_R = 1.0;
 		return 1.0;
 
 	case Capillary_Auto:
@@ -121,36 +238,28 @@ double CpuIntegrationHelper::capillaryResistance(Capillary &cap)
 	/* Calculate pressure in as a function of constant flow and pressure out.
 	 * Based on this, calculate R
 	 */
-	double Ptma;
-
 	if (isnan(cap.flow) || isnan(Ptmv) || cap.flow < 1e-50) {
 		// flow is 0, Ptma == Ptmv, R is unchanged
-		Ptma = Ptmv;
 		cap.last_delta_R = 0.0;
 		return 0.0;
 	}
 
 	double starlingR = -std::min(0.0, Ptmv) / cmH2O_per_mmHg / cap.flow;
 	double P = std::max(0.0, Ptmv); // starling resistor adjusted Pout
-	cap.Hout = capillaryH(cap, P);
-	Ptma = P + cap.flow * (1/cap.Alpha) * cap.Krc * 4.0/(sqr(sqr(cap.Hout)));
 
-	double diff;
-	int i=0;
-	do {
-		cap.Hin = capillaryH(cap, Ptma);
-
-		cap.R = starlingR +
-		        cap.Krc/(cap.Alpha*cmH2O_per_mmHg *
-		                 (cap.Hin*cap.Hin*cap.Hin +
-		                  cap.Hin*cap.Hin*cap.Hout +
-		                  cap.Hin*cap.Hout*cap.Hout +
-		                  cap.Hout*cap.Hout*cap.Hout));
-		double P1 = Ptma;
-		Ptma = P + cap.flow*cap.R*cmH2O_per_mmHg;
-		diff = std::fabs(P1-Ptma)/Ptma;
-	} while(i++<100 && diff > 1e-6);
+	double dH, S, iterations;
+	cap.Hout = capillarySheetHeight(P, cap.Ho, cap.Alpha, dH);
+	capillaryInletPressure(P - std::min(0.0, Ptmv), cap.flow*cap.Krc/cap.Alpha,
+	                       cap.Ho, cap.Alpha, cap.Hout, cap.Hin, S, iterations);
+	cap.R = starlingR + cap.Krc/(cap.Alpha*cmH2O_per_mmHg*S);
+	stats.add(int(iterations));
 
+	return capillaryDeltaR(cap, Ri);
+}
+
+template<class C>
+double CpuIntegrationHelper::capillaryDeltaR(C &cap, double Ri)
+{
 	if (cap.R > 1e12 && cap.R > 1e12) {
 		// change no longer affects flow, so ignore it
 		// otherwise loop will continue forever!
@@ -164,26 +273,10 @@ double CpuIntegrationHelper::capillaryResistance(Capillary &cap)
 	return cap.last_delta_R; // return different from target tolerance
 }
 
-double CpuIntegrationHelper::capillaryH(const Capillary &cap, double pressure)
-
-{
-	double Hmax, d, plr; // plr=pressure range over which curve is linear
-	double exp_cd;
-
-	plr=16.0;
-	d = plr/4.0;
-	Hmax = cap.Ho + plr*cap.Alpha;
-	exp_cd = Hmax/cap.Ho-1;
-
-	return Hmax/(1+exp_cd*std::exp(-pressure/d));
-
-}
-
-
-double CpuIntegrationHelper::singleSegmentVessel(Vessel &v)
+template<class V>
+double CpuIntegrationHelper::singleSegmentVessel(V &v)
 {
 	/* NOTE: calc_dim is assumed empty, if supplied */
-	const double hct = Hct();
 	double Rin = v.R;
 	double Pin = v.pressure_in;
 	const double Pout = std::max(v.pressure_0, v.pressure_out);
@@ -221,7 +314,7 @@ double CpuIntegrationHelper::singleSegmentVessel(Vessel &v)
 	}
 
 	double Px = v.Ppl + v.perivascular_press_a +
-	            v.perivascular_press_b/(1.0 + std::exp(
+	            v.perivascular_press_b/(1.0 + vmath::exp(
 	                       (v.perivascular_press_c-Pv+v.Ppl)/v.perivascular_press_d
 	                       ));
 	double Ptm = Pv - Px;
@@ -241,13 +334,13 @@ double CpuIntegrationHelper::singleSegmentVessel(Vessel &v)
 		double avg_P = (new_Pin + Pout) / 2.0;
 		Pv = cmH2O_per_mmHg * ( avg_P - v.tone );
 		Px = v.Ppl + v.perivascular_press_a +
-		     v.perivascular_press_b/(1.0 + std::exp(
+		     v.perivascular_press_b/(1.0 + vmath::exp(
 		                (v.perivascular_press_c-Pv+v.Ppl)/v.perivascular_press_d
 		                ));
 		Ptm = Pv - Px;
 
-		D = v.D*v.gamma - (v.gamma-1.0)*v.D*exp(-Ptm*v.phi/(v.gamma-1.0));
-		const double vf = viscosityFactor(D, hct);
+		D = v.D*v.gamma - (v.gamma-1.0)*v.D*vmath::exp(-Ptm*v.phi/(v.gamma-1.0));
+		const double vf = viscosity.value(D);
 		Rs = 128*Kr/M_PI * vf * dL / sqr(sqr(D)) * v.vessel_ratio;
 		v.viscosity_factor = vf;
 
@@ -273,7 +366,8 @@ double CpuIntegrationHelper::singleSegmentVessel(Vessel &v)
 	return v.last_delta_R;
 }
 
-double CpuIntegrationHelper::multiSegmentedFlowVessel(Vessel &v)
+template<class V>
+double CpuIntegrationHelper::multiSegmentedFlowVessel(V &v)
 {
 	/* In case where flow is nil, the vessel has constant pressure
 	 * across it and then the faster algorithm is really really the same
@@ -285,11 +379,11 @@ double CpuIntegrationHelper::multiSegmentedFlowVessel(Vessel &v)
 	return multiSegmentedFlowVessel(v, NULL);
 }
 
-double CpuIntegrationHelper::multiSegmentedFlowVessel(Vessel &v,
+template<class V>
+double CpuIntegrationHelper::multiSegmentedFlowVessel(V &v,
                                                       std::vector<double> *calc_dim)
 {
 	/* NOTE: calc_dim is assumed empty, if supplied */
-	const double hct = Hct();
 	double Rtot = 0.0;
 	double Rin = v.R;
 	double P = std::max(v.pressure_0, v.pressure_out); // pressure to the right (LAP) of the vessel
@@ -325,14 +419,14 @@ double CpuIntegrationHelper::multiSegmentedFlowVessel(Vessel &v,
 	for( int j=0; j<nSums; j++ ) {
 		double Pv = cmH2O_per_mmHg * ( P - v.tone );
 		double Px = v.Ppl + v.perivascular_press_a +
-		            v.perivascular_press_b/(1.0 + std::exp(
+		            v.perivascular_press_b/(1.0 + vmath::exp(
 		                       (v.perivascular_press_c-Pv+v.Ppl)/v.perivascular_press_d
 		                       ));
 		double Ptm = Pv - Px;
 
-		D = v.D*v.gamma - (v.gamma-1.0)*v.D*exp(-Ptm*v.phi/(v.gamma-1.0));
+		D = v.D*v.gamma - (v.gamma-1.0)*v.D*vmath::exp(-Ptm*v.phi/(v.gamma-1.0));
 		D_integral += D;
-		const double vf = viscosityFactor(D, hct);
+		const double vf = viscosity.value(D);
 
 		if (calc_dim)
 			calc_dim->push_back(D);
@@ -359,68 +453,1013 @@ double CpuIntegrationHelper::multiSegmentedFlowVessel(Vessel &v,
 	return v.last_delta_R;
 }
 
-double CpuIntegrationHelper::vesselIntegration(double(CpuIntegrationHelper::* func)(Vessel&))
+// vessel diameter at pressure P, as in multiSegmentedFlowVessel
+template<class V>
+static inline double segmentDiameter(const V &v, double P)
 {
-	QFutureSynchronizer<double> threads;
-	int thread_count = QThread::idealThreadCount();
-	if (thread_count < 1)
-		thread_count = 4;
+	double Pv = cmH2O_per_mmHg * ( P - v.tone );
+	double Px = v.Ppl + v.perivascular_press_a +
+	            v.perivascular_press_b/(1.0 + vmath::exp(
+	                       (v.perivascular_press_c-Pv+v.Ppl)/v.perivascular_press_d
+	                       ));
+	double Ptm = Pv - Px;
 
-	artery_no = 0;
-	vein_no = 0;
+	return v.D*v.gamma - (v.gamma-1.0)*v.D*vmath::exp(-Ptm*v.phi/(v.gamma-1.0));
+}
 
-	while (thread_count--)
-		threads.addFuture(
-		        QtConcurrent::run(this,
-		                &CpuIntegrationHelper::vesselIntegrationThread,
-		                func));
+template<class V>
+double CpuIntegrationHelper::adaptiveSegmentedFlowVessel(V &v, VesselStatistics &stats)
+{
+	/* Integrates dP/dx = flow * r(D(P)) from the outlet with the
+	 * Bogacki-Shampine 3(2) pair. A step is accepted when the difference to
+	 * the embedded second order result is below adaptiveTolerance() of the
+	 * step's pressure drop, which bounds the relative error of the whole
+	 * vessel's resistance the same way. D, the viscosity factor and D**2 are
+	 * integrated with the same weights. Steps are never shorter than
+	 * length/nSums. The vector kernel does the same per lane.
+	 */
+	const double Pout = std::max(v.pressure_0, v.pressure_out);
+	if (v.flow == 0.0 || isnan(Pout) || v.D < 0.1)
+		return multiSegmentedFlowVessel(v);
+
+	const double Rin = v.R;
+	const double starling_P = v.pressure_0 - std::min(v.pressure_out, v.pressure_0);
+	const double starling_R = (starling_P < 1e-10 && v.flow < 1e-10) ? 0 : starling_P/v.flow;
+
+	const double tolerance = adaptiveTolerance();
+	const double L = v.length;
+	const double min_h = L / (double)nSums;
+
+	// stages, P[i] -> D[i] -> vf[i] -> resistance per length r[i]
+	double P[4], D[4], vf[4], r[4];
+
+	P[0] = Pout;
+	D[0] = segmentDiameter(v, P[0]);
+	vf[0] = viscosity.value(D[0]);
+	r[0] = 128*Kr/M_PI * vf[0] / sqr(sqr(D[0])) * v.vessel_ratio;
+	int evaluations = 1;
+
+	v.Dmin = D[0];
+
+	double x = 0.0, h = L;
+	double Rtot = 0.0, D_integral = 0.0, vf_integral = 0.0, D2_integral = 0.0;
+	int segments = 0;
+
+	for (;;) {
+		const bool last = h >= L - x;
+		if (last)
+			h = L - x;
+
+		// stages at h/2 and 3h/4, then the third order result at h
+		const double q = v.flow*h;
+		for (int i=1; i<4; ++i) {
+			if (i == 1)
+				P[1] = P[0] + 0.5*q*r[0];
+			else if (i == 2)
+				P[2] = P[0] + 0.75*q*r[1];
+			else
+				P[3] = P[0] + q*(2.0/9.0*r[0] + 1.0/3.0*r[1] + 4.0/9.0*r[2]);
+
+			D[i] = segmentDiameter(v, P[i]);
+			vf[i] = viscosity.value(D[i]);
+			r[i] = 128*Kr/M_PI * vf[i] / sqr(sqr(D[i])) * v.vessel_ratio;
+		}
+		evaluations += 3;
+
+		const double dR = h*(2.0/9.0*r[0] + 1.0/3.0*r[1] + 4.0/9.0*r[2]);
+		const double err = fabs(h*(-5.0/72.0*r[0] + 1.0/12.0*r[1] + 1.0/9.0*r[2] - 0.125*r[3]));
+		const double allowed = tolerance*fabs(dR);
+
+		if (err <= allowed || h <= min_h) {
+			Rtot += dR;
+			D_integral += h*(2.0/9.0*D[0] + 1.0/3.0*D[1] + 4.0/9.0*D[2]);
+			vf_integral += h*(2.0/9.0*vf[0] + 1.0/3.0*vf[1] + 4.0/9.0*vf[2]);
+			D2_integral += h*(2.0/9.0*D[0]*D[0] + 1.0/3.0*D[1]*D[1] + 4.0/9.0*D[2]*D[2]);
+			segments++;
+
+			// last stage is the first of the next step
+			P[0] = P[3];
+			D[0] = D[3];
+			vf[0] = vf[3];
+			r[0] = r[3];
+
+			if (last)
+				break;
+			x += h;
+		}
+
+		/* Next step from the third order error estimate, within 0.2 to 5
+		 * times the current step. Undefined errors shrink the step.
+		 */
+		double s = err / allowed;
+		s = s < 1e4 ? s : 1e4;
+		s = s > 1e-4 ? s : 1e-4;
+		double factor = 0.9*vmath::pow(s, -1.0/3.0);
+		factor = factor < 5.0 ? factor : 5.0;
+		factor = factor > 0.2 ? factor : 0.2;
+		h = std::max(h*factor, min_h);
+	}
+
+	stats.add(segments, evaluations);
+
+	v.Dmax = D[0];
+	v.viscosity_factor = vf_integral / L;
+	v.D_calc = D_integral / L;
+	v.volume = M_PI/4.0 * D2_integral / (1e9*v.vessel_ratio); // um**3 => uL, and correct for real number of vessels
+	v.R = Rtot + starling_R;
+	v.last_delta_R = fabs(Rin-v.R)/Rin;
+
+	return v.last_delta_R;
+}
+
+CpuIntegrationHelper::Pressure0Key::Pressure0Key(const Vessel &v)
+        : Ppl(v.Ppl), a(v.perivascular_press_a), b(v.perivascular_press_b),
+          c(v.perivascular_press_c), d(v.perivascular_press_d), tone(v.tone)
+{
+}
+
+bool CpuIntegrationHelper::Pressure0Key::operator==(const Pressure0Key &o) const
+{
+	return Ppl == o.Ppl && a == o.a && b == o.b && c == o.c && d == o.d &&
+	       tone == o.tone;
+}
+
+quint64 CpuIntegrationHelper::Pressure0Key::hash() const
+{
+	const double values[] = { Ppl, a, b, c, d, tone };
+	quint64 h = 0;
+
+	for (unsigned i=0; i<sizeof(values)/sizeof(values[0]); ++i) {
+		quint64 bits;
+		memcpy(&bits, &values[i], sizeof(bits));
+		h = (h ^ bits) * Q_UINT64_C(0x9E3779B97F4A7C15);
+	}
+
+	return h ^ (h >> 32);
+}
+
+void CpuIntegrationHelper::pressure0()
+{
+	simd_isa = use_simd ? selectSimdIsa() : SimdVesselKernel::Scalar;
+
+	SolverPool &pool = solverPool();
+	SolverMemberTask<CpuIntegrationHelper, int> task(
+	        this, &CpuIntegrationHelper::pressure0Range, 0);
+	std::vector<int> table;
+
+	for (int t=0; t<2; ++t) {
+		Vessel *vessels = t == 0 ? arteries() : veins();
+		const int n = t == 0 ? nArteries() : nVeins();
+
+		/* Each distinct parameter tuple of a generation is solved once,
+		 * found through an open addressing table of p0_keys indices.
+		 * Corner vessels follow the last generation, in the range of the
+		 * next one.
+		 */
+		p0_keys.clear();
+		p0_slots.resize(n);
+
+		for (int begin=0, end=1; begin<n; begin=end, end=2*end+1) {
+			const int gen_end = std::min(end, n);
+
+			unsigned size = 16;
+			while (size < 2u*(gen_end-begin))
+				size *= 2;
+			table.assign(size, -1);
+
+			for (int i=begin; i<gen_end; ++i) {
+				const Pressure0Key key(vessels[i]);
+				unsigned h = static_cast<unsigned>(key.hash()) & (size-1);
+
+				while (table[h] >= 0 && !(p0_keys[table[h]] == key))
+					h = (h+1) & (size-1);
+
+				if (table[h] < 0) {
+					table[h] = p0_keys.size();
+					p0_keys.push_back(key);
+				}
+				p0_slots[i] = table[h];
+			}
+		}
+
+		p0_values.resize(p0_keys.size());
+		pool.run(task, 0, p0_keys.size(), 256);
+
+		for (int i=0; i<n; ++i)
+			vessels[i].pressure_0 = p0_values[p0_slots[i]];
+	}
+}
+
+// solves p0_keys [begin, end) into p0_values
+void CpuIntegrationHelper::pressure0Range(int worker, int, int begin, int end)
+{
+	Q_UNUSED(worker);
+
+	const int lanes = simd_isa == SimdVesselKernel::Scalar ? 0 : SimdVesselKernel::lanes(simd_isa);
+
+	if (lanes == 0) {
+		Vessel v;
+		memset(&v, 0, sizeof(v));
+
+		for (int i=begin; i<end; ++i) {
+			const Pressure0Key &key = p0_keys[i];
+			v.Ppl = key.Ppl;
+			v.perivascular_press_a = key.a;
+			v.perivascular_press_b = key.b;
+			v.perivascular_press_c = key.c;
+			v.perivascular_press_d = key.d;
+			v.tone = key.tone;
+			p0_values[i] = calculatePressure0(v);
+		}
+		return;
+	}
+
+	VesselBatch b;
+	memset(&b, 0, sizeof(b));
+
+	for (int first=begin; first<end; first+=lanes) {
+		b.n = std::min(lanes, end-first);
+
+		for (int k=0; k<b.n; ++k) {
+			const Pressure0Key &key = p0_keys[first+k];
+			b.Ppl[k] = key.Ppl;
+			b.perivascular_press_a[k] = key.a;
+			b.perivascular_press_b[k] = key.b;
+			b.perivascular_press_c[k] = key.c;
+			b.perivascular_press_d[k] = key.d;
+			b.tone[k] = key.tone;
+		}
+
+		SimdVesselKernel::pressure0(simd_isa, b);
+		for (int k=0; k<b.n; ++k)
+			p0_values[first+k] = b.pressure_0[k];
+	}
+}
+
+double CpuIntegrationHelper::vesselIntegration(Model::IntegralType solver)
+{
+	SolverPool &pool = solverPool();
+	worker_deviation.assign(pool.threadCount(), 0.0);
+	worker_vessel_stats.resize(pool.threadCount());
+
+	SolverMemberTask<CpuIntegrationHelper, Model::IntegralType> task(
+	        this, &CpuIntegrationHelper::vesselIntegrationRange, solver);
+	pool.run(task, 0, art_active.size(nArteries()) + vein_active.size(nVeins()), 1024);
+	mergeStatistics();
+
+	return *std::max_element(worker_deviation.begin(), worker_deviation.end());
+}
+
+void CpuIntegrationHelper::vesselIntegrationRange(int worker, Model::IntegralType solver,
+                                                  int begin, int end)
+{
+	// arteries are followed by veins
+	const int n_arteries = art_active.size(nArteries());
+	double ret = 0.0;
 
-	threads.waitForFinished();
+	if (begin < n_arteries)
+		ret = integrateVessels(worker, Vessel::Artery, solver,
+		                       begin, std::min(end, n_arteries));
 
-	double max_deviation = 0;
-	foreach (QFuture<double> future, threads.futures())
-		max_deviation = qMax(max_deviation, future.result());
+	if (end > n_arteries)
+		ret = std::max(ret, integrateVessels(worker, Vessel::Vein, solver,
+		                                     std::max(begin, n_arteries) - n_arteries,
+		                                     end - n_arteries));
 
-	return max_deviation;
+	worker_deviation[worker] = std::max(worker_deviation[worker], ret);
 }
 
-double CpuIntegrationHelper::vesselIntegrationThread(double (CpuIntegrationHelper::*func)(Vessel &))
+double CpuIntegrationHelper::integrateRange(int worker, Vessel::Type type, int begin, int end)
 {
+	(type == Vessel::Artery ? art_active : vein_active).position(begin, end);
+	return integrateVessels(worker, type, integralType(), begin, end);
+}
+
+double CpuIntegrationHelper::integrateVessels(int worker, Vessel::Type type,
+                                              Model::IntegralType solver,
+                                              int begin, int end)
+{
+	const ActiveSet &set = (type == Vessel::Artery) ? art_active : vein_active;
+	VesselStatistics &stats = worker_vessel_stats[worker];
+
+	if (structureOfArrays()) {
+		VesselArraysPointer v(type == Vessel::Artery ? arteryArrays() : veinArrays());
+		if (set.active)
+			return integrateVesselRange(IndexedPointer<VesselArraysPointer>(v, set.data()),
+			                            begin, end, solver, simd_isa, kernel_precision, stats);
+		return integrateVesselRange(v, begin, end, solver, simd_isa, kernel_precision, stats);
+	}
+
+	VesselPointer v(type == Vessel::Artery ? arteries() : veins());
+	if (set.active)
+		return integrateVesselRange(IndexedPointer<VesselPointer>(v, set.data()),
+		                            begin, end, solver, simd_isa, kernel_precision, stats);
+	return integrateVesselRange(v, begin, end, solver, simd_isa, kernel_precision, stats);
+}
+
+template<class Vessels>
+double CpuIntegrationHelper::integrateVesselRange(const Vessels &vessels,
+                                                  int begin, int end,
+                                                  Model::IntegralType solver,
+                                                  SimdVesselKernel::Isa isa,
+                                                  Model::Precision precision,
+                                                  VesselStatistics &stats)
+{
+	const bool adaptive = solver == Model::AdaptiveVesselFlow;
+	const bool segmented = adaptive || solver == Model::SegmentedVesselFlow;
 	double ret = 0.0;
-	int i;
 
-	int n = nArteries();
-	Vessel *v = arteries();
-	while ((i=artery_no.fetchAndAddOrdered(1024)) < n) {
-		int max_pos = std::min(n, i+1024);
-		for (int j=i; j<max_pos; ++j)
-			ret = std::max(ret, (this->*func)(v[j]));
+	if (isa == SimdVesselKernel::Scalar) {
+		for (int j=begin; j<end; ++j) {
+			typename Vessels::reference v = vessels[j];
+			ret = std::max(ret, adaptive ? adaptiveSegmentedFlowVessel(v, stats) :
+			                    segmented ? multiSegmentedFlowVessel(v) :
+			                                singleSegmentVessel(v));
+		}
 	}
+	else {
+		const bool float_kernel = solver == Model::SegmentedVesselFlow &&
+		                          precision != Model::DoublePrecision;
+		const int lanes = float_kernel ? SimdVesselKernel::floatLanes(isa) :
+		                                 SimdVesselKernel::lanes(isa);
+		int idx[VesselBatch::max_lanes];
+		VesselBatch b;
+		b.n = 0;
+
+		for (int j=begin; j<end; ++j) {
+			typename Vessels::reference v = vessels[j];
+			const double Pout = std::max(v.pressure_0, v.pressure_out);
+
+			/* Vessels without flow, closed vessels and undefined pressures
+			 * are special cases in the scalar code. They are not common so
+			 * they are not part of the vector kernels.
+			 */
+			if (v.flow == 0.0 || isnan(Pout) || v.D < 0.1 ||
+			    (!segmented && isnan(v.pressure_in))) {
+				ret = std::max(ret, segmented ? multiSegmentedFlowVessel(v) :
+				                                singleSegmentVessel(v));
+				continue;
+			}
+
+			const int k = b.n;
+			idx[k] = j;
+			b.pressure_in[k] = v.pressure_in;
+			b.pressure_out[k] = Pout;
+			b.flow[k] = v.flow;
+			b.D[k] = v.D;
+			b.gamma[k] = v.gamma;
+			b.phi[k] = v.phi;
+			b.tone[k] = v.tone;
+			b.Ppl[k] = v.Ppl;
+			b.perivascular_press_a[k] = v.perivascular_press_a;
+			b.perivascular_press_b[k] = v.perivascular_press_b;
+			b.perivascular_press_c[k] = v.perivascular_press_c;
+			b.perivascular_press_d[k] = v.perivascular_press_d;
+			b.length[k] = v.length;
+			b.vessel_ratio[k] = v.vessel_ratio;
+
+			if (++b.n < lanes)
+				continue;
+
+			vesselKernel(isa, b, solver, precision);
+			ret = std::max(ret, storeBatchResults(vessels, idx, b, solver, stats));
+			b.n = 0;
+		}
 
-	n = nVeins();
-	v = veins();
-	while ((i=vein_no.fetchAndAddOrdered(1024)) < n) {
-		int max_pos = std::min(n, i+1024);
-		for (int j=i; j<max_pos; ++j)
-			ret = std::max(ret, (this->*func)(v[j]));
+		// remaining lanes
+		if (b.n > 0) {
+			vesselKernel(isa, b, solver, precision);
+			ret = std::max(ret, storeBatchResults(vessels, idx, b, solver, stats));
+		}
 	}
 
 	return ret;
 }
 
-double CpuIntegrationHelper::capillaryThread()
+void CpuIntegrationHelper::vesselKernel(SimdVesselKernel::Isa isa, VesselBatch &b,
+                                        Model::IntegralType solver,
+                                        Model::Precision precision)
+{
+	if (solver == Model::AdaptiveVesselFlow)
+		SimdVesselKernel::adaptiveSegmented(isa, b, viscosity, adaptiveTolerance(), nSums);
+	else if (solver != Model::SegmentedVesselFlow)
+		SimdVesselKernel::singleSegment(isa, b, viscosity, Tlrns());
+	else if (precision == Model::DoublePrecision)
+		SimdVesselKernel::multiSegmented(isa, b, viscosity, nSums);
+	else
+		SimdVesselKernel::multiSegmentedFloat(isa, b, viscosity, nSums,
+		                                      precision == Model::MixedPrecision);
+}
+
+template<class Vessels>
+double CpuIntegrationHelper::storeBatchResults(const Vessels &vessels,
+                                               const int *idx,
+                                               const VesselBatch &b,
+                                               Model::IntegralType solver,
+                                               VesselStatistics &stats)
 {
 	double ret = 0.0;
-	int i;
 
-	int n = nCaps();
-	Capillary *c = capillaries();
+	for (int k=0; k<b.n; ++k) {
+		typename Vessels::reference v = vessels[idx[k]];
+		const double Rin = v.R;
+		const double starling_P = v.pressure_0 - std::min(v.pressure_out, v.pressure_0);
+		const double starling_R = (starling_P < 1e-10 && v.flow < 1e-10) ? 0 : starling_P/v.flow;
+
+		if (solver == Model::SegmentedVesselFlow) {
+			v.viscosity_factor = b.viscosity_factor[k] / nSums;
+			v.Dmin = b.Dmin[k];
+			v.Dmax = b.Dmax[k];
+			v.D_calc = b.D_integral[k] / nSums;
+		}
+		else {
+			v.viscosity_factor = b.viscosity_factor[k];
+			v.Dmin = b.Dmin[k];
+			v.Dmax = b.Dmax[k];
+			v.D_calc = b.D_integral[k];
+		}
+
+		if (solver == Model::AdaptiveVesselFlow)
+			stats.add(b.segments[k], b.evaluations[k]);
 
-	while ((i=cap_no.fetchAndAddOrdered(1024)) < n) {
-		int max_pos = std::min(n, i+1024);
-		for (int j=i; j<max_pos; ++j)
-			ret = std::max(ret, capillaryResistance(c[j]));
+		v.volume = b.volume[k] / (1e9*v.vessel_ratio); // um**3 => uL, and correct for real number of vessels
+		v.R = b.R[k] + starling_R;
+		v.last_delta_R = fabs(Rin-v.R)/Rin;
+
+		ret = std::max(ret, v.last_delta_R);
+	}
+
+	return ret;
+}
+
+SimdVesselKernel::Isa CpuIntegrationHelper::selectSimdIsa()
+{
+	QMutexLocker lock(&simd_lock);
+
+	if (simd_selected_isa < 0) {
+		simd_selected_isa = SimdVesselKernel::bestAvailable();
+		qDebug() << "Vessel and capillary kernel:"
+		         << SimdVesselKernel::isaName(static_cast<SimdVesselKernel::Isa>(simd_selected_isa));
+	}
+
+	return static_cast<SimdVesselKernel::Isa>(simd_selected_isa);
+}
+
+Model::Precision CpuIntegrationHelper::selectPrecision(SimdVesselKernel::Isa isa,
+                                                      Model::Precision precision)
+{
+	if (isa == SimdVesselKernel::Scalar ||
+	    (precision != Model::SinglePrecision && precision != Model::MixedPrecision))
+		return Model::DoublePrecision;
+
+	return precision;
+}
+
+bool CpuIntegrationHelper::verifyKernels()
+{
+	Model model(Model::Middle, Model::SegmentedVesselFlow);
+	CpuIntegrationHelper helper(&model, Model::SegmentedVesselFlow);
+	bool passed = true;
+
+	for (int i=SimdVesselKernel::bestAvailable(); i>SimdVesselKernel::Scalar; --i) {
+		const SimdVesselKernel::Isa isa = static_cast<SimdVesselKernel::Isa>(i);
+
+		passed = helper.verifySimdKernel(isa) && passed;
+		passed = helper.verifyFloatKernel(isa, Model::SinglePrecision) && passed;
+		passed = helper.verifyFloatKernel(isa, Model::MixedPrecision) && passed;
+	}
+
+	qDebug() << "Kernel verification" << (passed ? "passed" : "failed");
+	return passed;
+}
+
+bool CpuIntegrationHelper::verifySimdKernel(SimdVesselKernel::Isa isa)
+{
+	// all vessel kernels, see vesselKernelError(), and the capillaries
+	const double max_relative_error = 1e-10;
+	const Model::IntegralType solvers[] = { Model::SegmentedVesselFlow,
+	                                        Model::RigidVesselFlow,
+	                                        Model::AdaptiveVesselFlow };
+	const char * const solver_names[] = { "segmented", "single segment", "adaptive" };
+
+	bool ok = true;
+	for (int mode=0; mode<3; ++mode) {
+		const double max_error = vesselKernelError(isa, solvers[mode], Model::DoublePrecision);
+
+		qDebug() << SimdVesselKernel::isaName(isa) << solver_names[mode]
+		         << "kernel max relative error:" << max_error;
+
+		if (!(max_error <= max_relative_error))
+			ok = false;
+	}
+
+	// pressure0, including vessels outside the lung without perivascular pressure
+	double p0_error = 0.0;
+	unsigned p0_seed = 6789;
+	for (int n=0; n<8; ++n) {
+		VesselBatch b;
+		memset(&b, 0, sizeof(b));
+		b.n = SimdVesselKernel::lanes(isa) - (n%2);
+
+		Vessel ref[VesselBatch::max_lanes];
+		for (int k=0; k<b.n; ++k) {
+			p0_seed = p0_seed*1103515245 + 12345;
+			const double r1 = (p0_seed >> 8) / 16777216.0;
+			p0_seed = p0_seed*1103515245 + 12345;
+			const double r2 = (p0_seed >> 8) / 16777216.0;
+
+			const double Ptp = 10.0*r1;
+			memset(&ref[k], 0, sizeof(Vessel));
+			ref[k].Ppl = b.Ppl[k] = -5.0*r2;
+			ref[k].tone = b.tone[k] = (k%3 == 0) ? r2 : 0.0;
+			ref[k].perivascular_press_d = b.perivascular_press_d[k] = 15.6068;
+			if (k != 1) {
+				ref[k].perivascular_press_a = b.perivascular_press_a[k] = -5 - Ptp;
+				ref[k].perivascular_press_b = b.perivascular_press_b[k] = 16.0 + 1.8*Ptp;
+				ref[k].perivascular_press_c = b.perivascular_press_c[k] =
+				        -10.781 + 17.7509*std::exp(-0.0594107*Ptp);
+			}
+		}
+
+		SimdVesselKernel::pressure0(isa, b);
+		for (int k=0; k<b.n; ++k) {
+			const double a = calculatePressure0(ref[k]);
+			if (a == b.pressure_0[k])
+				continue;
+
+			const double err = std::fabs(a - b.pressure_0[k]) /
+			                   std::max(std::fabs(a), std::fabs(b.pressure_0[k]));
+			p0_error = std::max(p0_error, isnan(err) ? 1.0 : err);
+		}
+	}
+
+	qDebug() << SimdVesselKernel::isaName(isa)
+	         << "pressure0 kernel max relative error:" << p0_error;
+	if (!(p0_error <= max_relative_error))
+		ok = false;
+
+	// capillaries, including closed, no-flow and Starling resistor cases
+	const int n = 8*VesselBatch::max_lanes + 3;
+	unsigned seed = 54321;
+	std::vector<Capillary> cap_reference(n), c(n);
+	for (int i=0; i<n; ++i) {
+		seed = seed*1103515245 + 12345;
+		const double r1 = (seed >> 8) / 16777216.0;
+		seed = seed*1103515245 + 12345;
+		const double r2 = (seed >> 8) / 16777216.0;
+
+		Capillary &ref = cap_reference[i];
+		memset(&ref, 0, sizeof(Capillary));
+
+		ref.Ho = 2.5;
+		ref.Alpha = 0.07 + 0.23*r1;
+		ref.Krc = 1.26e6 * (0.5 + 1.5*r2);
+		ref.R = ref.Krc;
+		ref.flow = 1e-5*std::pow(1000.0, r2);
+		ref.pressure_out = -10.0 + 40.0*r1;
+		ref.open_state = Capillary_Auto;
+
+		if (i%11 == 0)
+			ref.flow = 0.0;
+		if (i%13 == 0)
+			ref.open_state = Capillary_Closed;
+	}
+	std::copy(cap_reference.begin(), cap_reference.end(), c.begin());
+
+	double max_ret = 0.0;
+	CapillaryStatistics stats;
+	for (int i=0; i<n; ++i)
+		max_ret = std::max(max_ret, capillaryResistance(cap_reference[i], stats));
+	const double simd_ret = integrateCapillaryRange(CapillaryPointer(&c[0]), 0, n, isa, stats);
+
+	double max_error = std::fabs(max_ret - simd_ret) / std::max(1e-300, max_ret);
+	for (int i=0; i<n; ++i) {
+		const double a[] = { cap_reference[i].R, cap_reference[i].Hin, cap_reference[i].Hout };
+		const double b[] = { c[i].R, c[i].Hin, c[i].Hout };
+
+		for (unsigned j=0; j<sizeof(a)/sizeof(a[0]); ++j) {
+			if (a[j] == b[j])
+				continue;
+
+			const double err = std::fabs(a[j]-b[j]) /
+			                   std::max(std::fabs(a[j]), std::fabs(b[j]));
+			max_error = std::max(max_error, isnan(err) ? 1.0 : err);
+		}
+	}
+
+	qDebug() << SimdVesselKernel::isaName(isa)
+	         << "capillary kernel max relative error:" << max_error;
+
+	if (!(max_error <= max_relative_error))
+		ok = false;
+
+	return ok;
+}
+
+bool CpuIntegrationHelper::verifyFloatKernel(SimdVesselKernel::Isa isa, Model::Precision precision)
+{
+	/* Float segments limit the agreement with the scalar code. The bounds
+	 * leave more than an order of magnitude over the measured errors of
+	 * about 3e-6 (single) and 4e-7 (mixed).
+	 */
+	const double max_relative_error = precision == Model::MixedPrecision ? 1e-5 : 1e-4;
+	const double max_error = vesselKernelError(isa, Model::SegmentedVesselFlow, precision);
+
+	qDebug() << SimdVesselKernel::isaName(isa)
+	         << (precision == Model::MixedPrecision ? "mixed precision" : "single precision")
+	         << "segmented kernel max relative error:" << max_error;
+
+	return max_error <= max_relative_error;
+}
+
+double CpuIntegrationHelper::vesselKernelError(SimdVesselKernel::Isa isa,
+                                               Model::IntegralType solver,
+                                               Model::Precision precision)
+{
+	/* Compares vector kernel results with the scalar code on a set of
+	 * vessels spanning the physiological range, including closed and
+	 * no-flow vessels and a partially filled final batch. The viscosity
+	 * table is built first, as verifyKernels() runs outside of calc() and
+	 * its lookups must be verified too.
+	 */
+	buildViscosityTable();
+	const int n = 8*VesselBatch::max_lanes + 3;
+
+	std::vector<Vessel> reference(n), v(n);
+	unsigned seed = 12345;
+	for (int i=0; i<n; ++i) {
+		seed = seed*1103515245 + 12345;
+		const double r1 = (seed >> 8) / 16777216.0;
+		seed = seed*1103515245 + 12345;
+		const double r2 = (seed >> 8) / 16777216.0;
+
+		Vessel &ref = reference[i];
+		memset(&ref, 0, sizeof(Vessel));
+
+		const double Ptp = 10.0*r2;
+		ref.D = 15.0*std::pow(25000.0/15.0, r1); // um
+		ref.gamma = 1.84 + 0.01*r2;
+		ref.phi = (i%7 == 0) ? 0.0 : 0.035 + 0.005*r1;
+		ref.tone = (i%5 == 0) ? 1.0*r2 : 0.0;
+		ref.Ppl = -5.0*r2;
+		ref.perivascular_press_a = -5 - Ptp;
+		ref.perivascular_press_b = 16.0 + 1.8*Ptp;
+		ref.perivascular_press_c = -10.781 + 17.7509*std::exp(-0.0594107*Ptp);
+		ref.perivascular_press_d = 15.6068;
+		ref.length = 20.0*ref.D;
+		ref.vessel_ratio = (i%3 == 0) ? 1.0 : 0.5*r2 + 0.01;
+		ref.pressure_out = 5.0 + 15.0*r1;
+		ref.pressure_0 = ref.pressure_out - 4.0 + 5.0*r2;
+		ref.pressure_in = ref.pressure_out + 1.0;
+		ref.flow = 5.0*std::pow(ref.D/25000.0, 3.0);
+		ref.R = 1.0;
+
+		if (i%11 == 0)
+			ref.flow = 0.0;
+		if (i%13 == 0)
+			ref.D = 0.05;
+	}
+	std::copy(reference.begin(), reference.end(), v.begin());
+
+	double max_ret = 0.0;
+	VesselStatistics stats;
+	for (int i=0; i<n; ++i) {
+		double r = solver == Model::AdaptiveVesselFlow ?
+		                   adaptiveSegmentedFlowVessel(reference[i], stats) :
+		           solver == Model::SegmentedVesselFlow ?
+		                   multiSegmentedFlowVessel(reference[i]) :
+		                   singleSegmentVessel(reference[i]);
+		max_ret = std::max(max_ret, r);
+	}
+	double simd_ret = integrateVesselRange(VesselPointer(&v[0]), 0, n,
+	                                       solver, isa, precision, stats);
+
+	double max_error = std::fabs(max_ret - simd_ret) / std::max(1e-300, max_ret);
+	for (int i=0; i<n; ++i) {
+		const double a[] = { reference[i].R, reference[i].D_calc,
+		                     reference[i].Dmin, reference[i].Dmax,
+		                     reference[i].volume,
+		                     reference[i].viscosity_factor };
+		const double b[] = { v[i].R, v[i].D_calc,
+		                     v[i].Dmin, v[i].Dmax,
+		                     v[i].volume,
+		                     v[i].viscosity_factor };
+
+		for (unsigned j=0; j<sizeof(a)/sizeof(a[0]); ++j) {
+			if (a[j] == b[j] || (isnan(a[j]) && isnan(b[j])))
+				continue;
+
+			const double err = std::fabs(a[j]-b[j]) /
+			                   std::max(std::fabs(a[j]), std::fabs(b[j]));
+			max_error = std::max(max_error, isnan(err) ? 1.0 : err);
+		}
+	}
+
+	return max_error;
+}
+
+void CpuIntegrationHelper::capillaryRange(int worker, bool soa, int begin, int end)
+{
+	Q_UNUSED(soa);
+	const double ret = integrateCapillaries(worker, begin, end);
+	worker_deviation[worker] = std::max(worker_deviation[worker], ret);
+}
+
+double CpuIntegrationHelper::capillaryResistanceRange(int worker, int begin, int end)
+{
+	cap_active.position(begin, end);
+	return integrateCapillaries(worker, begin, end);
+}
+
+double CpuIntegrationHelper::resolveCapillaryRange(int worker, int begin, int end)
+{
+	CapillaryStatistics &stats = worker_cap_stats[worker];
+
+	if (structureOfArrays())
+		return integrateCapillaryRange(CapillaryArraysPointer(capillaryArrays()),
+		                               begin, end, simd_isa, stats);
+	return integrateCapillaryRange(CapillaryPointer(capillaries()), begin, end,
+	                               simd_isa, stats);
+}
+
+double CpuIntegrationHelper::integrateCapillaries(int worker, int begin, int end)
+{
+	CapillaryStatistics &stats = worker_cap_stats[worker];
+
+	if (structureOfArrays()) {
+		CapillaryArraysPointer c(capillaryArrays());
+		if (cap_active.active)
+			return integrateCapillaryRange(IndexedPointer<CapillaryArraysPointer>(c, cap_active.data()),
+			                               begin, end, simd_isa, stats);
+		return integrateCapillaryRange(c, begin, end, simd_isa, stats);
+	}
+
+	CapillaryPointer c(capillaries());
+	if (cap_active.active)
+		return integrateCapillaryRange(IndexedPointer<CapillaryPointer>(c, cap_active.data()),
+		                               begin, end, simd_isa, stats);
+	return integrateCapillaryRange(c, begin, end, simd_isa, stats);
+}
+
+// converts element range to positions in the list
+void CpuIntegrationHelper::ActiveSet::position(int &begin, int &end) const
+{
+	if (!active)
+		return;
+
+	begin = std::lower_bound(list.begin(), list.end(), begin) - list.begin();
+	end = std::lower_bound(list.begin()+begin, list.end(), end) - list.begin();
+}
+
+void CpuIntegrationHelper::ActiveSet::select(const std::vector<int> *elements)
+{
+	active = elements != 0;
+	if (elements)
+		list = *elements;
+	else
+		list.clear();
+}
+
+bool CpuIntegrationHelper::activeSetChanged(double value, double last, double scale) const
+{
+	// NaN compares as changed, unless it was NaN before
+	if (isnan(value) || isnan(last))
+		return isnan(value) != isnan(last);
+
+	return std::fabs(value-last) > activeSetTolerance()*std::max(std::fabs(last), scale);
+}
+
+double CpuIntegrationHelper::selectActiveVessels(bool all)
+{
+	double skipped = 0.0;
+
+	if (structureOfArrays()) {
+		skipped = selectVessels(VesselArraysPointer(arteryArrays()), nArteries(), all, art_active);
+		skipped = std::max(skipped, selectVessels(VesselArraysPointer(veinArrays()), nVeins(), all, vein_active));
+	}
+	else {
+		skipped = selectVessels(VesselPointer(arteries()), nArteries(), all, art_active);
+		skipped = std::max(skipped, selectVessels(VesselPointer(veins()), nVeins(), all, vein_active));
+	}
+
+	if (!all)
+		qDebug() << "   active vessels:" << art_active.list.size() + vein_active.list.size()
+		         << "of" << nArteries() + nVeins();
+
+	return skipped;
+}
+
+double CpuIntegrationHelper::selectActiveCapillaries(bool all)
+{
+	double skipped;
+
+	if (structureOfArrays())
+		skipped = selectCapillaries(CapillaryArraysPointer(capillaryArrays()), nCaps(), all, cap_active);
+	else
+		skipped = selectCapillaries(CapillaryPointer(capillaries()), nCaps(), all, cap_active);
+
+	if (!all)
+		qDebug() << "   active capillaries:" << cap_active.list.size() << "of" << nCaps();
+
+	return skipped;
+}
+
+void CpuIntegrationHelper::selectElements(const std::vector<int> *arteries,
+                                          const std::vector<int> *veins,
+                                          const std::vector<int> *capillaries)
+{
+	art_active.select(arteries);
+	vein_active.select(veins);
+	cap_active.select(capillaries);
+
+	if (arteries)
+		qDebug() << "   selected elements:" << art_active.list.size() + vein_active.list.size()
+		         << "vessels," << cap_active.list.size() << "capillaries";
+}
+
+template<class Vessels>
+double CpuIntegrationHelper::selectVessels(const Vessels &vessels, int n, bool all,
+                                           ActiveSet &set)
+{
+	const bool segmented = integralType() == Model::SegmentedVesselFlow ||
+	                       integralType() == Model::AdaptiveVesselFlow;
+	const double tolerance = activeSetTolerance();
+	const bool first = set.flow.empty();
+	double skipped = 0.0;
+
+	if (first) {
+		set.flow.resize(n);
+		set.pressure_in.resize(n);
+		set.pressure_out.resize(n);
+	}
+
+	set.active = !all && !first;
+	set.list.clear();
+
+	for (int i=0; i<n; ++i) {
+		typename Vessels::reference v = vessels[i];
+		const double Pout = std::max(v.pressure_0, v.pressure_out);
+
+		if (set.active) {
+			/* No flow or undefined pressures, now and when last
+			 * integrated, leave the vessel unchanged. So does a closed
+			 * vessel once its resistance is infinite.
+			 */
+			const bool idle = v.flow == 0.0 || isnan(Pout) ||
+			                  (!segmented && isnan(v.pressure_in));
+			const bool was_idle = set.flow[i] == 0.0 || isnan(set.pressure_out[i]) ||
+			                      (!segmented && isnan(set.pressure_in[i]));
+
+			if ((idle && was_idle) || (v.D < 0.1 && isinf(v.R)))
+				continue;
+
+			if (!idle && !was_idle &&
+			    v.last_delta_R <= tolerance &&
+			    !activeSetChanged(v.flow, set.flow[i], 0.0) &&
+			    !activeSetChanged(Pout, set.pressure_out[i], 1.0) &&
+			    (segmented || !activeSetChanged(v.pressure_in, set.pressure_in[i], 1.0))) {
+				skipped = std::max(skipped, v.last_delta_R);
+				continue;
+			}
+
+			set.list.push_back(i);
+		}
+
+		set.flow[i] = v.flow;
+		set.pressure_in[i] = v.pressure_in;
+		set.pressure_out[i] = Pout;
+	}
+
+	return skipped;
+}
+
+template<class Capillaries>
+double CpuIntegrationHelper::selectCapillaries(const Capillaries &caps, int n, bool all,
+                                               ActiveSet &set)
+{
+	const double tolerance = activeSetTolerance();
+	const bool first = set.flow.empty();
+	double skipped = 0.0;
+
+	if (first) {
+		set.flow.resize(n);
+		set.pressure_out.resize(n);
+	}
+
+	set.active = !all && !first;
+	set.list.clear();
+
+	for (int i=0; i<n; ++i) {
+		typename Capillaries::reference c = caps[i];
+
+		if (set.active) {
+			// see capillaryResistance()
+			if (c.open_state == Capillary_Closed && isinf(c.R))
+				continue;
+
+			const bool idle = isnan(c.flow) || isnan(c.pressure_out) || c.flow < 1e-50;
+			const bool was_idle = isnan(set.flow[i]) || isnan(set.pressure_out[i]) ||
+			                      set.flow[i] < 1e-50;
+
+			if (idle && was_idle)
+				continue;
+
+			if (!idle && !was_idle &&
+			    c.open_state != Capillary_Closed &&
+			    c.last_delta_R <= tolerance &&
+			    !activeSetChanged(c.flow, set.flow[i], 0.0) &&
+			    !activeSetChanged(c.pressure_out, set.pressure_out[i], 1.0)) {
+				skipped = std::max(skipped, c.last_delta_R);
+				continue;
+			}
+
+			set.list.push_back(i);
+		}
+
+		set.flow[i] = c.flow;
+		set.pressure_out[i] = c.pressure_out;
+	}
+
+	return skipped;
+}
+
+template<class Capillaries>
+double CpuIntegrationHelper::integrateCapillaryRange(const Capillaries &caps,
+                                                     int begin, int end,
+                                                     SimdVesselKernel::Isa isa,
+                                                     CapillaryStatistics &stats)
+{
+	double ret = 0.0;
+
+	if (isa == SimdVesselKernel::Scalar) {
+		for (int j=begin; j<end; ++j) {
+			typename Capillaries::reference cap = caps[j];
+			ret = std::max(ret, capillaryResistance(cap, stats));
+		}
 	}
+	else {
+		const int lanes = SimdVesselKernel::lanes(isa);
+		int idx[CapillaryBatch::max_lanes];
+		CapillaryBatch b;
+		b.n = 0;
+
+		for (int j=begin; j<end; ++j) {
+			typename Capillaries::reference cap = caps[j];
+
+			// closed and idle capillaries are handled by the scalar code
+			if (cap.open_state == Capillary_Closed ||
+			    isnan(cap.flow) || isnan(cap.pressure_out) || cap.flow < 1e-50) {
+				ret = std::max(ret, capillaryResistance(cap, stats));
+				continue;
+			}
+
+			const int k = b.n;
+			idx[k] = j;
+			b.pressure_out[k] = std::max(0.0, cap.pressure_out);
+			b.starling_pressure[k] = -std::min(0.0, cap.pressure_out);
+			b.flow[k] = cap.flow;
+			b.Ho[k] = cap.Ho;
+			b.Alpha[k] = cap.Alpha;
+			b.Krc[k] = cap.Krc;
+
+			if (++b.n < lanes)
+				continue;
+
+			SimdVesselKernel::capillaries(isa, b);
+			ret = std::max(ret, storeBatchResults(caps, idx, b, stats));
+			b.n = 0;
+		}
+
+		// remaining lanes
+		if (b.n > 0) {
+			SimdVesselKernel::capillaries(isa, b);
+			ret = std::max(ret, storeBatchResults(caps, idx, b, stats));
+		}
+	}
+
 	return ret;
 }
 
+template<class Capillaries>
+double CpuIntegrationHelper::storeBatchResults(const Capillaries &caps,
+                                               const int *idx,
+                                               const CapillaryBatch &b,
+                                               CapillaryStatistics &stats)
+{
+	double ret = 0.0;
+
+	for (int k=0; k<b.n; ++k) {
+		typename Capillaries::reference cap = caps[idx[k]];
+		const double Ri = cap.R;
+		const double starlingR = b.starling_pressure[k] / cmH2O_per_mmHg / cap.flow;
+
+		cap.Hin = b.Hin[k];
+		cap.Hout = b.Hout[k];
+		cap.R = starlingR + b.R[k];
+		stats.add(int(b.iterations[k]));
+
+		ret = std::max(ret, capillaryDeltaR(cap, Ri));
+	}
+
+	return ret;
+}
@@ -17,34 +17,204 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QMutex>
 #include "abstracthelper.h"
 #include "model/model.h"
+#include "simdkernel.h"
 
 class CpuIntegrationHelper : public AbstractIntegrationHelper
 {
 public:
+	/* Newton iterations of the capillary solver, per solved capillary.
+	 * Closed capillaries and capillaries without flow are not counted.
+	 */
+	struct CapillaryStatistics
+	{
+		enum { n_bins = 16 }; // last bin counts n_bins-1 and more iterations
+
+		qint64 solves;
+		qint64 iterations;
+		int max_iterations;
+		qint64 histogram[n_bins];
+
+		CapillaryStatistics();
+		void add(int n);
+		void merge(const CapillaryStatistics &other);
+		double mean() const { return solves > 0 ? iterations/double(solves) : 0.0; }
+	};
+
+	/* Segments used by adaptive vessel integration, per integrated vessel
+	 * with flow. Fixed segment integration always uses nSums.
+	 */
+	struct VesselStatistics
+	{
+		qint64 vessels;
+		qint64 segments;
+		qint64 evaluations; // diameters and viscosity factors calculated
+
+		VesselStatistics();
+		void add(int n_segments, int n_evaluations);
+		void merge(const VesselStatistics &other);
+		double meanSegments() const { return vessels > 0 ? segments/double(vessels) : 0.0; }
+		double meanEvaluations() const { return vessels > 0 ? evaluations/double(vessels) : 0.0; }
+	};
+
 	CpuIntegrationHelper(Model *model, Model::IntegralType type);
 
 	virtual double multiSegmentedVessels();
 	virtual double singleSegmentVessels();
+	virtual double adaptiveSegmentedVessels();
 	void integrateWithDimentions(Vessel::Type t,
 	                             int gen, int idx,
 	                             std::vector<double> &calc_dim);
 
 	virtual double capillaryResistances();
 
+	/* Vectorised on the solver pool. Vessels of a generation with the
+	 * same parameters share one solve.
+	 */
+	virtual void pressure0();
+
+	virtual void beginCalculation();
+	virtual void endCalculation();
+	virtual bool supportsStructureOfArrays() const { return true; }
+
+	virtual bool supportsRanges() const { return true; }
+	virtual double integrateRange(int worker, Vessel::Type type, int begin, int end);
+	virtual double capillaryResistanceRange(int worker, int begin, int end);
+	virtual double resolveCapillaryRange(int worker, int begin, int end);
+
+	virtual bool supportsActiveSet() const { return true; }
+	virtual double selectActiveVessels(bool all);
+	virtual double selectActiveCapillaries(bool all);
+	virtual void selectElements(const std::vector<int> *arteries,
+	                            const std::vector<int> *veins,
+	                            const std::vector<int> *capillaries);
+
+	// viscosity factors for current Hct, rebuilt by beginCalculation()
+	const ViscosityTable& viscosityTable() const { return viscosity; }
+	void buildViscosityTable();
+
+	/* Returns the vector instruction set used for vessel integration and
+	 * the capillary solver, the best one available.
+	 */
+	SimdVesselKernel::Isa simdIsa() const { return simd_isa; }
+
+	/* Precision of the vectorised segmented vessel kernel, the model's
+	 * precision() with a vector instruction set, double otherwise.
+	 */
+	Model::Precision kernelPrecision() const { return kernel_precision; }
+
+	/* Compares the vector kernels of every available instruction set with
+	 * the scalar code, see verifySimdKernel() and verifyFloatKernel().
+	 * Returns true if all are within their bounds. Run by --verify-kernels.
+	 */
+	static bool verifyKernels();
+
+	// capillary solver iterations since beginCalculation()
+	CapillaryStatistics capillaryStatistics() const;
+
+	// adaptive integration segments since beginCalculation()
+	VesselStatistics vesselStatistics() const;
+
 protected:
-	double capillaryResistance(Capillary &cap);
-	double capillaryH(const Capillary &cap, double pressure);
-	double singleSegmentVessel(Vessel &v);
-	double multiSegmentedFlowVessel(Vessel &v);
-	double multiSegmentedFlowVessel(Vessel &v,
-	                                std::vector<double> *calc_dim);
+	/* Solvers are templates over Vessel/Capillary and VesselRef/CapillaryRef
+	 * so the same code is used for both storage layouts.
+	 */
+	template<class C> double capillaryResistance(C &cap, CapillaryStatistics &stats);
+	template<class C> double capillaryDeltaR(C &cap, double Ri);
+	template<class V> double singleSegmentVessel(V &v);
+	template<class V> double multiSegmentedFlowVessel(V &v);
+	template<class V> double multiSegmentedFlowVessel(V &v,
+	                                                  std::vector<double> *calc_dim);
+	template<class V> double adaptiveSegmentedFlowVessel(V &v, VesselStatistics &stats);
+
+	/* Parallel phases on the model's solver pool. Ranges are per-worker
+	 * tasks, their results go to worker_deviation[worker].
+	 */
+	void pressure0Range(int worker, int, int begin, int end);
+	double vesselIntegration(Model::IntegralType solver);
+	void vesselIntegrationRange(int worker, Model::IntegralType solver, int begin, int end);
+	void capillaryRange(int worker, bool soa, int begin, int end);
+	void mergeStatistics();
+	double integrateVessels(int worker, Vessel::Type type, Model::IntegralType solver,
+	                        int begin, int end);
+	double integrateCapillaries(int worker, int begin, int end);
+	template<class Capillaries>
+	double integrateCapillaryRange(const Capillaries &caps, int begin, int end,
+	                               SimdVesselKernel::Isa isa, CapillaryStatistics &stats);
+	template<class Capillaries>
+	double storeBatchResults(const Capillaries &caps, const int *idx,
+	                         const CapillaryBatch &b, CapillaryStatistics &stats);
+
+	/* Elements selected for integration, and their flow and pressures
+	 * when last integrated. Integration ranges are positions in list
+	 * when active is set, element indices otherwise.
+	 */
+	struct ActiveSet
+	{
+		bool active;
+		std::vector<int> list;
+		std::vector<double> flow, pressure_in, pressure_out;
+
+		ActiveSet() : active(false) {}
+		int size(int n_elements) const { return active ? list.size() : n_elements; }
+		const int* data() const { return list.empty() ? 0 : &list[0]; }
+		void position(int &begin, int &end) const;
+		void select(const std::vector<int> *elements);
+	};
+
+	template<class Vessels>
+	double selectVessels(const Vessels &vessels, int n, bool all, ActiveSet &set);
+	template<class Capillaries>
+	double selectCapillaries(const Capillaries &caps, int n, bool all, ActiveSet &set);
+	bool activeSetChanged(double value, double last, double scale) const;
+	/* solver is SegmentedVesselFlow, AdaptiveVesselFlow or, for any
+	 * other value, RigidVesselFlow.
+	 */
+	template<class Vessels>
+	double integrateVesselRange(const Vessels &vessels, int begin, int end,
+	                            Model::IntegralType solver, SimdVesselKernel::Isa isa,
+	                            Model::Precision precision, VesselStatistics &stats);
+	void vesselKernel(SimdVesselKernel::Isa isa, VesselBatch &b,
+	                  Model::IntegralType solver, Model::Precision precision);
+	template<class Vessels>
+	double storeBatchResults(const Vessels &vessels, const int *idx,
+	                         const VesselBatch &b, Model::IntegralType solver,
+	                         VesselStatistics &stats);
+
+	SimdVesselKernel::Isa selectSimdIsa();
+	bool verifySimdKernel(SimdVesselKernel::Isa isa);
+	Model::Precision selectPrecision(SimdVesselKernel::Isa isa, Model::Precision precision);
+	bool verifyFloatKernel(SimdVesselKernel::Isa isa, Model::Precision precision);
+	double vesselKernelError(SimdVesselKernel::Isa isa, Model::IntegralType solver,
+	                         Model::Precision precision);
 
-	double vesselIntegration(double(CpuIntegrationHelper::* func)(Vessel&));
-	double vesselIntegrationThread(double(CpuIntegrationHelper::* func)(Vessel&));
+	// parameters of calculatePressure0()
+	struct Pressure0Key
+	{
+		double Ppl, a, b, c, d, tone;
 
-	double capillaryThread();
+		explicit Pressure0Key(const Vessel &v);
+		bool operator==(const Pressure0Key &o) const;
+		quint64 hash() const;
+	};
 
-	QAtomicInt artery_no, vein_no, cap_no;
+	std::vector<double> worker_deviation;
+	std::vector<Pressure0Key> p0_keys; // distinct per generation, see pressure0()
+	std::vector<double> p0_values;     // of p0_keys
+	std::vector<int> p0_slots;         // per vessel, index in p0_keys
+	/* Statistics are collected per worker, and merged into cap_stats and
+	 * vessel_stats at the end of each pass, see mergeStatistics().
+	 */
+	std::vector<CapillaryStatistics> worker_cap_stats;
+	std::vector<VesselStatistics> worker_vessel_stats;
+	CapillaryStatistics cap_stats;
+	VesselStatistics vessel_stats;
+	mutable QMutex stats_lock;
+	ActiveSet art_active, vein_active, cap_active;
+	ViscosityTable viscosity;
+	bool use_simd;
+	SimdVesselKernel::Isa simd_isa;
+	Model::Precision kernel_precision;
 };
@@ -1,9 +1,15 @@
 SOURCES += \
 	$${SRC_DIR}/model/integrationhelper/abstracthelper.cpp \
 	$${SRC_DIR}/model/integrationhelper/cpuhelper.cpp \
-	$${SRC_DIR}/model/integrationhelper/openclhelper.cpp
+	$${SRC_DIR}/model/integrationhelper/openclhelper.cpp \
+	$${SRC_DIR}/model/integrationhelper/simdkernel.cpp \
+	$${SRC_DIR}/model/integrationhelper/viscosity.cpp
 
 HEADERS += \
 	$${SRC_DIR}/model/integrationhelper/abstracthelper.h \
+	$${SRC_DIR}/model/integrationhelper/capillarysolver.h \
 	$${SRC_DIR}/model/integrationhelper/cpuhelper.h \
-	$${SRC_DIR}/model/integrationhelper/openclhelper.h
+	$${SRC_DIR}/model/integrationhelper/openclhelper.h \
+	$${SRC_DIR}/model/integrationhelper/simdkernel.h \
+	$${SRC_DIR}/model/integrationhelper/simdkernel_impl.h \
+	$${SRC_DIR}/model/integrationhelper/viscosity.h
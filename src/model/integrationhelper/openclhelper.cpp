@@ -31,9 +31,10 @@ struct WorkGroup {
 	Vessel *vessels;
 
 	QAtomicInt &vessel_idx;
+	cl_mem viscosity_table;
 
-	WorkGroup(int ne, cl_kernel k, Vessel *v, QAtomicInt &i)
-	        :n_elements(ne), kernel(k), vessels(v), vessel_idx(i) {}
+	WorkGroup(int ne, cl_kernel k, Vessel *v, QAtomicInt &i, cl_mem vt)
+	        :n_elements(ne), kernel(k), vessels(v), vessel_idx(i), viscosity_table(vt) {}
 };
 
 OpenCLIntegrationHelper::OpenCLIntegrationHelper(Model *model, Model::IntegralType type)
@@ -42,6 +43,10 @@ OpenCLIntegrationHelper::OpenCLIntegrationHelper(Model *model, Model::IntegralTy
 {
 	error = 0;
 	is_available = cl->isAvailable();
+	viscosity_first = 0;
+	viscosity_n = 0;
+	viscosity_excl_min = 0;
+	viscosity_excl_max = 0;
 
 	if (!is_available)
 		return;
@@ -65,9 +70,69 @@ OpenCLIntegrationHelper::OpenCLIntegrationHelper(Model *model, Model::IntegralTy
 
 OpenCLIntegrationHelper::~OpenCLIntegrationHelper()
 {
+	for (unsigned i=0; i<viscosity_tables.size(); ++i)
+		cl->functions().clReleaseMemObject(viscosity_tables[i]);
+
 	delete cpu_helper;
 }
 
+void OpenCLIntegrationHelper::beginCalculation()
+{
+	if (!is_available || d.empty())
+		return;
+
+	cpu_helper->beginCalculation();
+
+	/* Kernels use single precision copy of the CPU table. The interval
+	 * boundaries are powers of 2 subdivisions, so float and double
+	 * diameters map to the same intervals.
+	 */
+	const ViscosityTable &table = cpu_helper->viscosityTable();
+	const int n = ViscosityTable::n_intervals;
+	std::vector<cl_float4> coeff(n);
+	for (int i=0; i<n; ++i)
+		for (int j=0; j<4; ++j)
+			coeff[i].s[j] = table.coefficients(j)[i];
+
+	const float min_D = ViscosityTable::minDiameter();
+	cl_int min_D_bits;
+	memcpy(&min_D_bits, &min_D, sizeof(min_D_bits));
+	viscosity_first = min_D_bits >> (23-ViscosityTable::interval_bits);
+	viscosity_n = table.isValid() ? n : 0;
+	viscosity_excl_min = table.excludedMinDiameter();
+	viscosity_excl_max = table.excludedMaxDiameter();
+
+	const OpenCL_func f = cl->functions();
+	try {
+		for (int i=0; i<n_devices; ++i) {
+			cl_int err;
+			if (viscosity_tables.size() <= (unsigned)i) {
+				cl_mem mem = f.clCreateBuffer(d[i].context, CL_MEM_READ_ONLY,
+				                              sizeof(cl_float4)*n, NULL, &err);
+				cl->errorCheck(err, __FUNCTION__, __LINE__);
+				viscosity_tables.push_back(mem);
+			}
+
+			err = f.clEnqueueWriteBuffer(d[i].queue, viscosity_tables[i], CL_TRUE,
+			                             0, sizeof(cl_float4)*n, &coeff[0],
+			                             0, NULL, NULL);
+			cl->errorCheck(err, __FUNCTION__, __LINE__);
+		}
+	}
+	catch (opencl_exception e) {
+		qDebug() << "OpenCL ERROR: " << e.what();
+		error = e.error_no;
+	}
+}
+
+void OpenCLIntegrationHelper::endCalculation()
+{
+	if (!is_available || d.empty())
+		return;
+
+	cpu_helper->endCalculation();
+}
+
 double OpenCLIntegrationHelper::multiSegmentedVessels()
 {
 
@@ -81,7 +146,7 @@ double OpenCLIntegrationHelper::multiSegmentedVessels()
 	for (int i=0; i<n_devices; ++i) {
 		futures.addFuture(QtConcurrent::run(this,
 		        &OpenCLIntegrationHelper::integrateByDevice,
-		        d[i], d[i].multiSegmentedVesselKernel));
+		        i, d[i].multiSegmentedVesselKernel));
 	}
 
 	QList<QFuture<float> > results = futures.futures();
@@ -102,7 +167,7 @@ double OpenCLIntegrationHelper::singleSegmentVessels()
 	for (int i=0; i<n_devices; ++i) {
 		futures.addFuture(QtConcurrent::run(this,
 		        &OpenCLIntegrationHelper::integrateByDevice,
-		        d[i], d[i].singleSegmentVesselKernel));
+		        i, d[i].singleSegmentVesselKernel));
 	}
 
 	QList<QFuture<float> > results = futures.futures();
@@ -118,12 +183,20 @@ double OpenCLIntegrationHelper::capillaryResistances()
 	return cpu_helper->capillaryResistances();
 }
 
-float OpenCLIntegrationHelper::integrateByDevice(OpenCL_device &dev, cl_kernel k)
+float OpenCLIntegrationHelper::integrateByDevice(int dev_no, cl_kernel k)
 {
+	OpenCL_device &dev = d[dev_no];
 	struct CL_Vessel *cl_vessel = dev.cl_vessel;
 	struct CL_Result *ret_values = dev.integration_workspace;
 	float ret = 0.0;
 
+	// beginCalculation() failed before creating this device's table
+	if (dev_no >= static_cast<int>(viscosity_tables.size())) {
+		if (error == 0)
+			error = CL_INVALID_MEM_OBJECT;
+		return ret;
+	}
+
 	/* Integrate all arteries, then integrate veins. Scheduling same code in the work
 	 * unit maximizes throuput and efficiency.
 	 * Compute items in blocks of 1024 elements, using blocks of 4x256,
@@ -131,8 +204,8 @@ float OpenCLIntegrationHelper::integrateByDevice(OpenCL_device &dev, cl_kernel k
 	 */
 
 	const struct WorkGroup group[2] = {
-	        WorkGroup(nArteries(), k, arteries(), art_index),
-	        WorkGroup(nVeins(),    k, veins(),    vein_index)
+	        WorkGroup(nArteries(), k, arteries(), art_index, viscosity_tables[dev_no]),
+	        WorkGroup(nVeins(),    k, veins(),    vein_index, viscosity_tables[dev_no])
 	};
 
 	try {
@@ -197,6 +270,21 @@ float OpenCLIntegrationHelper::processWorkGroup(
 		err = f.clSetKernelArg(w.kernel, kernel_arg_no++, sizeof(cl_float), &tlrns);
 		cl->errorCheck(err, __FUNCTION__, __LINE__);
 
+		err = f.clSetKernelArg(w.kernel, kernel_arg_no++, sizeof(cl_mem), &w.viscosity_table);
+		cl->errorCheck(err, __FUNCTION__, __LINE__);
+
+		err = f.clSetKernelArg(w.kernel, kernel_arg_no++, sizeof(cl_int), &viscosity_first);
+		cl->errorCheck(err, __FUNCTION__, __LINE__);
+
+		err = f.clSetKernelArg(w.kernel, kernel_arg_no++, sizeof(cl_int), &viscosity_n);
+		cl->errorCheck(err, __FUNCTION__, __LINE__);
+
+		err = f.clSetKernelArg(w.kernel, kernel_arg_no++, sizeof(cl_float), &viscosity_excl_min);
+		cl->errorCheck(err, __FUNCTION__, __LINE__);
+
+		err = f.clSetKernelArg(w.kernel, kernel_arg_no++, sizeof(cl_float), &viscosity_excl_max);
+		cl->errorCheck(err, __FUNCTION__, __LINE__);
+
 		err = f.clSetKernelArg(w.kernel, kernel_arg_no++, sizeof(cl_mem), &dev.mem_vein_buffer);
 		cl->errorCheck(err, __FUNCTION__, __LINE__);
 
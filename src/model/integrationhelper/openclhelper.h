@@ -37,11 +37,14 @@ public:
 
 	virtual double capillaryResistances();
 
+	virtual void beginCalculation();
+	virtual void endCalculation();
+
 	virtual bool isAvailable() const { return is_available; }
 	virtual int hasErrors() const { return error; }
 
 protected:
-	float integrateByDevice(OpenCL_device &dev, cl_kernel k);
+	float integrateByDevice(int dev_no, cl_kernel k);
 	float processWorkGroup(const struct WorkGroup &wg,
 	                       OpenCL_device &dev,
 	                       struct CL_Vessel *cl_vessel_buf,
@@ -59,4 +62,9 @@ private:
 	// used by the integration function
 	QAtomicInt vein_index, art_index;
 	CpuIntegrationHelper *cpu_helper; // used for capillaries
+
+	// float copy of cpu_helper's viscosity table, one buffer per device
+	std::vector<cl_mem> viscosity_tables;
+	cl_int viscosity_first, viscosity_n;
+	cl_float viscosity_excl_min, viscosity_excl_max;
 };
@@ -0,0 +1,282 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "model/model.h"
+#include "simdkernel.h"
+#include "capillarysolver.h"
+#include <string.h>
+
+/* The kernels use GCC vector extensions. Each instruction set gets its own
+ * copy of simdkernel_impl.h compiled with the matching target pragma, and
+ * the copy is selected at runtime. Other compilers only get the scalar
+ * code in CpuIntegrationHelper.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_SIMD_KERNELS
+#endif
+
+#ifdef HAVE_SIMD_KERNELS
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define SIMD_NAMESPACE simd_sse2
+#define SIMD_WIDTH 2
+#include "simdkernel_impl.h"
+#undef SIMD_NAMESPACE
+#undef SIMD_WIDTH
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define SIMD_NAMESPACE simd_avx2
+#define SIMD_WIDTH 4
+#include "simdkernel_impl.h"
+#undef SIMD_NAMESPACE
+#undef SIMD_WIDTH
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define SIMD_NAMESPACE simd_avx512
+#define SIMD_WIDTH 8
+#include "simdkernel_impl.h"
+#undef SIMD_NAMESPACE
+#undef SIMD_WIDTH
+#pragma GCC pop_options
+
+#endif // HAVE_SIMD_KERNELS
+
+SimdVesselKernel::Isa SimdVesselKernel::bestAvailable()
+{
+#ifdef HAVE_SIMD_KERNELS
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f"))
+		return AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SSE2;
+#endif
+
+	return Scalar;
+}
+
+int SimdVesselKernel::lanes(Isa isa)
+{
+	switch (isa) {
+	case Scalar:
+		return 1;
+	case SSE2:
+		return 2;
+	case AVX2:
+		return 4;
+	case AVX512:
+		return 8;
+	}
+
+	return 1;
+}
+
+const char* SimdVesselKernel::isaName(Isa isa)
+{
+	switch (isa) {
+	case Scalar:
+		return "scalar";
+	case SSE2:
+		return "SSE2";
+	case AVX2:
+		return "AVX2";
+	case AVX512:
+		return "AVX-512";
+	}
+
+	return "unknown";
+}
+
+void SimdVesselKernel::multiSegmented(Isa isa, VesselBatch &b,
+                                      const ViscosityTable &viscosity, int n_sums)
+{
+#ifdef HAVE_SIMD_KERNELS
+	switch (isa) {
+	case Scalar:
+		break;
+	case SSE2:
+		simd_sse2::multiSegmented(b, viscosity, n_sums);
+		return;
+	case AVX2:
+		simd_avx2::multiSegmented(b, viscosity, n_sums);
+		return;
+	case AVX512:
+		simd_avx512::multiSegmented(b, viscosity, n_sums);
+		return;
+	}
+#else
+	Q_UNUSED(isa);
+	Q_UNUSED(b);
+	Q_UNUSED(viscosity);
+	Q_UNUSED(n_sums);
+#endif
+
+	qFatal("SimdVesselKernel called without SIMD support");
+}
+
+void SimdVesselKernel::singleSegment(Isa isa, VesselBatch &b,
+                                     const ViscosityTable &viscosity, double tlrns)
+{
+#ifdef HAVE_SIMD_KERNELS
+	switch (isa) {
+	case Scalar:
+		break;
+	case SSE2:
+		simd_sse2::singleSegment(b, viscosity, tlrns);
+		return;
+	case AVX2:
+		simd_avx2::singleSegment(b, viscosity, tlrns);
+		return;
+	case AVX512:
+		simd_avx512::singleSegment(b, viscosity, tlrns);
+		return;
+	}
+#else
+	Q_UNUSED(isa);
+	Q_UNUSED(b);
+	Q_UNUSED(viscosity);
+	Q_UNUSED(tlrns);
+#endif
+
+	qFatal("SimdVesselKernel called without SIMD support");
+}
+
+void SimdVesselKernel::adaptiveSegmented(Isa isa, VesselBatch &b,
+                                         const ViscosityTable &viscosity,
+                                         double tolerance, int max_segments)
+{
+#ifdef HAVE_SIMD_KERNELS
+	switch (isa) {
+	case Scalar:
+		break;
+	case SSE2:
+		simd_sse2::adaptiveSegmented(b, viscosity, tolerance, max_segments);
+		return;
+	case AVX2:
+		simd_avx2::adaptiveSegmented(b, viscosity, tolerance, max_segments);
+		return;
+	case AVX512:
+		simd_avx512::adaptiveSegmented(b, viscosity, tolerance, max_segments);
+		return;
+	}
+#else
+	Q_UNUSED(isa);
+	Q_UNUSED(b);
+	Q_UNUSED(viscosity);
+	Q_UNUSED(tolerance);
+	Q_UNUSED(max_segments);
+#endif
+
+	qFatal("SimdVesselKernel called without SIMD support");
+}
+
+void SimdVesselKernel::pressure0(Isa isa, VesselBatch &b)
+{
+#ifdef HAVE_SIMD_KERNELS
+	switch (isa) {
+	case Scalar:
+		break;
+	case SSE2:
+		simd_sse2::pressure0(b);
+		return;
+	case AVX2:
+		simd_avx2::pressure0(b);
+		return;
+	case AVX512:
+		simd_avx512::pressure0(b);
+		return;
+	}
+#else
+	Q_UNUSED(isa);
+	Q_UNUSED(b);
+#endif
+
+	qFatal("SimdVesselKernel called without SIMD support");
+}
+
+void SimdVesselKernel::multiSegmentedFloat(Isa isa, VesselBatch &b,
+                                           const ViscosityTable &viscosity, int n_sums,
+                                           bool double_sums)
+{
+#ifdef HAVE_SIMD_KERNELS
+	switch (isa) {
+	case Scalar:
+		break;
+	case SSE2:
+		if (double_sums)
+			simd_sse2::multiSegmentedFloat<simd_sse2::vdouble2>(b, viscosity, n_sums);
+		else
+			simd_sse2::multiSegmentedFloat<simd_sse2::vfloat>(b, viscosity, n_sums);
+		return;
+	case AVX2:
+		if (double_sums)
+			simd_avx2::multiSegmentedFloat<simd_avx2::vdouble2>(b, viscosity, n_sums);
+		else
+			simd_avx2::multiSegmentedFloat<simd_avx2::vfloat>(b, viscosity, n_sums);
+		return;
+	case AVX512:
+		if (double_sums)
+			simd_avx512::multiSegmentedFloat<simd_avx512::vdouble2>(b, viscosity, n_sums);
+		else
+			simd_avx512::multiSegmentedFloat<simd_avx512::vfloat>(b, viscosity, n_sums);
+		return;
+	}
+#else
+	Q_UNUSED(isa);
+	Q_UNUSED(b);
+	Q_UNUSED(viscosity);
+	Q_UNUSED(n_sums);
+	Q_UNUSED(double_sums);
+#endif
+
+	qFatal("SimdVesselKernel called without SIMD support");
+}
+
+void SimdVesselKernel::capillaries(Isa isa, CapillaryBatch &b)
+{
+#ifdef HAVE_SIMD_KERNELS
+	switch (isa) {
+	case Scalar:
+		break;
+	case SSE2:
+		simd_sse2::capillaries(b);
+		return;
+	case AVX2:
+		simd_avx2::capillaries(b);
+		return;
+	case AVX512:
+		simd_avx512::capillaries(b);
+		return;
+	}
+#else
+	Q_UNUSED(isa);
+	Q_UNUSED(b);
+#endif
+
+	qFatal("SimdVesselKernel called without SIMD support");
+}
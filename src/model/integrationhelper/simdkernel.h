@@ -0,0 +1,127 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMD_KERNEL_H
+#define SIMD_KERNEL_H
+
+#include <cmath>
+#include "viscosity.h"
+
+const double Kr = 1.2501e8; // cP/um**3 => mmHg*min/l
+
+/* A group of open vessels, with flow, integrated together by the SIMD
+ * kernels. Lanes past n are padded with a copy of the first lane by
+ * the kernel and their results are to be ignored.
+ */
+struct VesselBatch
+{
+	enum { max_lanes = 16 };
+
+	int n;
+
+	// inputs
+	double pressure_in[max_lanes];  // used by single segment kernel only
+	double pressure_out[max_lanes]; // max(pressure_0, pressure_out)
+	double flow[max_lanes];
+	double D[max_lanes], gamma[max_lanes], phi[max_lanes], tone[max_lanes];
+	double Ppl[max_lanes];
+	double perivascular_press_a[max_lanes], perivascular_press_b[max_lanes];
+	double perivascular_press_c[max_lanes], perivascular_press_d[max_lanes];
+	double length[max_lanes], vessel_ratio[max_lanes];
+
+	// outputs
+	double R[max_lanes];  // without Starling resistance
+	double Dmin[max_lanes], Dmax[max_lanes];
+	double D_integral[max_lanes];       // sum of segment diameters
+	double viscosity_factor[max_lanes]; // sum of segment viscosity factors
+	double volume[max_lanes];           // sum of segment volumes, in um**3
+
+	// adaptive kernel only
+	double segments[max_lanes], evaluations[max_lanes];
+
+	// pressure0 kernel only, uses Ppl, perivascular_press_* and tone
+	double pressure_0[max_lanes];
+};
+
+/* A group of open capillaries with flow, solved together by the SIMD
+ * capillary kernel. Padded like VesselBatch.
+ */
+struct CapillaryBatch
+{
+	enum { max_lanes = VesselBatch::max_lanes };
+
+	int n;
+
+	// inputs
+	double pressure_out[max_lanes];      // max(0, Ptmv)
+	double starling_pressure[max_lanes]; // -min(0, Ptmv)
+	double flow[max_lanes];
+	double Ho[max_lanes], Alpha[max_lanes], Krc[max_lanes];
+
+	// outputs
+	double Hin[max_lanes], Hout[max_lanes];
+	double R[max_lanes]; // without Starling resistance
+	double iterations[max_lanes];
+};
+
+class SimdVesselKernel
+{
+public:
+	enum Isa { Scalar, SSE2, AVX2, AVX512 };
+
+	// best ISA supported by the compiler and the running CPU
+	static Isa bestAvailable();
+	static int lanes(Isa isa);
+	static const char* isaName(Isa isa);
+
+	/* Same calculations as multiSegmentedFlowVessel and
+	 * singleSegmentVessel in CpuIntegrationHelper, for b.n vessels
+	 * at a time. isa must not be Scalar.
+	 */
+	static void multiSegmented(Isa isa, VesselBatch &b,
+	                           const ViscosityTable &viscosity, int n_sums);
+	static void singleSegment(Isa isa, VesselBatch &b,
+	                          const ViscosityTable &viscosity, double tlrns);
+
+	/* CpuIntegrationHelper::adaptiveSegmentedFlowVessel for b.n vessels.
+	 * Lanes step independently and finished lanes are masked. D_integral
+	 * and viscosity_factor are the means along the vessel.
+	 */
+	static void adaptiveSegmented(Isa isa, VesselBatch &b,
+	                              const ViscosityTable &viscosity,
+	                              double tolerance, int max_segments);
+
+	/* multiSegmented() with segments calculated in float, for
+	 * floatLanes(isa) vessels at a time. With double_sums, the pressure
+	 * along the vessel and the sums over the segments (R, volume, D and
+	 * viscosity factor) are accumulated in double.
+	 */
+	static int floatLanes(Isa isa) { return 2*lanes(isa); }
+	static void multiSegmentedFloat(Isa isa, VesselBatch &b,
+	                                const ViscosityTable &viscosity, int n_sums,
+	                                bool double_sums);
+
+	// Model::calculatePressure0 for b.n vessels
+	static void pressure0(Isa isa, VesselBatch &b);
+
+	// CpuIntegrationHelper::capillaryResistance for b.n capillaries
+	static void capillaries(Isa isa, CapillaryBatch &b);
+};
+
+#endif // SIMD_KERNEL_H
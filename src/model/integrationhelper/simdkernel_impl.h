@@ -0,0 +1,625 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Included multiple times by simdkernel.cpp, once per instruction set.
+ * SIMD_NAMESPACE and SIMD_WIDTH must be defined and the matching
+ * target pragma must be active.
+ */
+
+namespace SIMD_NAMESPACE {
+
+typedef double vdouble __attribute__((vector_size(SIMD_WIDTH*sizeof(double))));
+typedef long long vmask __attribute__((vector_size(SIMD_WIDTH*sizeof(double))));
+
+// float kernels, twice the lanes in the same registers
+typedef float vfloat __attribute__((vector_size(SIMD_WIDTH*sizeof(double))));
+typedef int vfmask __attribute__((vector_size(SIMD_WIDTH*sizeof(double))));
+
+}
+
+namespace vmath {
+
+template<> struct Traits<SIMD_NAMESPACE::vdouble>
+{
+	typedef SIMD_NAMESPACE::vdouble T;
+	typedef SIMD_NAMESPACE::vmask Int;
+	typedef double Scalar;
+
+	static Int toBits(T x) { return (Int)x; }
+	static T fromBits(Int i) { return (T)i; }
+	static T select(Int mask, T a, T b) { return (T)((mask & (Int)a) | (~mask & (Int)b)); }
+	static T splat(double s) {
+		T v;
+		for (int k=0; k<SIMD_WIDTH; ++k)
+			v[k] = s;
+		return v;
+	}
+	static bool all(Int mask) {
+		for (int k=0; k<SIMD_WIDTH; ++k)
+			if (!mask[k])
+				return false;
+		return true;
+	}
+	static T gather(const double *base, Int idx) {
+		T v;
+		for (int k=0; k<SIMD_WIDTH; ++k)
+			v[k] = base[idx[k]];
+		return v;
+	}
+};
+
+template<> struct Traits<SIMD_NAMESPACE::vfloat>
+{
+	typedef SIMD_NAMESPACE::vfloat T;
+	typedef SIMD_NAMESPACE::vfmask Int;
+	typedef float Scalar;
+
+	static Int toBits(T x) { return (Int)x; }
+	static T fromBits(Int i) { return (T)i; }
+	static T select(Int mask, T a, T b) { return (T)((mask & (Int)a) | (~mask & (Int)b)); }
+	static T splat(float s) {
+		T v;
+		for (int k=0; k<2*SIMD_WIDTH; ++k)
+			v[k] = s;
+		return v;
+	}
+	static bool all(Int mask) {
+		for (int k=0; k<2*SIMD_WIDTH; ++k)
+			if (!mask[k])
+				return false;
+		return true;
+	}
+	static T gather(const float *base, Int idx) {
+		T v;
+		for (int k=0; k<2*SIMD_WIDTH; ++k)
+			v[k] = base[idx[k]];
+		return v;
+	}
+};
+
+}
+
+namespace SIMD_NAMESPACE {
+
+inline vdouble load(const double *p)
+{
+	vdouble v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline void store(double *p, vdouble v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+inline vdouble broadcast(double d)
+{
+	return vmath::Traits<vdouble>::splat(d);
+}
+
+// result = mask ? a : b
+inline vdouble select(vmask mask, vdouble a, vdouble b)
+{
+	return vmath::Traits<vdouble>::select(mask, a, b);
+}
+
+inline bool any(vmask mask)
+{
+	for (int k=0; k<SIMD_WIDTH; ++k)
+		if (mask[k])
+			return true;
+	return false;
+}
+
+inline vdouble vabs(vdouble x)
+{
+	return (vdouble)((vmask)x & ~(vmask)broadcast(-0.0));
+}
+
+inline void padBatch(VesselBatch &b, int lanes)
+{
+	for (int k=b.n; k<lanes; ++k) {
+		b.pressure_in[k] = b.pressure_in[0];
+		b.pressure_out[k] = b.pressure_out[0];
+		b.flow[k] = b.flow[0];
+		b.D[k] = b.D[0];
+		b.gamma[k] = b.gamma[0];
+		b.phi[k] = b.phi[0];
+		b.tone[k] = b.tone[0];
+		b.Ppl[k] = b.Ppl[0];
+		b.perivascular_press_a[k] = b.perivascular_press_a[0];
+		b.perivascular_press_b[k] = b.perivascular_press_b[0];
+		b.perivascular_press_c[k] = b.perivascular_press_c[0];
+		b.perivascular_press_d[k] = b.perivascular_press_d[0];
+		b.length[k] = b.length[0];
+		b.vessel_ratio[k] = b.vessel_ratio[0];
+	}
+}
+
+void multiSegmented(VesselBatch &b, const ViscosityTable &viscosity, int n_sums)
+{
+	padBatch(b, SIMD_WIDTH);
+
+	const vdouble flow = load(b.flow);
+	const vdouble D0 = load(b.D);
+	const vdouble gamma = load(b.gamma);
+	const vdouble phi = load(b.phi);
+	const vdouble tone = load(b.tone);
+	const vdouble Ppl = load(b.Ppl);
+	const vdouble pa = load(b.perivascular_press_a);
+	const vdouble pb = load(b.perivascular_press_b);
+	const vdouble pc = load(b.perivascular_press_c);
+	const vdouble pd = load(b.perivascular_press_d);
+	const vdouble ratio = load(b.vessel_ratio);
+	const vdouble dL = load(b.length) / (double)n_sums;
+
+	const vdouble D_gamma = D0*gamma;
+	const vdouble gamma_1 = gamma-1.0;
+	const vdouble D_gamma_1 = gamma_1*D0;
+
+	vdouble P = load(b.pressure_out);
+	vdouble Rtot = broadcast(0.0);
+	vdouble vf_sum = broadcast(0.0);
+	vdouble volume = broadcast(0.0);
+	vdouble D_integral = broadcast(0.0);
+	vdouble D = broadcast(0.0);
+
+	for (int j=0; j<n_sums; ++j) {
+		vdouble Pv = cmH2O_per_mmHg * (P - tone);
+		vdouble Px = Ppl + pa + pb/(1.0 + vmath::exp((pc-Pv+Ppl)/pd));
+		vdouble Ptm = Pv - Px;
+
+		D = D_gamma - D_gamma_1*vmath::exp(-Ptm*phi/gamma_1);
+		D_integral += D;
+		const vdouble vf = viscosity.value(D);
+
+		if (j == 0)
+			store(b.Dmin, D);
+
+		const vdouble D2 = D*D;
+		vdouble Rs = 128*Kr/M_PI * vf * dL / (D2*D2) * ratio;
+		vf_sum += vf;
+		volume += M_PI/4.0 * D2 * dL;
+
+		P = P + flow * Rs;
+		Rtot += Rs;
+	}
+
+	store(b.Dmax, D);
+	store(b.R, Rtot);
+	store(b.D_integral, D_integral);
+	store(b.viscosity_factor, vf_sum);
+	store(b.volume, volume);
+}
+
+void singleSegment(VesselBatch &b, const ViscosityTable &viscosity, double tlrns)
+{
+	padBatch(b, SIMD_WIDTH);
+
+	const vdouble flow = load(b.flow);
+	const vdouble D0 = load(b.D);
+	const vdouble gamma = load(b.gamma);
+	const vdouble phi = load(b.phi);
+	const vdouble tone = load(b.tone);
+	const vdouble Ppl = load(b.Ppl);
+	const vdouble pa = load(b.perivascular_press_a);
+	const vdouble pb = load(b.perivascular_press_b);
+	const vdouble pc = load(b.perivascular_press_c);
+	const vdouble pd = load(b.perivascular_press_d);
+	const vdouble ratio = load(b.vessel_ratio);
+	const vdouble dL = load(b.length);
+	const vdouble Pout = load(b.pressure_out);
+
+	const vdouble D_gamma = D0*gamma;
+	const vdouble gamma_1 = gamma-1.0;
+	const vdouble D_gamma_1 = gamma_1*D0;
+
+	vdouble new_Pin = load(b.pressure_in);
+	vdouble Rs = broadcast(0.0);
+	vdouble vf = broadcast(0.0);
+	vdouble D = broadcast(0.0);
+
+	/* Lanes converge independently. Each lane runs the same number of
+	 * iterations as the scalar code and is frozen afterwards.
+	 */
+	vmask active = (vmask)(broadcast(0.0) == 0.0); // all lanes
+	vdouble iterations = broadcast(0.0);
+	do {
+		const vdouble old_Pin = new_Pin;
+		const vdouble avg_P = (new_Pin + Pout) / 2.0;
+		const vdouble Pv = cmH2O_per_mmHg * (avg_P - tone);
+		const vdouble Px = Ppl + pa + pb/(1.0 + vmath::exp((pc-Pv+Ppl)/pd));
+		const vdouble Ptm = Pv - Px;
+
+		const vdouble D_new = D_gamma - D_gamma_1*vmath::exp(-Ptm*phi/gamma_1);
+		const vdouble vf_new = viscosity.value(D_new);
+		const vdouble D2 = D_new*D_new;
+		const vdouble Rs_new = 128*Kr/M_PI * vf_new * dL / (D2*D2) * ratio;
+
+		vdouble Pin = Pout + flow * Rs_new;
+		Pin = (Pin + old_Pin) / 2.0;
+
+		D = select(active, D_new, D);
+		vf = select(active, vf_new, vf);
+		Rs = select(active, Rs_new, Rs);
+		new_Pin = select(active, Pin, new_Pin);
+
+		// while (fabs(new_Pin - old_Pin)/old_Pin > Tlrns() && i++ < 100)
+		active &= (vmask)(vabs(new_Pin - old_Pin)/old_Pin > tlrns);
+		active &= (vmask)(iterations < 100.0);
+		iterations += 1.0;
+	} while (any(active));
+
+	store(b.Dmin, D);
+	store(b.Dmax, D);
+	store(b.D_integral, D);
+	store(b.viscosity_factor, vf);
+	store(b.R, Rs);
+	const vdouble D2 = D*D;
+	store(b.volume, M_PI/4.0 * D2 * dL);
+}
+
+void adaptiveSegmented(VesselBatch &b, const ViscosityTable &viscosity,
+                       double tolerance, int max_segments)
+{
+	padBatch(b, SIMD_WIDTH);
+
+	const vdouble flow = load(b.flow);
+	const vdouble D0 = load(b.D);
+	const vdouble gamma = load(b.gamma);
+	const vdouble phi = load(b.phi);
+	const vdouble tone = load(b.tone);
+	const vdouble Ppl = load(b.Ppl);
+	const vdouble pa = load(b.perivascular_press_a);
+	const vdouble pb = load(b.perivascular_press_b);
+	const vdouble pc = load(b.perivascular_press_c);
+	const vdouble pd = load(b.perivascular_press_d);
+	const vdouble ratio = load(b.vessel_ratio);
+	const vdouble L = load(b.length);
+	const vdouble min_h = L / (double)max_segments;
+
+	const vdouble D_gamma = D0*gamma;
+	const vdouble gamma_1 = gamma-1.0;
+	const vdouble D_gamma_1 = gamma_1*D0;
+
+	// stages, P[i] -> D[i] -> vf[i] -> resistance per length r[i]
+	vdouble P[4], D[4], vf[4], r[4];
+
+	P[0] = load(b.pressure_out);
+	{
+		const vdouble Pv = cmH2O_per_mmHg * (P[0] - tone);
+		const vdouble Px = Ppl + pa + pb/(1.0 + vmath::exp((pc-Pv+Ppl)/pd));
+		const vdouble Ptm = Pv - Px;
+
+		D[0] = D_gamma - D_gamma_1*vmath::exp(-Ptm*phi/gamma_1);
+		vf[0] = viscosity.value(D[0]);
+		const vdouble D2 = D[0]*D[0];
+		r[0] = 128*Kr/M_PI * vf[0] / (D2*D2) * ratio;
+	}
+	store(b.Dmin, D[0]);
+
+	vdouble x = broadcast(0.0), h = L;
+	vdouble Rtot = broadcast(0.0);
+	vdouble D_integral = broadcast(0.0);
+	vdouble vf_integral = broadcast(0.0);
+	vdouble D2_integral = broadcast(0.0);
+	vdouble segments = broadcast(0.0);
+	vdouble evaluations = broadcast(1.0);
+
+	vmask active = (vmask)(broadcast(0.0) == 0.0); // all lanes
+	do {
+		const vmask last = (vmask)(h >= L - x);
+		h = select(last, L - x, h);
+
+		const vdouble q = flow*h;
+		for (int i=1; i<4; ++i) {
+			if (i == 1)
+				P[1] = P[0] + 0.5*q*r[0];
+			else if (i == 2)
+				P[2] = P[0] + 0.75*q*r[1];
+			else
+				P[3] = P[0] + q*(2.0/9.0*r[0] + 1.0/3.0*r[1] + 4.0/9.0*r[2]);
+
+			const vdouble Pv = cmH2O_per_mmHg * (P[i] - tone);
+			const vdouble Px = Ppl + pa + pb/(1.0 + vmath::exp((pc-Pv+Ppl)/pd));
+			const vdouble Ptm = Pv - Px;
+
+			D[i] = D_gamma - D_gamma_1*vmath::exp(-Ptm*phi/gamma_1);
+			vf[i] = viscosity.value(D[i]);
+			const vdouble D2 = D[i]*D[i];
+			r[i] = 128*Kr/M_PI * vf[i] / (D2*D2) * ratio;
+		}
+		evaluations += select(active, broadcast(3.0), broadcast(0.0));
+
+		const vdouble dR = h*(2.0/9.0*r[0] + 1.0/3.0*r[1] + 4.0/9.0*r[2]);
+		const vdouble err = vabs(h*(-5.0/72.0*r[0] + 1.0/12.0*r[1] + 1.0/9.0*r[2] - 0.125*r[3]));
+		const vdouble allowed = tolerance*vabs(dR);
+		const vmask accept = active & ((vmask)(err <= allowed) | (vmask)(h <= min_h));
+
+		Rtot = select(accept, Rtot + dR, Rtot);
+		D_integral = select(accept, D_integral +
+		                    h*(2.0/9.0*D[0] + 1.0/3.0*D[1] + 4.0/9.0*D[2]), D_integral);
+		vf_integral = select(accept, vf_integral +
+		                     h*(2.0/9.0*vf[0] + 1.0/3.0*vf[1] + 4.0/9.0*vf[2]), vf_integral);
+		D2_integral = select(accept, D2_integral +
+		                     h*(2.0/9.0*D[0]*D[0] + 1.0/3.0*D[1]*D[1] + 4.0/9.0*D[2]*D[2]),
+		                     D2_integral);
+		segments = select(accept, segments + 1.0, segments);
+		x = select(accept, x + h, x);
+
+		// last stage is the first of the next step
+		P[0] = select(accept, P[3], P[0]);
+		D[0] = select(accept, D[3], D[0]);
+		vf[0] = select(accept, vf[3], vf[0]);
+		r[0] = select(accept, r[3], r[0]);
+
+		active &= ~(accept & last);
+
+		vdouble s = err / allowed;
+		s = select((vmask)(s < 1e4), s, broadcast(1e4));
+		s = select((vmask)(s > 1e-4), s, broadcast(1e-4));
+		vdouble factor = 0.9*vmath::pow(s, -1.0/3.0);
+		factor = select((vmask)(factor < 5.0), factor, broadcast(5.0));
+		factor = select((vmask)(factor > 0.2), factor, broadcast(0.2));
+		const vdouble new_h = h*factor;
+		h = select((vmask)(new_h < min_h), min_h, new_h);
+	} while (any(active));
+
+	store(b.Dmax, D[0]);
+	store(b.R, Rtot);
+	store(b.D_integral, D_integral / L);
+	store(b.viscosity_factor, vf_integral / L);
+	store(b.volume, M_PI/4.0 * D2_integral);
+	store(b.segments, segments);
+	store(b.evaluations, evaluations);
+}
+
+void pressure0(VesselBatch &b)
+{
+	padBatch(b, SIMD_WIDTH);
+
+	const vdouble Ppl = load(b.Ppl);
+	const vdouble pa = load(b.perivascular_press_a);
+	const vdouble pb = load(b.perivascular_press_b);
+	const vdouble pc = load(b.perivascular_press_c);
+	const vdouble pd = load(b.perivascular_press_d);
+	const vdouble tone = load(b.tone);
+
+	/* Newton's method from Pv=75 as in the scalar code. Lanes stop when
+	 * their step is below 1e-10, all stop after the same 100 iterations.
+	 */
+	vdouble Pv = broadcast(75.0);
+	vmask active = (vmask)(broadcast(0.0) == 0.0); // all lanes
+	int i = 0;
+	do {
+		const vdouble alpha = Pv - pc - Ppl;
+		const vdouble ex = vmath::exp(-alpha/pd);
+
+		const vdouble fx = alpha - pa + pc - pb / (1.0 + ex);
+		const vdouble fxp = 1.0 - (pb/pd)*ex/((1.0+ex)*(1.0+ex));
+
+		const vdouble new_Pv = Pv - fx/fxp;
+		const vdouble diff = vabs(Pv - new_Pv);
+		Pv = select(active, new_Pv, Pv);
+		active &= (vmask)(diff > 1e-10);
+	} while (i++ < 100 && any(active));
+
+	store(b.pressure_0, Pv/cmH2O_per_mmHg + tone);
+}
+
+// float lanes widened to double
+struct vdouble2
+{
+	vdouble lo, hi;
+};
+
+inline vfloat loadFloat(const double *p)
+{
+	vfloat v;
+	for (int k=0; k<2*SIMD_WIDTH; ++k)
+		v[k] = float(p[k]);
+	return v;
+}
+
+inline void store(double *p, vfloat v)
+{
+	for (int k=0; k<2*SIMD_WIDTH; ++k)
+		p[k] = v[k];
+}
+
+inline void store(double *p, const vdouble2 &v)
+{
+	store(p, v.lo);
+	store(p+SIMD_WIDTH, v.hi);
+}
+
+#if __GNUC__ >= 9
+typedef float vhalf __attribute__((vector_size(SIMD_WIDTH*sizeof(float))));
+#endif
+
+inline vdouble2 widen(vfloat v)
+{
+	vdouble2 d;
+#if __GNUC__ >= 9
+	vhalf h[2];
+	memcpy(h, &v, sizeof(v));
+	d.lo = __builtin_convertvector(h[0], vdouble);
+	d.hi = __builtin_convertvector(h[1], vdouble);
+#else
+	for (int k=0; k<SIMD_WIDTH; ++k) {
+		d.lo[k] = v[k];
+		d.hi[k] = v[k+SIMD_WIDTH];
+	}
+#endif
+	return d;
+}
+
+inline vfloat narrow(vfloat v)
+{
+	return v;
+}
+
+inline vfloat narrow(const vdouble2 &d)
+{
+	vfloat v;
+#if __GNUC__ >= 9
+	const vhalf h[2] = { __builtin_convertvector(d.lo, vhalf),
+	                     __builtin_convertvector(d.hi, vhalf) };
+	memcpy(&v, h, sizeof(v));
+#else
+	for (int k=0; k<SIMD_WIDTH; ++k) {
+		v[k] = float(d.lo[k]);
+		v[k+SIMD_WIDTH] = float(d.hi[k]);
+	}
+#endif
+	return v;
+}
+
+inline void load(vfloat &acc, const double *p)
+{
+	acc = loadFloat(p);
+}
+
+inline void load(vdouble2 &acc, const double *p)
+{
+	acc.lo = load(p);
+	acc.hi = load(p+SIMD_WIDTH);
+}
+
+inline void accumulate(vfloat &acc, vfloat v)
+{
+	acc += v;
+}
+
+inline void accumulate(vdouble2 &acc, vfloat v)
+{
+	const vdouble2 d = widen(v);
+	acc.lo += d.lo;
+	acc.hi += d.hi;
+}
+
+// table lookup in float, the rest as in multiSegmented()
+inline vfloat viscosityValue(const ViscosityTable &viscosity, vfloat D)
+{
+	vfmask in_table;
+	const vfloat table = viscosity.floatValue(D, in_table);
+	if (vmath::Traits<vfloat>::all(in_table))
+		return table;
+
+	vdouble2 exact = widen(D);
+	exact.lo = viscosity.value(exact.lo);
+	exact.hi = viscosity.value(exact.hi);
+	return vmath::Traits<vfloat>::select(in_table, table, narrow(exact));
+}
+
+/* Float version of multiSegmented(), for 2*SIMD_WIDTH vessels. Segments
+ * are calculated in float. Acc is the type of the sums over the segments,
+ * including the pressure along the vessel: vfloat, or vdouble2 for double
+ * accumulation.
+ */
+template<class Acc>
+void multiSegmentedFloat(VesselBatch &b, const ViscosityTable &viscosity, int n_sums)
+{
+	padBatch(b, 2*SIMD_WIDTH);
+
+	const vfloat flow = loadFloat(b.flow);
+	const vfloat D0 = loadFloat(b.D);
+	const vfloat gamma = loadFloat(b.gamma);
+	const vfloat phi = loadFloat(b.phi);
+	const vfloat tone = loadFloat(b.tone);
+	const vfloat Ppl = loadFloat(b.Ppl);
+	const vfloat pa = loadFloat(b.perivascular_press_a);
+	const vfloat pb = loadFloat(b.perivascular_press_b);
+	const vfloat pc = loadFloat(b.perivascular_press_c);
+	const vfloat pd = loadFloat(b.perivascular_press_d);
+	const vfloat ratio = loadFloat(b.vessel_ratio);
+	const vfloat dL = loadFloat(b.length) / float(n_sums);
+
+	const vfloat D_gamma = D0*gamma;
+	const vfloat gamma_1 = gamma-1.0f;
+	const vfloat D_gamma_1 = gamma_1*D0;
+
+	Acc P;
+	load(P, b.pressure_out);
+	Acc Rtot = Acc(), vf_sum = Acc(), volume = Acc(), D_integral = Acc();
+	vfloat D = vmath::Traits<vfloat>::splat(0.0f);
+
+	for (int j=0; j<n_sums; ++j) {
+		vfloat Pv = float(cmH2O_per_mmHg) * (narrow(P) - tone);
+		vfloat Px = Ppl + pa + pb/(1.0f + vmath::exp((pc-Pv+Ppl)/pd));
+		vfloat Ptm = Pv - Px;
+
+		D = D_gamma - D_gamma_1*vmath::exp(-Ptm*phi/gamma_1);
+		accumulate(D_integral, D);
+		const vfloat vf = viscosityValue(viscosity, D);
+
+		if (j == 0)
+			store(b.Dmin, D);
+
+		const vfloat D2 = D*D;
+		vfloat Rs = float(128*Kr/M_PI) * vf * dL / (D2*D2) * ratio;
+		accumulate(vf_sum, vf);
+		accumulate(volume, float(M_PI/4.0) * D2 * dL);
+
+		accumulate(P, flow * Rs);
+		accumulate(Rtot, Rs);
+	}
+
+	store(b.Dmax, D);
+	store(b.R, Rtot);
+	store(b.D_integral, D_integral);
+	store(b.viscosity_factor, vf_sum);
+	store(b.volume, volume);
+}
+
+inline void padBatch(CapillaryBatch &b)
+{
+	for (int k=b.n; k<SIMD_WIDTH; ++k) {
+		b.pressure_out[k] = b.pressure_out[0];
+		b.starling_pressure[k] = b.starling_pressure[0];
+		b.flow[k] = b.flow[0];
+		b.Ho[k] = b.Ho[0];
+		b.Alpha[k] = b.Alpha[0];
+		b.Krc[k] = b.Krc[0];
+	}
+}
+
+void capillaries(CapillaryBatch &b)
+{
+	padBatch(b);
+
+	const vdouble P = load(b.pressure_out);
+	const vdouble flow = load(b.flow);
+	const vdouble Ho = load(b.Ho);
+	const vdouble Alpha = load(b.Alpha);
+	const vdouble Krc = load(b.Krc);
+
+	vdouble dH, Hin, S, iterations;
+	const vdouble Hout = capillarySheetHeight(P, Ho, Alpha, dH);
+	capillaryInletPressure(P + load(b.starling_pressure), flow*Krc/Alpha,
+	                       Ho, Alpha, Hout, Hin, S, iterations);
+
+	store(b.Hin, Hin);
+	store(b.Hout, Hout);
+	store(b.R, Krc/(Alpha*cmH2O_per_mmHg*S));
+	store(b.iterations, iterations);
+}
+
+}
@@ -0,0 +1,170 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include "viscosity.h"
+
+ViscosityTable::ViscosityTable()
+        : coeff(4*n_intervals, 0.0), float_coeff(4*n_intervals, 0.0f)
+{
+	for (int i=0; i<4; ++i) {
+		c[i] = &coeff[i*n_intervals];
+		cf[i] = &float_coeff[i*n_intervals];
+	}
+
+	min_D = minDiameter();
+	max_D = maxDiameter();
+	first_index = vmath::Traits<double>::toBits(min_D) >> int(52-interval_bits);
+	first_float_index = vmath::Traits<float>::toBits(float(min_D)) >> int(23-interval_bits);
+
+	exact_min_D = 0;
+	exact_max_D = 0;
+
+	table_hct = 0;
+	ln_1_hct = 0;
+	max_error = 0;
+	built = false;
+	valid = false;
+}
+
+double ViscosityTable::minDiameter()
+{
+	return std::ldexp(1.0, min_exponent);
+}
+
+double ViscosityTable::maxDiameter()
+{
+	return std::ldexp(1.0, max_exponent);
+}
+
+double ViscosityTable::intervalStart(int i) const
+{
+	const int octave = i / intervals_per_octave;
+	const int sub = i % intervals_per_octave;
+	return std::ldexp(1.0 + sub/double(intervals_per_octave), min_exponent+octave);
+}
+
+bool ViscosityTable::build(double hct)
+{
+	table_hct = hct;
+	ln_1_hct = std::log(1.0-hct);
+	built = true;
+	valid = false;
+
+	/* Find intervals where viscosityFactor() switches between its two
+	 * forms, and exclude them, and one interval on each side so that
+	 * the derivative stencils do not cross the discontinuity.
+	 */
+	int first_excluded = n_intervals, last_excluded = -1;
+	for (int i=0; i<n_intervals; ++i) {
+		const double x0 = intervalStart(i);
+		const double h = intervalStart(i+1) - x0;
+		const bool branch = std::fabs(viscosityExponent(x0)) > 0.01;
+		for (int k=1; k<=64; ++k) {
+			const double C = viscosityExponent(x0 + h*k/64.0);
+			if ((std::fabs(C) > 0.01) != branch) {
+				first_excluded = std::min(first_excluded, i);
+				last_excluded = std::max(last_excluded, i);
+				break;
+			}
+		}
+	}
+
+	if (last_excluded >= 0) {
+		first_excluded = std::max(first_excluded-1, 0);
+		last_excluded = std::min(last_excluded+1, n_intervals-1);
+		exact_min_D = intervalStart(first_excluded);
+		exact_max_D = intervalStart(last_excluded+1);
+	}
+	else {
+		exact_min_D = exact_max_D = 0;
+	}
+
+	// node values and derivatives, 4th order central difference
+	std::vector<double> x(n_intervals+1), y(n_intervals+1), m(n_intervals+1);
+	for (int i=0; i<=n_intervals; ++i) {
+		x[i] = intervalStart(i);
+		y[i] = viscosityFactor(x[i], ln_1_hct);
+
+		const double h = x[i] * 1e-3;
+		m[i] = (8.0*(viscosityFactor(x[i]+h, ln_1_hct) - viscosityFactor(x[i]-h, ln_1_hct)) -
+		        (viscosityFactor(x[i]+2*h, ln_1_hct) - viscosityFactor(x[i]-2*h, ln_1_hct))) / (12.0*h);
+	}
+
+	/* Fritsch-Carlson limiter, applied only to intervals where the
+	 * function is monotone at both ends. The interval containing the
+	 * viscosity minimum keeps its exact derivatives.
+	 */
+	for (int i=0; i<n_intervals; ++i) {
+		const double delta = (y[i+1]-y[i]) / (x[i+1]-x[i]);
+		if (delta == 0.0)
+			continue;
+
+		const double a = m[i] / delta;
+		const double b = m[i+1] / delta;
+		const double r = a*a + b*b;
+		if (a > 0.0 && b > 0.0 && r > 9.0) {
+			const double tau = 3.0 / std::sqrt(r);
+			m[i] = tau * a * delta;
+			m[i+1] = tau * b * delta;
+		}
+	}
+
+	for (int i=0; i<n_intervals; ++i) {
+		const double h = x[i+1]-x[i];
+		coeff[i] = y[i];
+		coeff[n_intervals+i] = h*m[i];
+		coeff[2*n_intervals+i] = 3.0*(y[i+1]-y[i]) - h*(2.0*m[i] + m[i+1]);
+		coeff[3*n_intervals+i] = 2.0*(y[i]-y[i+1]) + h*(m[i] + m[i+1]);
+	}
+
+	for (int i=0; i<4*n_intervals; ++i)
+		float_coeff[i] = float(coeff[i]);
+
+	/* Estimate the error by sampling every interval. The interpolation
+	 * error vanishes at the nodes and peaks within the interval, near the
+	 * midpoint for a smooth function, which is one of the samples.
+	 */
+	max_error = 0;
+	for (int i=0; i<n_intervals; ++i) {
+		if (x[i] >= exact_min_D && x[i] < exact_max_D)
+			continue;
+
+		const double h = x[i+1]-x[i];
+		for (int k=1; k<error_samples; ++k) {
+			const double D = x[i] + h*k/double(error_samples);
+			const double exact = viscosityFactor(D, ln_1_hct);
+			const double err = std::fabs(interpolate(D) - exact) / std::fabs(exact);
+
+			if (!(err <= max_error))
+				max_error = err;
+		}
+	}
+
+	valid = max_error <= errorBound();
+	if (!valid)
+		qWarning() << "Viscosity table for Hct" << hct << "has estimated error" << max_error
+		           << "- using exact viscosity calculation";
+	else
+		qDebug() << "Viscosity table for Hct" << hct << "estimated max error" << max_error;
+
+	return valid;
+}
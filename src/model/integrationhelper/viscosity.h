@@ -0,0 +1,189 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VISCOSITY_H
+#define VISCOSITY_H
+
+#include <vector>
+#include "model/vmath.h"
+
+// Hct exponent of the viscosity factor, for diameter D (um)
+template<class T>
+VMATH_INLINE T viscosityExponent(T D)
+{
+	const T D4 = (D*D)*(D*D);
+	const T q = 1/(1 + 1e-11*(D4*D4*D4)); // 1/(1 + 1e-11*D^12)
+	return (0.8+vmath::exp(-0.075*D)) * (q-1.0) + q;
+}
+
+/* Viscosity factor for diameter D (um). ln_1_hct is std::log(1-Hct), which
+ * is constant for the model so it is calculated once by the caller.
+ * T is double or one of the SIMD kernel vector types.
+ */
+template<class T>
+VMATH_INLINE T viscosityFactor(T D, double ln_1_hct)
+{
+	const double ln_1_hct45 = -0.597837000755620449; // log(1.0-0.45)
+
+	const T C = viscosityExponent(D);
+	const T Mi45 = 220 * vmath::exp(-1.3*D) - 2.44*vmath::exp(-0.06*vmath::pow(D, 0.645)) + 3.2;
+	const T bb = vmath::Traits<T>::select((C < -0.01) | (C > 0.01),
+	                (vmath::exp(C*ln_1_hct)-1)/(vmath::exp(C*ln_1_hct45)-1),
+	                vmath::Traits<T>::splat(ln_1_hct/ln_1_hct45));
+	return (1.0 + (Mi45-1.0)*bb) / 3.2;
+}
+
+/* Tabulated viscosityFactor() for a given Hct.
+ *
+ * The diameter range [min_diameter, max_diameter) is split into
+ * intervals_per_octave intervals per power of 2. An interval is selected
+ * directly from the exponent and top mantissa bits of D, and the position
+ * within the interval from the remaining mantissa bits, so no log() or
+ * division is needed for the lookup.
+ *
+ * Each interval is a cubic Hermite polynomial through the exact values and
+ * derivatives at its end points, with Fritsch-Carlson limited slopes so the
+ * interpolant is monotone wherever the data is. After building, the table
+ * is compared to viscosityFactor() at error_samples-1 points within every
+ * interval. This estimates the error, it is not a proven bound. If the
+ * estimate exceeds errorBound() the table is not used.
+ *
+ * viscosityFactor() is discontinuous where |viscosityExponent()| crosses
+ * 0.01 (D ~ 8.5um). Intervals around these points are excluded from the
+ * table. Diameters there, and outside the table range, including closed
+ * and collapsed vessels, use viscosityFactor() directly.
+ */
+class ViscosityTable
+{
+public:
+	enum {
+		interval_bits = 7, // 128 intervals per octave
+		intervals_per_octave = 1 << interval_bits,
+		min_exponent = -2, // 0.25 um
+		max_exponent = 17, // 131072 um
+		n_intervals = (max_exponent-min_exponent) * intervals_per_octave,
+		error_samples = 16 // per interval, for maxError()
+	};
+
+	ViscosityTable();
+
+	// builds the table for given hematocrit, returns isValid()
+	bool build(double hct);
+
+	bool isBuilt() const { return built; }
+	bool isValid() const { return valid; }
+	double hct() const { return table_hct; }
+	double maxError() const { return max_error; } // estimated, relative
+	static double errorBound() { return 1e-7; } // relative
+
+	static double minDiameter();
+	static double maxDiameter();
+
+	// diameters in [min, max) are not taken from the table
+	double excludedMinDiameter() const { return exact_min_D; }
+	double excludedMaxDiameter() const { return exact_max_D; }
+
+	/* Coefficients of interval i, in terms of t in [0,1) within the
+	 * interval, are c[0][i] + t*(c[1][i] + t*(c[2][i] + t*c[3][i]))
+	 */
+	const double* coefficients(int n) const { return c[n]; }
+
+	template<class T>
+	VMATH_INLINE T value(T D) const
+	{
+		typedef vmath::Traits<T> tr;
+
+		if (!valid)
+			return viscosityFactor(D, ln_1_hct);
+
+		const typename tr::Int in_table = (D >= min_D) & (D < max_D) &
+		                                  ((D < exact_min_D) | (D >= exact_max_D));
+		if (tr::all(in_table))
+			return interpolate(D);
+
+		// decided per element, so vector and scalar results are identical
+		const T exact = viscosityFactor(D, ln_1_hct);
+		return tr::select(in_table, interpolate(tr::select(in_table, D, tr::splat(min_D))), exact);
+	}
+
+	/* Table value for float types, from float copies of the coefficients.
+	 * Elements without in_table set are not in the table and the caller
+	 * calculates them with value() in double precision.
+	 */
+	template<class T>
+	VMATH_INLINE T floatValue(T D, typename vmath::Traits<T>::Int &in_table) const
+	{
+		typedef vmath::Traits<T> tr;
+		typedef typename tr::Int I;
+
+		in_table = (D >= float(min_D)) & (D < float(max_D)) &
+		           ((D < float(exact_min_D)) | (D >= float(exact_max_D)));
+		if (!valid)
+			in_table = in_table & (D != D);
+
+		D = tr::select(in_table, D, tr::splat(float(min_D)));
+		const I bits = tr::toBits(D);
+		const I idx = (bits >> int(23-interval_bits)) - first_float_index;
+		const T t = tr::fromBits(((bits & float_t_mask) << int(interval_bits)) | float_one_bits) - 1.0f;
+
+		return ((tr::gather(cf[3], idx)*t + tr::gather(cf[2], idx))*t +
+		        tr::gather(cf[1], idx))*t + tr::gather(cf[0], idx);
+	}
+
+private:
+	ViscosityTable(const ViscosityTable&);
+	ViscosityTable& operator=(const ViscosityTable&);
+
+	double intervalStart(int i) const;
+
+	// table value, D must be within [min_D, max_D)
+	template<class T>
+	VMATH_INLINE T interpolate(T D) const
+	{
+		typedef vmath::Traits<T> tr;
+		typedef typename tr::Int I;
+
+		const I bits = tr::toBits(D);
+		const I idx = (bits >> int(52-interval_bits)) - first_index;
+		const T t = tr::fromBits(((bits & t_mask) << int(interval_bits)) | one_bits) - 1.0;
+
+		return ((tr::gather(c[3], idx)*t + tr::gather(c[2], idx))*t +
+		        tr::gather(c[1], idx))*t + tr::gather(c[0], idx);
+	}
+
+	static const long long t_mask = (1LL << (52-interval_bits)) - 1;
+	static const long long one_bits = 0x3FF0000000000000LL; // 1.0
+	static const int float_t_mask = (1 << (23-interval_bits)) - 1;
+	static const int float_one_bits = 0x3F800000; // 1.0f
+
+	std::vector<double> coeff;
+	const double *c[4];
+	long long first_index;
+	std::vector<float> float_coeff;
+	const float *cf[4];
+	int first_float_index;
+	double min_D, max_D;
+	double exact_min_D, exact_max_D; // excluded intervals
+
+	double table_hct, ln_1_hct;
+	double max_error;
+	bool built, valid;
+};
+
+#endif // VISCOSITY_H
@@ -18,10 +18,8 @@
  */
 
 #include "../common.h"
-#include <QtConcurrentRun>
-#include <QFuture>
 #include <QCoreApplication>
-#include <QFutureSynchronizer>
+#include <QCryptographicHash>
 #include <QFile>
 #include <QProgressDialog>
 #include <QSqlDatabase>
@@ -30,19 +28,22 @@
 #include <QString>
 #include <QStringList>
 #include <QVariant>
+#include <algorithm>
 #include <cmath>
+#include "anderson.h"
 #include "dbsettings.h"
 #include "integrationhelper/cpuhelper.h"
 #include "integrationhelper/openclhelper.h"
 #include "model.h"
+#include "morphometry.h"
+#include "solverpool.h"
+#include "vmath.h"
 #include <limits>
 
-#include <QSettings>
 #include <QTime>
 
 /* No accuracy benefit above 128. Speed is not compromised at 128 (on 16 core machine!) */
 const int nSums = 128; // number of divisions in the integral
-const QLatin1String vessel_ini_relative("data/vessel.ini");
 
 #if defined(Q_OS_WIN32) && !defined(__GNUC__)
 inline double cbrt(double x) {
@@ -94,25 +95,19 @@ bool operator==(const struct Capillary &a, const struct Capillary &b)
 
 // CONSTRUCTOR - always called - initializes everything
 Model::Model(Transducer transducer_pos, IntegralType int_type)
+        : art_store(numArteries()), vein_store(numVeins()),
+          cap_store(numCapillaries())
 {
 	n_iterations = 0;
 	vessel_value_override.resize(numArteries() + numVeins() + numCapillaries(), false);
 
-	arteries = (Vessel*)allocateCachelineAligned(sizeof(Vessel)*numArteries());
-	veins = (Vessel*)allocateCachelineAligned(sizeof(Vessel)*numVeins());
-	caps = (Capillary*)allocateCachelineAligned(sizeof(Capillary)*numCapillaries());
-
-	if (arteries == 0 || veins == 0 || caps == 0)
-		throw std::bad_alloc();
+	// new storage is zeroed and private
+	updateVesselPointers();
 
 	Krc_factor = calibrationValue(Krc);
+	ideal_BSA = BSA(calibrationValue(Pat_Ht_value), calibrationValue(Pat_Wt_value));
 	pat_gender = Male;
 
-	/* set to zero, mostly to prevent valgrind complaining */
-	memset(arteries, 0, numArteries()*sizeof(Vessel));
-	memset(veins, 0, numVeins()*sizeof(Vessel));
-	memset(caps, 0, numCapillaries()*sizeof(Capillary));
-
 	// Initial conditions
 	trans_pos = transducer_pos;
 	Tlrns = calibrationValue(Tlrns_value);
@@ -142,6 +137,30 @@ Model::Model(Transducer transducer_pos, IntegralType int_type)
 	CI = CO/BSAz();
 	integral_type = int_type;
 
+	storage_layout = DbSettings::value(settings_soa_storage, true).toBool() ?
+	                         StructureOfArrays : ArrayOfStructures;
+	soa_active = false;
+
+	solver_pool = 0;
+	solver_threads = DbSettings::value(settings_solver_threads, 0).toInt();
+	fused_sweep = DbSettings::value(settings_fused_sweep, true).toBool();
+	total_R_current = false;
+
+	outer_acceleration = DbSettings::value(settings_anderson_acceleration, false).toBool() ?
+	                             AndersonAcceleration : NoAcceleration;
+	anderson = 0;
+
+	solver_precision = static_cast<Precision>(DbSettings::value(settings_solver_precision,
+	                                                            DoublePrecision).toInt());
+
+	// heuristics that change converged results are opt-in
+	active_set = DbSettings::value(settings_active_set, false).toBool();
+	active_full_pass = true;
+	local_capillary_solve = DbSettings::value(settings_local_capillary_solve, false).toBool();
+	coarse_generations = DbSettings::value(settings_coarse_generations, 0).toInt();
+	coarse_level = 0;
+	cold_start = true;
+
 	// to have a default PAP value of 15
 	arteries[0].flow = CO;
 	arteries[0].total_R = (15.0-LAP)/arteries[0].flow;
@@ -157,23 +176,26 @@ Model::Model(Transducer transducer_pos, IntegralType int_type)
 }
 
 Model::Model(const Model &other)
+        : art_store(other.art_store), vein_store(other.vein_store),
+          cap_store(other.cap_store)
 {
-	arteries = (Vessel*)allocateCachelineAligned(sizeof(Vessel)*numArteries());
-	veins = (Vessel*)allocateCachelineAligned(sizeof(Vessel)*numVeins());
-	caps = (Capillary*)allocateCachelineAligned(sizeof(Capillary)*numCapillaries());
+	updateVesselPointers();
 
 	integral_type = other.integral_type;
+	soa_active = false;
+	solver_pool = 0;
+	total_R_current = false;
+	anderson = 0;
+	coarse_level = 0;
 	allocateIntegralType();
 	operator =(other);
 }
 
 Model::~Model()
 {
-	freeAligned(arteries);
-	freeAligned(veins);
-	freeAligned(caps);
-
 	delete integration_helper;
+	delete solver_pool;
+	delete anderson;
 }
 
 Model& Model::operator =(const Model &other)
@@ -208,6 +230,17 @@ Model& Model::operator =(const Model &other)
 	PV_diam = other.PV_diam;
 	cv_diam_ratio = other.cv_diam_ratio;
 
+	// solver arrays and threads are only valid during calc() and are never copied
+	storage_layout = other.storage_layout;
+	solver_threads = other.solver_threads;
+	fused_sweep = other.fused_sweep;
+	outer_acceleration = other.outer_acceleration;
+	solver_precision = other.solver_precision;
+	active_set = other.active_set;
+	local_capillary_solve = other.local_capillary_solve;
+	coarse_generations = other.coarse_generations;
+	cold_start = other.cold_start;
+
 	modified_flag = other.modified_flag;
 	model_reset = other.model_reset;
 	abort_calculation = other.abort_calculation;
@@ -221,11 +254,14 @@ Model& Model::operator =(const Model &other)
 	dis = other.dis;
 
 	Krc_factor = other.Krc_factor;
+	ideal_BSA = other.ideal_BSA;
 	n_iterations = other.n_iterations;
 
-	memcpy(arteries, other.arteries, numArteries()*sizeof(Vessel));
-	memcpy(veins, other.veins, numVeins()*sizeof(Vessel));
-	memcpy(caps, other.caps, numCapillaries()*sizeof(Capillary));
+	// shares the vessel blocks until either model writes them
+	art_store = other.art_store;
+	vein_store = other.vein_store;
+	cap_store = other.cap_store;
+	updateVesselPointers();
 
 	vessel_value_override = other.vessel_value_override;
 
@@ -255,6 +291,19 @@ Model* Model::clone() const
 	return new Model(*this);
 }
 
+qint64 Model::memoryFootprint() const
+{
+	qint64 bytes = static_cast<qint64>(numArteries() + numVeins())*sizeof(Vessel) +
+	               static_cast<qint64>(numCapillaries())*sizeof(Capillary);
+
+	if (storage_layout == StructureOfArrays)
+		bytes += VesselArrays::bufferBytes(numArteries()) +
+		         VesselArrays::bufferBytes(numVeins()) +
+		         CapillaryArrays::bufferBytes(numCapillaries());
+
+	return bytes;
+}
+
 void Model::setIntegralType(IntegralType t) {
 	integral_type = t;
 }
@@ -265,18 +314,7 @@ int Model::nVessels(Vessel::Type vessel_type,
 	/* As measured in Huang's paper - Morphometry of
 	 * Pulmonary Vasculature, Table 5
 	 */
-
-	static int artery_number[16], vein_number[16];
-
-	if (artery_number[0] == 0.0) {
-		/* Initialize values */
-		QSettings s(vessel_ini_relative, QSettings::IniFormat);
-		for (int i=1; i<=16; ++i) {
-			artery_number[i-1] = s.value("artery_number/gen_"+QString::number(i)).toInt();
-			vein_number[i-1] = s.value("vein_number/gen_"+QString::number(i)).toInt();
-		}
-	}
-
+	const MorphometryTable &t = Morphometry::table();
 
 	switch (vessel_type) {
 	case Vessel::Artery:
@@ -285,11 +323,11 @@ int Model::nVessels(Vessel::Type vessel_type,
 			gen_no = 16;
 		if (gen_no > 16)
 			break;
-		return artery_number[gen_no-1];
+		return t.artery_number[gen_no-1];
 	case Vessel::Vein:
 		if (gen_no > 16)
 			break;
-		return vein_number[gen_no-1];
+		return t.vein_number[gen_no-1];
 	}
 
 	return 0;
@@ -298,16 +336,7 @@ int Model::nVessels(Vessel::Type vessel_type,
 double Model::measuredDiameterRatio(Vessel::Type vessel_type,
                                     unsigned gen_no) const
 {
-	static double artery_ratios[16], vein_ratios[16];
-
-	if (artery_ratios[0] == 0.0) {
-		/* Initialize values */
-		QSettings s(vessel_ini_relative, QSettings::IniFormat);
-		for (int i=1; i<=16; ++i) {
-			artery_ratios[i-1] = s.value("artery_diameter_ratios/gen_"+QString::number(i)).toDouble();
-			vein_ratios[i-1] =  s.value("vein_diameter_ratios/gen_"+QString::number(i)).toDouble();
-		}
-	}
+	const MorphometryTable &t = Morphometry::table();
 
 	switch (vessel_type) {
 	case Vessel::Artery:
@@ -315,11 +344,11 @@ double Model::measuredDiameterRatio(Vessel::Type vessel_type,
 			return cv_diam_ratio;
 		if (gen_no > 16)
 			break;
-		return artery_ratios[gen_no-1];
+		return t.artery_diameter_ratio[gen_no-1];
 	case Vessel::Vein:
 		if (gen_no > 16)
 			break;
-		return vein_ratios[gen_no-1];
+		return t.vein_diameter_ratio[gen_no-1];
 	}
 
 	return 1;
@@ -331,17 +360,7 @@ double Model::measuredLengthRatio(Vessel::Type vessel_type,
 	/* Length ratios assume 2.5 cm main PA, 5cm left PA
 	 * same for the veins
 	 */
-	static double artery_ratios[16], vein_ratios[16];
-
-	if (artery_ratios[0] == 0.0) {
-		/* Initialize values */
-		QSettings s(vessel_ini_relative, QSettings::IniFormat);
-		for (int i=1; i<=16; ++i) {
-			artery_ratios[i-1]=s.value("artery_length_ratios/gen_"+QString::number(i)).toDouble();
-			vein_ratios[i-1]=s.value("vein_length_ratios/gen_"+QString::number(i)).toDouble();
-		}
-	}
-
+	const MorphometryTable &t = Morphometry::table();
 
 	switch (vessel_type) {
 	case Vessel::Artery:
@@ -349,11 +368,11 @@ double Model::measuredLengthRatio(Vessel::Type vessel_type,
 			gen_no = 16; // corner vessels, same as last gen vessels
 		if (gen_no > 16)
 			break;
-		return artery_ratios[gen_no-1];
+		return t.artery_length_ratio[gen_no-1];
 	case Vessel::Vein:
 		if (gen_no > 16)
 			break;
-		return vein_ratios[gen_no-1];
+		return t.vein_length_ratio[gen_no-1];
 	}
 
 	return 1;
@@ -361,8 +380,7 @@ double Model::measuredLengthRatio(Vessel::Type vessel_type,
 
 double Model::BSAz() const
 {
-	return BSA(calibrationValue(Model::Pat_Ht_value),
-	           calibrationValue(Model::Pat_Wt_value));
+	return ideal_BSA;
 }
 
 double Model::BSA(double pat_ht, double pat_wt)
@@ -394,7 +412,7 @@ const Vessel& Model::artery( int gen, int index ) const
 	if( gen <= 0 || index < 0 || gen > 17 || index >= nElements( gen ))
 		throw "Out of bounds";
 
-	return arteries[ index + startIndex( gen )];
+	return art_store.at(index + startIndex(gen));
 }
 
 const Vessel& Model::vein( int gen, int index ) const
@@ -402,7 +420,7 @@ const Vessel& Model::vein( int gen, int index ) const
 	if( gen <= 0 || index < 0 || gen > 16 || index >= nElements( gen ))
 		throw "Out of bounds";
 
-	return veins[ index + startIndex( gen )];
+	return vein_store.at(index + startIndex(gen));
 }
 
 const Capillary& Model::capillary( int index ) const
@@ -410,7 +428,7 @@ const Capillary& Model::capillary( int index ) const
 	if( index < 0 || index >= nElements( 16 ))
 		throw "Out of bounds";
 
-	return caps[ index ];
+	return cap_store.at(index);
 }
 
 void Model::setArtery(int gen, int index, const Vessel & v, bool override)
@@ -420,7 +438,8 @@ void Model::setArtery(int gen, int index, const Vessel & v, bool override)
 
 	const int idx = index + startIndex(gen);
 
-	arteries[idx] = v;
+	art_store.write(idx) = v;
+	updateVesselPointers();
 	vessel_value_override[idx] = vessel_value_override[idx] || override;
 	modified_flag = true;
 }
@@ -433,7 +452,8 @@ void Model::setVein(int gen, int index, const Vessel & v, bool override)
 	const int idx = index + startIndex(gen);
 	const int o_idx = numArteries() + idx;
 
-	veins[idx] = v;
+	vein_store.write(idx) = v;
+	updateVesselPointers();
 	vessel_value_override[o_idx] = vessel_value_override[o_idx] || override;
 	modified_flag = true;
 }
@@ -444,11 +464,13 @@ void Model::setCapillary(int index, const Capillary & c, bool override)
 		throw "Out of bounds";
 
 	const int c_idx = index + numArteries() + numVeins();
-	caps[ index ] = c;
+	Capillary &cap = cap_store.write(index);
+	updateVesselPointers();
 
-	caps[index].F = 1.0 + 25*caps[index].Alpha;
-	caps[index].F3 = caps[index].F*caps[index].F*caps[index].F;
-	caps[index].F4 = caps[index].F*caps[index].F*caps[index].F*caps[index].F;
+	cap = c;
+	cap.F = 1.0 + 25*cap.Alpha;
+	cap.F3 = cap.F*cap.F*cap.F;
+	cap.F4 = cap.F*cap.F*cap.F*cap.F;
 
 	vessel_value_override[c_idx] = vessel_value_override[c_idx] || override;
 	modified_flag = true;
@@ -476,13 +498,13 @@ double Model::getResult(DataType type) const
 		if (!validInputs())
 			return std::numeric_limits<double>::quiet_NaN();
 
-		return LAP + arteries[0].flow * arteries[0].total_R;
+		return LAP + art_store.at(0).flow * art_store.at(0).total_R;
 	case Rus_value:
-		return arteries[0].partial_R;
+		return art_store.at(0).partial_R;
 	case Rds_value:
-		return veins[0].partial_R;
+		return vein_store.at(0).partial_R;
 	case Rm_value:
-		return veins[0].total_R - arteries[0].partial_R - veins[0].partial_R;
+		return vein_store.at(0).total_R - art_store.at(0).partial_R - vein_store.at(0).partial_R;
 	case Rt_value:
 		return (getResult(PAP_value) - LAP) / CO;
 	case Tlrns_value:
@@ -494,7 +516,7 @@ double Model::getResult(DataType type) const
 	case Pat_Wt_value:
 		return PatWt;
 	case TotalR_value:
-		return arteries[0].total_R;
+		return art_store.at(0).total_R;
 	case DiseaseParam:
 		break;
 
@@ -788,9 +810,7 @@ bool Model::setData(DataType type, double val)
 			PatWt = idealWeight(pat_gender, val);
 			PatHt = val;
 
-			double idealBSA = BSA(calibrationValue(Model::Pat_Ht_value),
-			                      calibrationValue(Model::Pat_Wt_value));
-			double baseline_ratio = 4.85 + 13.43*sqrt(idealBSA);
+			double baseline_ratio = 4.85 + 13.43*sqrt(BSAz());
 			double new_ratio = 4.85 + 13.43*sqrt(BSA(PatHt, PatWt));
 
 			PA_diam = calibrationValue(Model::PA_Diam_value)*new_ratio/baseline_ratio;
@@ -805,9 +825,7 @@ bool Model::setData(DataType type, double val)
 		if (significantChange(PatWt, val)) {
 			PatWt = val;
 
-			double idealBSA = BSA(calibrationValue(Model::Pat_Ht_value),
-			                      calibrationValue(Model::Pat_Wt_value));
-			double baseline_ratio = 4.85 + 13.43*sqrt(idealBSA);
+			double baseline_ratio = 4.85 + 13.43*sqrt(BSAz());
 			double new_ratio = 4.85 + 13.43*sqrt(BSA(PatHt, PatWt));
 
 			PA_diam = calibrationValue(Model::PA_Diam_value)*new_ratio/baseline_ratio;
@@ -868,53 +886,88 @@ int Model::calc( int max_iter )
 	abort_calculation = 0;
 	prog = 0;
 	n_iterations = 0;
+	solver_stats = SolverPool::Statistics();
 
 	if (!validInputs())
 		return 0;
 
+	materializeVessels();
+
 	if (model_reset) {
 		getParameters();
 		for (DiseaseList::iterator i=dis.begin(); i!=dis.end(); ++i)
 			i->processModel(*this);
 
-		for (int i=0; i<numArteries(); ++i)
-			arteries[i].pressure_0 = calculatePressure0(arteries[i]);
-		for (int i=0; i<numVeins(); ++i)
-			veins[i].pressure_0 = calculatePressure0(veins[i]);
-
+		integration_helper->pressure0();
 		model_reset = false;
 	}
 
+	integration_helper->beginCalculation();
+	beginSolverArrays();
+	solverPool().resetStatistics();
+	total_R_current = false;
+	active_full_pass = true;
+
+	// a previous solution is a better start than the coarse one
+	int coarse_iterations = 0;
+	if (cold_start && coarse_generations > 0 && coarse_generations < nGenerations() &&
+	    integration_helper->supportsActiveSet())
+		coarse_iterations = coarseCalc(max_iter);
+
+	if (outer_acceleration == AndersonAcceleration)
+		anderson = new AndersonMixer;
+
 	/* It is possible that the last capillary that is opened results in all
 	 * capilaries to be closed. To remedy this situation, we allow for the
 	 * final opened capillary to be re-closed once more
 	 */
-	QThreadPool *thread_pool = QThreadPool::globalInstance();
-	int ideal_thread_count = thread_pool->maxThreadCount();
-	if (ideal_thread_count<=1) {
-		thread_pool->reserveThread();
-		thread_pool->reserveThread();
-		thread_pool->reserveThread();
-		thread_pool->reserveThread();
-		ideal_thread_count=4;
-	}
 
 	do {
 		qDebug() << "---- Iteration: " << n_iterations << " -> " << n_iterations;
-		qDebug() << "PAPm: " << getResult(Model::PAP_value);
+		qDebug() << "PAPm: " << (soa_active ?
+		                                 LAP + art_arrays.flow[0]*art_arrays.total_R[0] :
+		                                 getResult(Model::PAP_value));
 
-		totalResistance(0, ideal_thread_count);
-		vascPress(ideal_thread_count);
+		if (!total_R_current)
+			totalResistance();
+		vascPress();
 
 		int iter_prog = 10000*n_iterations/max_iter;
 		if (prog < iter_prog)
 			prog = iter_prog;
 
 		n_iterations++;
-	} while (!deltaR(ideal_thread_count) &&
+	} while (!deltaR() &&
 	         (n_iterations < max_iter) &&
 	         abort_calculation==0);
 
+	// reported iterations include the coarse solve
+	n_iterations += coarse_iterations;
+
+	/* After a fused sweep total_R is already from the final resistances,
+	 * so update flows and pressures to match, as getResult() calculates
+	 * PAP from total_R.
+	 */
+	if (total_R_current) {
+		vascPress();
+		total_R_current = false;
+	}
+
+	if (anderson) {
+		qDebug() << "Anderson acceleration:" << anderson->steps() << "steps,"
+		         << anderson->restarts() << "restarts";
+		delete anderson;
+		anderson = 0;
+		anderson_x.clear();
+		anderson_g.clear();
+	}
+
+	integration_helper->endCalculation();
+	endSolverArrays();
+	solver_stats = solverPool().statistics();
+	releaseSolverPool();
+	cold_start = false;
+
 	partialR(Vessel::Artery, 0);
 	partialR(Vessel::Vein, 0);
 
@@ -922,6 +975,177 @@ int Model::calc( int max_iter )
 	return n_iterations;
 }
 
+static inline double extrapolateR(double R1, double R0, double step_ratio)
+{
+	// only moderate changes, and never from or to closed vessels
+	const double d = step_ratio * (std::log(R1) - std::log(R0));
+	if (!(std::fabs(d) <= M_LN2))
+		return R1;
+
+	return R1 * std::exp(d);
+}
+
+void Model::warmStart(const Model &previous, const Model *before, double step_ratio)
+{
+	const int n_art = numArteries();
+	const int n_vein = numVeins();
+	const int n_cap = numCapillaries();
+
+	materializeVessels();
+
+	for (int i=0; i<n_art; ++i) {
+		Vessel &v = arteries[i];
+		const Vessel &p = previous.art_store.at(i);
+		v.R = before ? extrapolateR(p.R, before->art_store.at(i).R, step_ratio) : p.R;
+		v.total_R = p.total_R;
+		v.flow = p.flow;
+		v.pressure_in = p.pressure_in;
+		v.pressure_out = p.pressure_out;
+	}
+
+	for (int i=0; i<n_vein; ++i) {
+		Vessel &v = veins[i];
+		const Vessel &p = previous.vein_store.at(i);
+		v.R = before ? extrapolateR(p.R, before->vein_store.at(i).R, step_ratio) : p.R;
+		v.total_R = p.total_R;
+		v.flow = p.flow;
+		v.pressure_in = p.pressure_in;
+		v.pressure_out = p.pressure_out;
+	}
+
+	for (int i=0; i<n_cap; ++i) {
+		Capillary &c = caps[i];
+		const Capillary &p = previous.cap_store.at(i);
+		c.R = before ? extrapolateR(p.R, before->cap_store.at(i).R, step_ratio) : p.R;
+		c.flow = p.flow;
+		c.pressure_in = p.pressure_in;
+		c.pressure_out = p.pressure_out;
+	}
+
+	cold_start = false;
+}
+
+QByteArray Model::resistanceState() const
+{
+	const int n_art = numArteries();
+	const int n_vein = numVeins();
+	const int n_cap = numCapillaries();
+
+	std::vector<double> R;
+	R.reserve(n_art + n_vein + n_cap);
+	for (int i=0; i<n_art; ++i)
+		R.push_back(art_store.at(i).R);
+	for (int i=0; i<n_vein; ++i)
+		R.push_back(vein_store.at(i).R);
+	for (int i=0; i<n_cap; ++i)
+		R.push_back(cap_store.at(i).R);
+
+	return qCompress(QByteArray::fromRawData(reinterpret_cast<const char*>(&R[0]),
+	                                         R.size()*sizeof(double)));
+}
+
+bool Model::restoreResistanceState(const QByteArray &state)
+{
+	const int n_art = numArteries();
+	const int n_vein = numVeins();
+	const int n_cap = numCapillaries();
+
+	const QByteArray data = qUncompress(state);
+	if (data.size() != static_cast<int>((n_art + n_vein + n_cap)*sizeof(double)))
+		return false;
+
+	materializeVessels();
+
+	const double *R = reinterpret_cast<const double*>(data.constData());
+	for (int i=0; i<n_art; ++i)
+		arteries[i].R = *R++;
+	for (int i=0; i<n_vein; ++i)
+		veins[i].R = *R++;
+	for (int i=0; i<n_cap; ++i)
+		caps[i].R = *R++;
+
+	cold_start = false;
+	return true;
+}
+
+template<class T>
+static void addHashData(QCryptographicHash &hash, const T &value)
+{
+	hash.addData(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// fields calc() depends on, not its results or starting resistances
+static void addVesselInputs(QCryptographicHash &hash, const Vessel &v)
+{
+	const double inputs[] = {
+		v.D, v.length, v.length_factor, v.gamma, v.phi, v.c, v.tone,
+		v.GP, v.GPz, v.Ppl, v.Ptp,
+		v.perivascular_press_a, v.perivascular_press_b,
+		v.perivascular_press_c, v.perivascular_press_d,
+		v.vessel_ratio
+	};
+	addHashData(hash, inputs);
+}
+
+static void addCapillaryInputs(QCryptographicHash &hash, const Capillary &c)
+{
+	const double inputs[] = {
+		c.Ho, c.Alpha, c.F, c.F3, c.F4, c.Krc
+	};
+	addHashData(hash, inputs);
+	addHashData(hash, c.open_state);
+}
+
+QByteArray Model::inputHash() const
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+
+	// as getKrc()
+	const double krc = Krc_factor != 0.0 ? Krc_factor : calibrationValue(Krc);
+	const double inputs[] = {
+		Tlrns, Pal, Ppl, CO, CI, LAP,
+		LungHt[0], LungHt[1], Vm[0], Vm[1], Vc[0], Vc[1],
+		Vd[0], Vd[1], Vtlc[0], Vtlc[1],
+		PatWt, PatHt, Hct, PA_EVL, PA_diam, PV_EVL, PV_diam,
+		BSA_ratio, krc, cv_diam_ratio, ideal_BSA
+	};
+	addHashData(hash, inputs);
+
+	const int options[] = {
+		nGenerations(), trans_pos, pat_gender, integral_type,
+		fused_sweep, outer_acceleration, solver_precision, active_set,
+		local_capillary_solve, coarse_generations
+	};
+	addHashData(hash, options);
+
+	// calibration values reach calc() through the inputs above
+	addHashData(hash, Morphometry::table());
+
+	for (DiseaseList::const_iterator i=dis.begin(); i!=dis.end(); ++i) {
+		hash.addData(i->script().toUtf8());
+		for (int n=0; n<i->paramCount(); ++n)
+			addHashData(hash, i->parameterValue(n));
+	}
+
+	QByteArray overrides(vessel_value_override.size(), '0');
+	for (unsigned i=0; i<vessel_value_override.size(); ++i)
+		if (vessel_value_override[i])
+			overrides[i] = '1';
+	hash.addData(overrides);
+
+	const int n_art = numArteries();
+	const int n_vein = numVeins();
+	const int n_cap = numCapillaries();
+	for (int i=0; i<n_art; ++i)
+		addVesselInputs(hash, art_store.at(i));
+	for (int i=0; i<n_vein; ++i)
+		addVesselInputs(hash, vein_store.at(i));
+	for (int i=0; i<n_cap; ++i)
+		addCapillaryInputs(hash, cap_store.at(i));
+
+	return hash.result();
+}
+
 int Model::calculationErrors() const
 {
 	return integration_helper->hasErrors();
@@ -1124,7 +1348,7 @@ double Model::calculatePressure0(const Vessel &v)
 	double diff;
 	do {
 		double alpha = Pv - v.perivascular_press_c - v.Ppl;
-		double ex = std::exp(-alpha/v.perivascular_press_d);
+		double ex = vmath::exp(-alpha/v.perivascular_press_d);
 
 		double fx = alpha - v.perivascular_press_a + v.perivascular_press_c -
 		            v.perivascular_press_b / (1.0 + ex);
@@ -1145,12 +1369,22 @@ void Model::getParameters()
 	 *
 	 * Adjust length basedon Ptp
 	 */
-	int n = numArteries();
-	for (int i=0; i<n; i++) {
+	SolverMemberTask<Model, int> task(this, &Model::parameterRange, nOutsideElements());
+	solverPool().run(task, 0, numArteries(), 2048);
+}
+
+void Model::parameterRange(int worker, int first_inside, int begin, int end)
+{
+	Q_UNUSED(worker);
+
+	// corner vessels are arteries only
+	const int vein_end = std::min(end, numVeins());
+
+	for (int i=begin; i<end; i++) {
 		Vessel &art = arteries[i];
 
 		art.perivascular_press_d = 15.6068;
-		if (isOutsideLung(i)) {
+		if (i < first_inside) {
 			art.perivascular_press_a = 0.0;
 			art.perivascular_press_b = 0.0;
 			art.perivascular_press_c = 0.0;
@@ -1165,12 +1399,11 @@ void Model::getParameters()
 		art.length *= art.length_factor;
 	}
 
-	n = numVeins();
-	for (int i=0; i<n; i++) {
+	for (int i=begin; i<vein_end; i++) {
 		Vessel &vein = veins[i];
 
 		vein.perivascular_press_d = 16.02287;
-		if (isOutsideLung(i)) {
+		if (i < first_inside) {
 			vein.perivascular_press_a = 0.0;
 			vein.perivascular_press_b = 0.0;
 			vein.perivascular_press_c = 0.0;
@@ -1186,8 +1419,472 @@ void Model::getParameters()
 	}
 }
 
-void Model::vascPress(int ideal_threads)
+void Model::materializeVessels()
 {
+	arteries = art_store.materialize();
+	veins = vein_store.materialize();
+	caps = cap_store.materialize();
+}
+
+void Model::updateVesselPointers()
+{
+	arteries = art_store.data();
+	veins = vein_store.data();
+	caps = cap_store.data();
+}
+
+bool Model::beginSolverArrays()
+{
+	soa_active = false;
+
+	if (storage_layout != StructureOfArrays ||
+	    !integration_helper->supportsStructureOfArrays())
+		return false;
+
+	if (!art_arrays.allocate(numArteries()) ||
+	    !vein_arrays.allocate(numVeins()) ||
+	    !cap_arrays.allocate(numCapillaries())) {
+		// not fatal, just use the vessel structures directly
+		qDebug() << "Cannot allocate solver arrays. Using AoS storage.";
+		art_arrays.release();
+		vein_arrays.release();
+		cap_arrays.release();
+		return false;
+	}
+
+	art_arrays.scatter(arteries, numArteries());
+	vein_arrays.scatter(veins, numVeins());
+	cap_arrays.scatter(caps, numCapillaries());
+
+	soa_active = true;
+	return true;
+}
+
+SolverPool& Model::solverPool()
+{
+	if (solver_pool == 0)
+		solver_pool = new SolverPool(solver_threads);
+
+	return *solver_pool;
+}
+
+bool Model::beginSetupPool()
+{
+	const bool transient = (solver_pool == 0);
+	solverPool();
+	return transient;
+}
+
+void Model::endSetupPool(bool transient)
+{
+	if (!transient)
+		return;
+
+	// setup phases are not part of the calculation statistics
+	solver_pool->resetStatistics();
+	releaseSolverPool();
+}
+
+void Model::releaseSolverPool()
+{
+	if (solver_pool == 0)
+		return;
+
+	const SolverPool::Statistics &stats = solver_pool->statistics();
+	if (stats.run_ns > 0)
+		qDebug() << "Solver pool:" << solver_pool->threadCount() << "threads,"
+		         << stats.phases << "phases, dispatch overhead"
+		         << stats.dispatch_ns/1e6 << "ms of" << stats.run_ns/1e6 << "ms"
+		         << "(" << 100.0*stats.dispatch_ns/stats.run_ns << "% )";
+
+	delete solver_pool;
+	solver_pool = 0;
+}
+
+void Model::endSolverArrays()
+{
+	if (!soa_active)
+		return;
+
+	art_arrays.gather(arteries, numArteries());
+	vein_arrays.gather(veins, numVeins());
+	cap_arrays.gather(caps, numCapillaries());
+
+	art_arrays.release();
+	vein_arrays.release();
+	cap_arrays.release();
+
+	soa_active = false;
+}
+
+namespace {
+
+/* Level-synchronous passes over the vessel tree, for either storage layout.
+ * Vessel i has children 2i+1 and 2i+2, so each generation is a contiguous
+ * index range and the functions work on [begin, end) of a single
+ * generation. Ranges of the same generation can be processed concurrently.
+ */
+template<class Vessels, class Capillaries>
+struct TreePasses
+{
+	typedef typename Vessels::reference VesselRef;
+	typedef typename Capillaries::reference CapillaryRef;
+
+	TreePasses(Vessels art, Vessels vein, Capillaries cap,
+	           int leaf_start, int corner_start, double Pal)
+	        : a(art), v(vein), c(cap),
+	          leaf_start(leaf_start), cv_start(corner_start), Pal(Pal) {}
+
+	// total_R from the children, or the capillary and corner vessel for
+	// the final generation
+	void totalResistance(int begin, int end) const
+	{
+		if (begin >= leaf_start) {
+			for (int i=begin; i<end; ++i) {
+				const int c_idx = i - leaf_start;
+				VesselRef ai = a[i];
+				VesselRef vi = v[i];
+				const double R = ai.R +
+				                 1.0 / (1.0/c[c_idx].R + 1.0/a[c_idx+cv_start].R) +
+				                 vi.R;
+				ai.total_R = R;
+				vi.total_R = R;
+			}
+			return;
+		}
+
+		for (int i=begin; i<end; ++i) {
+			VesselRef ai = a[i];
+			VesselRef vi = v[i];
+			const double R1 = a[2*i+1].total_R;
+			const double R2 = a[2*i+2].total_R;
+			double R_tot;
+
+			if (isinf(R1) && isinf(R2))
+				R_tot = std::numeric_limits<double>::infinity();
+			else if(isinf(R1))
+				R_tot = ai.R + R2 + vi.R;
+			else if(isinf(R2))
+				R_tot = ai.R + R1 + vi.R;
+			else
+				R_tot = ai.R + 1/(1/R1 + 1/R2) + vi.R;
+
+			ai.total_R = R_tot;
+			vi.total_R = R_tot;
+		}
+	}
+
+	/* Flow and pressure of the children from the parent vessels, or of
+	 * the capillary and corner vessel for the final generation
+	 */
+	void flowPress(int begin, int end) const
+	{
+		if (begin >= leaf_start) {
+			for (int i=begin; i<end; ++i)
+				leafFlowPress(i);
+			return;
+		}
+
+		for (int i=begin; i<end; ++i) {
+			childFlowPress(i, 2*i+1);
+			childFlowPress(i, 2*i+2);
+		}
+	}
+
+	// 'backward' pressure for static flow vessels since a block
+	void blockedPressBackward(int begin, int end) const
+	{
+		for (int i=begin; i<end; ++i) {
+			VesselRef ai = a[i];
+			VesselRef vi = v[i];
+
+			if (ai.flow != 0.0 && vi.flow != 0.0)
+				continue;
+
+			for (int con=2*i+1; con<=2*i+2; ++con) {
+				if (ai.flow == 0.0 && isnan(ai.pressure_out)) {
+					ai.pressure_out = a[con].pressure_in +
+					                  (a[con].GP - ai.GP)/cmH2O_per_mmHg;
+					if (!isinf(ai.R))
+						ai.pressure_in = ai.pressure_out;
+				}
+
+				if (vi.flow == 0.0 && isnan(vi.pressure_in)) {
+					vi.pressure_in = v[con].pressure_out +
+					                 (v[con].GP - vi.GP)/cmH2O_per_mmHg;
+					if (!isinf(vi.R))
+						vi.pressure_out = vi.pressure_in;
+				}
+			}
+		}
+	}
+
+	/* Forward static pressure towards a blockage, after the backward pass.
+	 * This is only encountered in multiple blockages scenario. Branches
+	 * that receive a pressure are recalculated, one generation at a time.
+	 */
+	void blockedPressForward(int begin, int end) const
+	{
+		for (int i=begin; i<end; ++i) {
+			VesselRef ai = a[i];
+			VesselRef vi = v[i];
+
+			if (ai.flow != 0.0 && vi.flow != 0.0)
+				continue;
+
+			for (int con=2*i+1; con<=2*i+2; ++con) {
+				VesselRef ac = a[con];
+				VesselRef vc = v[con];
+				bool redo_branch = false;
+
+				if (ai.flow == 0.0 &&
+				    !isnan(ai.pressure_out) &&
+				    isnan(ac.pressure_in)) {
+
+					ac.pressure_in = ai.pressure_out -
+					                 (ac.GP - ai.GP)/cmH2O_per_mmHg;
+					if (!isinf(ac.R)) {
+						ac.pressure_out = ac.pressure_in;
+						redo_branch = true;
+					}
+				}
+
+				if (vi.flow == 0.0 &&
+				    !isnan(vi.pressure_in) &&
+				    isnan(vc.pressure_out)) {
+
+					vc.pressure_out = vi.pressure_in -
+					                  (vc.GP - vi.GP)/cmH2O_per_mmHg;
+					if (!isinf(vc.R)) {
+						vc.pressure_in = vc.pressure_out;
+						redo_branch = true;
+					}
+				}
+
+				if (redo_branch)
+					recalculateBranch(con);
+			}
+		}
+	}
+
+	/* Flow and pressures within the subtrees of vessels [begin, end) from
+	 * their inlet and outlet pressures, which are held fixed. Same passes
+	 * as vascPress(), restricted to each subtree.
+	 */
+	void subtreeFlowPress(int begin, int end) const
+	{
+		for (int i=begin; i<end; ++i)
+			subtreeFlowPress(i);
+	}
+
+	void subtreeFlowPress(int root) const
+	{
+		vesselFlowPress(root);
+		recalculateBranch(root);
+
+		int begin = root, end = root+1;
+		while (begin < leaf_start) {
+			blockedPressForward(begin, end);
+			begin = 2*begin+1;
+			end = 2*end+1;
+		}
+	}
+
+private:
+	void childFlowPress(int i, int con) const
+	{
+		VesselRef ai = a[i];
+		VesselRef vi = v[i];
+		VesselRef ac = a[con];
+		VesselRef vc = v[con];
+
+		ac.pressure_in = ai.pressure_out - (ac.GP - ai.GP)/cmH2O_per_mmHg;
+		vc.pressure_out = vi.pressure_in - (vc.GP - vi.GP)/cmH2O_per_mmHg;
+
+		vesselFlowPress(con);
+	}
+
+	/* Flow of artery and vein con, and their remaining pressures, from
+	 * ac.pressure_in and vc.pressure_out
+	 */
+	void vesselFlowPress(int con) const
+	{
+		VesselRef ac = a[con];
+		VesselRef vc = v[con];
+
+		if (isinf(ac.total_R)) {
+			// all vessels inside have no flow, pressure is only defined
+			// until block. Later, it is undefined.
+			ac.flow = 0.0;
+			vc.flow = 0.0;
+
+			ac.pressure_out = isinf(ac.R) ?
+			                          std::numeric_limits<double>::quiet_NaN() :
+			                          ac.pressure_in;
+			vc.pressure_in = isinf(vc.R) ?
+			                         std::numeric_limits<double>::quiet_NaN() :
+			                         vc.pressure_out;
+		}
+		else {
+			double flow = (ac.pressure_in - vc.pressure_out) / ac.total_R;
+			if (flow < 0.0 || isnan(flow))
+				flow = 0.0;
+
+			vc.flow = flow;
+			ac.flow = flow;
+
+			ac.pressure_out = ac.pressure_in - ac.flow * ac.R;
+			vc.pressure_in = vc.pressure_out + vc.flow * vc.R;
+		}
+	}
+
+	void leafFlowPress(int i) const
+	{
+		const int c_idx = i - leaf_start;
+		VesselRef ai = a[i];
+		VesselRef vi = v[i];
+		VesselRef cv = a[c_idx + cv_start];
+		CapillaryRef cap = c[c_idx];
+
+		cap.flow = ai.flow*cv.R/(cv.R + cap.R);
+		cv.flow = ai.flow - cap.flow;
+
+		if (Q_UNLIKELY(isnan(cap.flow) || isnan(cv.flow))) {
+			cap.flow = 0.0;
+			cv.flow = 0.0;
+		}
+
+		cv.pressure_out = vi.pressure_in;
+		cv.pressure_in = ai.pressure_out;
+
+		cap.pressure_in = cmH2O_per_mmHg*ai.pressure_out - Pal;
+		cap.pressure_out = cmH2O_per_mmHg*vi.pressure_in - Pal;
+	}
+
+	/* Recalculates the branch below vessel i, whose pressures changed.
+	 * Forward passes top-down, then backward pass bottom-up. Forward
+	 * static pressure within the branch is handled by the caller's pass
+	 * of the following generations.
+	 */
+	void recalculateBranch(int i) const
+	{
+		int begin = i, end = i+1;
+		while (begin < leaf_start) {
+			flowPress(begin, end);
+			begin = 2*begin+1;
+			end = 2*end+1;
+		}
+		flowPress(begin, end);
+
+		while (begin > i) {
+			begin = (begin-1)/2;
+			end = (end-1)/2;
+			blockedPressBackward(begin, end);
+		}
+	}
+
+	Vessels a, v;
+	Capillaries c;
+	const int leaf_start, cv_start;
+	const double Pal;
+};
+
+typedef TreePasses<VesselPointer, CapillaryPointer> AoSTreePasses;
+typedef TreePasses<VesselArraysPointer, CapillaryArraysPointer> SoATreePasses;
+
+template<class Passes>
+void runTreePass(const Passes &p, Model::TreePass pass, int begin, int end)
+{
+	switch (pass) {
+	case Model::TotalResistancePass:
+		p.totalResistance(begin, end);
+		break;
+	case Model::FlowPressPass:
+		p.flowPress(begin, end);
+		break;
+	case Model::BlockedPressBackwardPass:
+		p.blockedPressBackward(begin, end);
+		break;
+	case Model::BlockedPressForwardPass:
+		p.blockedPressForward(begin, end);
+		break;
+	case Model::SubtreeFlowPressPass:
+		p.subtreeFlowPress(begin, end);
+		break;
+	}
+}
+
+/* Copies the integration results of the first element of each group of
+ * group_size elements in [begin, end) to the rest of the group. Closed
+ * vessels keep their own results.
+ */
+template<class Vessels>
+void prolongateVessels(const Vessels &vessels, int begin, int end, int group_size)
+{
+	for (int first=begin; first<end; first+=group_size) {
+		typename Vessels::reference r = vessels[first];
+		if (r.D < 0.1)
+			continue;
+
+		for (int i=first+1; i<first+group_size; ++i) {
+			typename Vessels::reference v = vessels[i];
+			if (v.D < 0.1)
+				continue;
+
+			v.R = r.R;
+			v.last_delta_R = r.last_delta_R;
+			v.D_calc = r.D_calc;
+			v.Dmin = r.Dmin;
+			v.Dmax = r.Dmax;
+			v.volume = r.volume;
+			v.viscosity_factor = r.viscosity_factor;
+		}
+	}
+}
+
+// as prolongateVessels(), for capillaries
+template<class Capillaries>
+void prolongateCapillaries(const Capillaries &caps, int n, int group_size)
+{
+	for (int first=0; first<n; first+=group_size) {
+		typename Capillaries::reference r = caps[first];
+		if (r.open_state == Capillary_Closed)
+			continue;
+
+		for (int i=first+1; i<first+group_size; ++i) {
+			typename Capillaries::reference c = caps[i];
+			if (c.open_state == Capillary_Closed)
+				continue;
+
+			c.R = r.R;
+			c.last_delta_R = r.last_delta_R;
+			c.Hin = r.Hin;
+			c.Hout = r.Hout;
+		}
+	}
+}
+
+}
+
+void Model::vascPress()
+{
+	if (soa_active) {
+		VesselArrays &a = art_arrays;
+		VesselArrays &v = vein_arrays;
+
+		v.flow[0] = CO;
+		a.flow[0] = CO;
+
+		double PAP = LAP + a.flow[0] * a.total_R[0];
+		a.pressure_in[0] = PAP;
+		a.pressure_out[0] = PAP - a.flow[0] * a.R[0];
+		v.pressure_in[0] = LAP + v.flow[0] * v.R[0];
+		v.pressure_out[0] = LAP;
+
+		calculateChildrenFlowPress();
+		return;
+	}
+
 	// Calculate Flow (Q) and then Pressure (P) for each resistance
 	veins[0].flow = CO;
 	arteries[0].flow = CO;
@@ -1198,62 +1895,130 @@ void Model::vascPress(int ideal_threads)
 	veins[0].pressure_in = LAP + veins[0].flow * veins[0].R;
 	veins[0].pressure_out = LAP;
 
-	calculateChildrenFlowPress(0, ideal_threads);
+	calculateChildrenFlowPress();
 }
 
-double Model::totalResistance(int i, int ideal_threads)
+void Model::treePass(TreePass pass, int gen)
 {
-	// get current generation and determine if this is final generation
-	int gen = gen_no( i );
-	if( gen == nGenerations()){
-		int c_idx = i - startIndex(gen);
-		int cv_idx = c_idx + startIndex(17);
-		double R = arteries[i].R +
-		           1.0 / (1.0/caps[c_idx].R + 1.0/arteries[cv_idx].R) +
-		           veins[i].R;
-		arteries[i].total_R = R;
-		veins[i].total_R = R;
+	SolverMemberTask<Model, TreePass> task(this, &Model::treePassRange, pass);
+	solverPool().run(task, startIndex(gen), startIndex(gen)+nElements(gen), 2048);
+}
 
-		return R;
-	}
+void Model::treePassRange(int worker, TreePass pass, int begin, int end)
+{
+	Q_UNUSED(worker);
 
-	// not the final generation, determine connection indexes
-	int current_gen_start = startIndex( gen );
-	int next_gen_start = startIndex( gen+1 );
+	const int leaf_start = startIndex(nGenerations());
+	const int cv_start = startIndex(nGenerations()+1);
 
-	int connection_first = (i - current_gen_start) * 2 + next_gen_start;
+	if (soa_active)
+		runTreePass(SoATreePasses(art_arrays, vein_arrays, cap_arrays,
+		                          leaf_start, cv_start, Pal),
+		            pass, begin, end);
+	else
+		runTreePass(AoSTreePasses(arteries, veins, caps,
+		                          leaf_start, cv_start, Pal),
+		            pass, begin, end);
+}
+
+int Model::coarseCalc(int max_iter)
+{
+	int n = 0;
+
+	coarse_level = coarse_generations;
+	selectCoarseElements(coarse_level);
+
+	do {
+		totalResistance();
+		vascPress();
+		n++;
+	} while (!deltaR() &&
+	         (n < max_iter) &&
+	         abort_calculation==0);
+
+	integration_helper->selectElements(0, 0, 0);
+	coarse_level = 0;
+	total_R_current = false;
 
-	// Add the connecting resistances in parallel
-	double R1, R2;
-	if (ideal_threads > 1) {
-		QFuture<double> r1 = QtConcurrent::run(this, &Model::totalResistance,
-		                                       connection_first, ideal_threads/2);
-		QFuture<double> r2 = QtConcurrent::run(this, &Model::totalResistance,
-		                                       connection_first+1, ideal_threads/2);
+	qDebug() << "Coarse solve:" << n << "iterations with"
+	         << coarse_generations << "generations";
+	return n;
+}
+
+void Model::selectCoarseElements(int level)
+{
+	const int n_gen = nGenerations();
+	std::vector<int> art, vein, cap;
+
+	// arteries of generation n_gen+1 are the corner vessels
+	for (int gen=1; gen<=n_gen+1; ++gen) {
+		const int start = startIndex(gen);
+		const int n = nElements(std::min(gen, n_gen));
+		const int group_size = 1 << std::max(0, std::min(gen, n_gen)-level);
+
+		for (int k=0; k<n; ++k) {
+			const int i = start + k;
+			const bool first = k % group_size == 0;
+			const double art_D = soa_active ? art_arrays.D[i] : arteries[i].D;
+
+			if (first || art_D < 0.1)
+				art.push_back(i);
+
+			if (gen > n_gen)
+				continue;
 
-		R1 = r1.result();
-		R2 = r2.result();
+			const double vein_D = soa_active ? vein_arrays.D[i] : veins[i].D;
+			if (first || vein_D < 0.1)
+				vein.push_back(i);
+		}
 	}
-	else {
-		R1 = totalResistance(connection_first, ideal_threads/2);
-		R2 = totalResistance(connection_first+1, ideal_threads/2);
+
+	const int cap_group_size = 1 << std::max(0, n_gen-level);
+	for (int i=0; i<numCapillaries(); ++i) {
+		const int state = soa_active ? cap_arrays.open_state[i] : caps[i].open_state;
+		if (i % cap_group_size == 0 || state == Capillary_Closed)
+			cap.push_back(i);
 	}
 
-	double R_tot;
+	integration_helper->selectElements(&art, &vein, &cap);
+}
 
-	if (isinf(R1) && isinf(R2))
-		R_tot = std::numeric_limits<double>::infinity();
-	else if(isinf(R1))
-		R_tot = arteries[i].R + R2 + veins[i].R;
-	else if(isinf(R2))
-		R_tot = arteries[i].R + R1 + veins[i].R;
-	else
-		R_tot = arteries[i].R + 1/(1/R1 + 1/R2) + veins[i].R;
+void Model::prolongateCoarse(bool vessels, bool capillaries)
+{
+	const int n_gen = nGenerations();
 
-	arteries[i].total_R = R_tot;
-	veins[i].total_R = R_tot;
+	for (int gen=coarse_level+1; vessels && gen<=n_gen+1; ++gen) {
+		const int begin = startIndex(gen);
+		const int end = begin + nElements(std::min(gen, n_gen));
+		const int group_size = 1 << (std::min(gen, n_gen)-coarse_level);
 
-	return R_tot;
+		if (soa_active) {
+			prolongateVessels(VesselArraysPointer(art_arrays), begin, end, group_size);
+			if (gen <= n_gen)
+				prolongateVessels(VesselArraysPointer(vein_arrays), begin, end, group_size);
+		}
+		else {
+			prolongateVessels(VesselPointer(arteries), begin, end, group_size);
+			if (gen <= n_gen)
+				prolongateVessels(VesselPointer(veins), begin, end, group_size);
+		}
+	}
+
+	if (!capillaries)
+		return;
+
+	const int cap_group_size = 1 << (n_gen-coarse_level);
+	if (soa_active)
+		prolongateCapillaries(CapillaryArraysPointer(cap_arrays), numCapillaries(), cap_group_size);
+	else
+		prolongateCapillaries(CapillaryPointer(caps), numCapillaries(), cap_group_size);
+}
+
+void Model::totalResistance()
+{
+	// bottom-up, final generation includes capillaries and corner vessels
+	for (int gen=nGenerations(); gen>0; --gen)
+		treePass(TotalResistancePass, gen);
 }
 
 double Model::partialR(Vessel::Type type, int i)
@@ -1302,231 +2067,434 @@ double Model::partialR(Vessel::Type type, int i)
 	return total_R;
 }
 
-void Model::calculateChildrenFlowPress(int i , int ideal_threads)
+void Model::calculateChildrenFlowPress()
 {
-	int gen = gen_no( i );
-	int current_gen_start = startIndex( gen );
-
-	// last generation, no children
-	if( gen == nGenerations()) {
-		const int c_idx = i - current_gen_start;
-		const int cv_idx = c_idx + startIndex(gen+1);
+	// flow and pressure, top-down from the root set by vascPress()
+	for (int gen=1; gen<=nGenerations(); ++gen)
+		treePass(FlowPressPass, gen);
+
+	// pressure fix-ups for blocked vessels
+	for (int gen=nGenerations()-1; gen>0; --gen)
+		treePass(BlockedPressBackwardPass, gen);
+	for (int gen=1; gen<nGenerations(); ++gen)
+		treePass(BlockedPressForwardPass, gen);
+}
 
-		caps[c_idx].flow = arteries[i].flow*arteries[cv_idx].R/(arteries[cv_idx].R + caps[c_idx].R);
-		arteries[cv_idx].flow = arteries[i].flow - caps[c_idx].flow;
+bool Model::deltaR()
+{
+	double max_vessel_deviation, max_cap_deviation;
+	double skipped_vessel_deviation = 0.0, skipped_cap_deviation = 0.0;
+	int cap_iteration = 0;
 
-		if (Q_UNLIKELY(isnan(caps[c_idx].flow) || isnan(arteries[cv_idx].flow))) {
-			caps[c_idx].flow = 0.0;
-			arteries[cv_idx].flow = 0.0;
-		}
+	const bool coarse = coarse_level > 0;
+	const bool use_active_set = !coarse && active_set && integration_helper->supportsActiveSet();
+	const bool full_pass = !use_active_set || active_full_pass;
+	if (use_active_set) {
+		skipped_vessel_deviation = integration_helper->selectActiveVessels(full_pass);
+		skipped_cap_deviation = integration_helper->selectActiveCapillaries(full_pass);
+	}
 
-		arteries[cv_idx].pressure_out = veins[i].pressure_in;
-		arteries[cv_idx].pressure_in = arteries[i].pressure_out;
+	if (anderson)
+		gatherLogResistances(anderson_x);
 
-		caps[c_idx].pressure_in = cmH2O_per_mmHg*arteries[i].pressure_out - Pal;
-		caps[c_idx].pressure_out = cmH2O_per_mmHg*veins[i].pressure_in - Pal;
-		return;
+	// integrate resistance of veins, arteries and capillaries
+	if (!coarse && fused_sweep && integration_helper->supportsRanges()) {
+		fusedResistances(max_vessel_deviation, max_cap_deviation);
+		total_R_current = true;
+	}
+	else {
+		max_vessel_deviation = integration_helper->integrate();
+		max_cap_deviation = integration_helper->capillaryResistances();
+		if (coarse)
+			prolongateCoarse(true, true);
 	}
 
-	// determine connecting indexes
-	int next_gen_start = startIndex( gen+1 );
-	int connection_first = ( i - current_gen_start ) * 2 + next_gen_start;
-
-	// Calculate flow and pressure in children vessels based on the calculated flow and their resistances
-	for( int con=connection_first; con<=connection_first+1; con++ ){
-		if (isinf(arteries[con].total_R)) {
-			// all vessels inside have no flow, pressure is only defined
-			// until block. Later, it is undefined.
-			arteries[con].pressure_in = arteries[i].pressure_out - (arteries[con].GP - arteries[i].GP)/cmH2O_per_mmHg;
-			veins[con].pressure_out = veins[i].pressure_in - (veins[con].GP - veins[i].GP)/cmH2O_per_mmHg;
+	// elements left out of the active set keep their last deviation
+	max_vessel_deviation = std::max(max_vessel_deviation, skipped_vessel_deviation);
+	max_cap_deviation = std::max(max_cap_deviation, skipped_cap_deviation);
 
-			arteries[con].flow = 0.0;
-			veins[con].flow = 0.0;
+	qDebug() << "   max vessel deltaR: " << max_vessel_deviation;
+	qDebug() << "   max cap deltaR:    " << max_cap_deviation;
+	const bool local_solve = !coarse && local_capillary_solve &&
+	                         integration_helper->supportsRanges();
+	while (max_cap_deviation/max_vessel_deviation > 20.0 && cap_iteration < 25) {
+		// unstable capillaries, simply adjust flow and recalculate
+		// capillaries until deviation is reduced.
+		if (local_solve) {
+			max_cap_deviation = localCapillaryResistances(20.0*max_vessel_deviation);
+		}
+		else {
+			vascPress();
+			if (use_active_set)
+				skipped_cap_deviation = integration_helper->selectActiveCapillaries(full_pass);
+			max_cap_deviation = std::max(integration_helper->capillaryResistances(),
+			                             skipped_cap_deviation);
+			if (coarse)
+				prolongateCoarse(false, true);
+		}
+		cap_iteration++;
 
-			arteries[con].pressure_out = arteries[con].pressure_in;
-			veins[con].pressure_in = veins[con].pressure_out;
+		// capillary resistances changed after the fused sweep
+		total_R_current = false;
 
-			arteries[con].pressure_out =
-			                isinf(arteries[con].R) ?
-			                        std::numeric_limits<double>::quiet_NaN() :
-			                        arteries[con].pressure_in;
+		qDebug() << "    +++++  max cap deltaR: " << max_cap_deviation;
+	}
 
-			veins[con].pressure_in =
-			                isinf(veins[con].R) ?
-			                        std::numeric_limits<double>::quiet_NaN() :
-			                        veins[con].pressure_out;
-		}
-		else {
-			arteries[con].pressure_in = arteries[i].pressure_out - (arteries[con].GP - arteries[i].GP)/cmH2O_per_mmHg;
-			veins[con].pressure_out = veins[i].pressure_in - (veins[con].GP - veins[i].GP)/cmH2O_per_mmHg;
+	qDebug() << "   max cap deltaR: " << max_cap_deviation;
 
-			double flow = (arteries[con].pressure_in - veins[con].pressure_out) /
-			              arteries[con].total_R;;
-			if (flow < 0.0 || isnan(flow))
-				flow = 0.0;
+	// do not end iterations when capillaries are still ununstable
+	double max_deviation = std::max(cap_iteration>0 ? Tlrns*100.0 : 0.0,
+	                                std::max(max_vessel_deviation, max_cap_deviation));
+	int estimated_progression = 10000;
+	for (double md=max_deviation; md>Tlrns && estimated_progression>0;) {
+		estimated_progression /= 2;
+		md /= 2.0;
+	}
+	if (prog < estimated_progression)
+		prog = estimated_progression;
 
-			veins[con].flow = flow;
-			arteries[con].flow = flow;
+	bool converged = max_deviation < Tlrns;
 
-			arteries[con].pressure_out = arteries[con].pressure_in - arteries[con].flow * arteries[con].R;
-			veins[con].pressure_in = veins[con].pressure_out + veins[con].flow * veins[con].R;
+	/* Convergence with an active set is confirmed by a full pass in the
+	 * next iteration.
+	 */
+	if (use_active_set) {
+		active_full_pass = converged && !full_pass;
+		if (active_full_pass) {
+			qDebug() << "   active set converged, verifying all elements";
+			converged = false;
 		}
 	}
 
-	// Now, calculate the same thing for child generations
-	if (ideal_threads>1) {
-		QFuture<void> f1 = QtConcurrent::run(
-		                           this, &Model::calculateChildrenFlowPress,
-		                           connection_first, ideal_threads/2);
-		QFuture<void> f2 = QtConcurrent::run(
-		                           this, &Model::calculateChildrenFlowPress,
-		                           connection_first+1, ideal_threads/2);
+	if (anderson && !converged)
+		accelerateResistances(cap_iteration > 0);
 
-		f1.waitForFinished();
-		f2.waitForFinished();
-	}
-	else {
-		calculateChildrenFlowPress(connection_first, 0);
-		calculateChildrenFlowPress(connection_first+1, 0);
+	return converged;
+}
+
+void Model::gatherLogResistances(std::vector<double> &log_R)
+{
+	const int n_art = numArteries();
+	const int n_vein = numVeins();
+	const int n_cap = numCapillaries();
+
+	log_R.resize(n_art + n_vein + n_cap);
+	double *r = &log_R[0];
+
+	if (soa_active) {
+		for (int i=0; i<n_art; ++i)
+			*r++ = std::log(art_arrays.R[i]);
+		for (int i=0; i<n_vein; ++i)
+			*r++ = std::log(vein_arrays.R[i]);
+		for (int i=0; i<n_cap; ++i)
+			*r++ = std::log(cap_arrays.R[i]);
+		return;
 	}
 
-	// Calculate 'backward' pressure for static flow vessels since a block
-	for( int con=connection_first; con<=connection_first+1; con++ ){
-		if (arteries[i].flow == 0.0 && isnan(arteries[i].pressure_out)) {
-			arteries[i].pressure_out = arteries[con].pressure_in +
-			                           (arteries[con].GP - arteries[i].GP)/cmH2O_per_mmHg;
-			if (!isinf(arteries[i].R))
-				arteries[i].pressure_in = arteries[i].pressure_out;
-		}
+	for (int i=0; i<n_art; ++i)
+		*r++ = std::log(arteries[i].R);
+	for (int i=0; i<n_vein; ++i)
+		*r++ = std::log(veins[i].R);
+	for (int i=0; i<n_cap; ++i)
+		*r++ = std::log(caps[i].R);
+}
 
-		if (veins[i].flow == 0.0 && isnan(veins[i].pressure_in)) {
-			veins[i].pressure_in = veins[con].pressure_out +
-			                       (veins[con].GP - veins[i].GP)/cmH2O_per_mmHg;
-			if (!isinf(veins[i].R))
-				veins[i].pressure_out = veins[i].pressure_in;
-		}
+void Model::scatterLogResistances(const std::vector<double> &log_R,
+                                  const std::vector<double> &unchanged)
+{
+	const int n_art = numArteries();
+	const int n_vein = numVeins();
+	const int n_cap = numCapillaries();
+	const double *r = &log_R[0];
+	const double *u = &unchanged[0];
+
+	// only changed values, so the others are not rounded by exp(log(R))
+	if (soa_active) {
+		for (int i=0; i<n_art; ++i, ++r, ++u)
+			if (*r != *u)
+				art_arrays.R[i] = std::exp(*r);
+		for (int i=0; i<n_vein; ++i, ++r, ++u)
+			if (*r != *u)
+				vein_arrays.R[i] = std::exp(*r);
+		for (int i=0; i<n_cap; ++i, ++r, ++u)
+			if (*r != *u)
+				cap_arrays.R[i] = std::exp(*r);
+		return;
 	}
 
-	// Check if we need to recalculate forward static pressure towards a blockage
-	// This is only encoutered in multiple blockages scenario
-	for( int con=connection_first; con<=connection_first+1; con++ ){
-		bool redo_branch = false;
+	for (int i=0; i<n_art; ++i, ++r, ++u)
+		if (*r != *u)
+			arteries[i].R = std::exp(*r);
+	for (int i=0; i<n_vein; ++i, ++r, ++u)
+		if (*r != *u)
+			veins[i].R = std::exp(*r);
+	for (int i=0; i<n_cap; ++i, ++r, ++u)
+		if (*r != *u)
+			caps[i].R = std::exp(*r);
+}
+
+/* Replaces resistances from the last integration, G(R), with the Anderson
+ * mix of the previous iterations. Mixing is in log(R), as resistances span
+ * many orders of magnitude and must remain positive. After unstable
+ * capillaries are re-solved, the step is not part of the same fixed point
+ * iteration so the history is restarted.
+ */
+void Model::accelerateResistances(bool restart)
+{
+	gatherLogResistances(anderson_g);
 
-		if (arteries[i].flow == 0.0 &&
-		    !isnan(arteries[i].pressure_out) &&
-		    isnan(arteries[con].pressure_in)) {
+	if (restart)
+		anderson->reset();
 
-			arteries[con].pressure_in = arteries[i].pressure_out -
-			                            (arteries[con].GP - arteries[i].GP)/cmH2O_per_mmHg;
-			if (!isinf(arteries[con].R)) {
-				arteries[con].pressure_out = arteries[con].pressure_in;
-				redo_branch = true;
-			}
-		}
+	std::vector<double> mixed(anderson_g);
+	if (!anderson->step(anderson_x, mixed))
+		return;
 
-		if (veins[i].flow == 0.0 &&
-		    !isnan(veins[i].pressure_in) &&
-		    isnan(veins[con].pressure_out)) {
+	scatterLogResistances(mixed, anderson_g);
+	total_R_current = false;
+}
 
-			veins[con].pressure_out = veins[i].pressure_in -
-			                          (veins[con].GP - veins[i].GP)/cmH2O_per_mmHg;
-			if (!isinf(veins[con].R)) {
-				veins[con].pressure_in = veins[con].pressure_out;
-				redo_branch = true;
-			}
-		}
+int Model::fusedSplitGeneration()
+{
+	/* Subtrees of 10 generations, ~500KB of solver state, fit in L2
+	 * cache. Smaller ones split the generations into ranges that are too
+	 * short for the vector kernels. Use more, smaller subtrees only when
+	 * needed to keep all workers busy.
+	 */
+	int gen = std::max(1, nGenerations()-9);
+	while (gen < nGenerations() && nElements(gen) < 4*solverPool().threadCount())
+		++gen;
+
+	return gen;
+}
+
+void Model::fusedResistances(double &max_vessel_deviation, double &max_cap_deviation)
+{
+	const int split_gen = fusedSplitGeneration();
+	SolverPool &pool = solverPool();
+
+	worker_vessel_deviation.assign(pool.threadCount(), 0.0);
+	worker_cap_deviation.assign(pool.threadCount(), 0.0);
 
-		if (redo_branch)
-			calculateChildrenFlowPress(con, ideal_threads);
+	SolverMemberTask<Model, int> task(this, &Model::fusedSubtrees, split_gen);
+	pool.run(task, startIndex(split_gen), startIndex(split_gen)+nElements(split_gen), 1);
+
+	max_vessel_deviation = *std::max_element(worker_vessel_deviation.begin(),
+	                                         worker_vessel_deviation.end());
+	max_cap_deviation = *std::max_element(worker_cap_deviation.begin(),
+	                                      worker_cap_deviation.end());
+
+	// generations above the subtrees
+	const int top_end = startIndex(split_gen);
+	max_vessel_deviation = std::max(max_vessel_deviation,
+	                                integration_helper->integrateRange(0, Vessel::Artery, 0, top_end));
+	max_vessel_deviation = std::max(max_vessel_deviation,
+	                                integration_helper->integrateRange(0, Vessel::Vein, 0, top_end));
+
+	for (int gen=split_gen-1; gen>0; --gen)
+		treePassRange(0, TotalResistancePass, startIndex(gen), startIndex(gen)+nElements(gen));
+}
+
+void Model::fusedSubtrees(int worker, int split_gen, int begin, int end)
+{
+	const int depth = nGenerations() - split_gen;
+	const int leaf_start = startIndex(nGenerations());
+	const int cv_start = startIndex(nGenerations()+1);
+	double vessel_deviation = worker_vessel_deviation[worker];
+	double cap_deviation = worker_cap_deviation[worker];
+
+	/* One subtree at a time, so that its vessels are still in cache when
+	 * total_R is calculated. Descendants of vessel i in the n-th
+	 * generation below it are [(i+1)*2^n-1, (i+2)*2^n-1).
+	 */
+	for (int root=begin; root<end; ++root) {
+		int first = ((root+1) << depth) - 1;
+		int last = ((root+2) << depth) - 1;
+
+		// final generation connects through capillaries and corner vessels
+		cap_deviation = std::max(cap_deviation,
+		        integration_helper->capillaryResistanceRange(worker, first-leaf_start,
+		                                                     last-leaf_start));
+		vessel_deviation = std::max(vessel_deviation,
+		        integration_helper->integrateRange(worker, Vessel::Artery,
+		                                           first-leaf_start+cv_start,
+		                                           last-leaf_start+cv_start));
+
+		for (int gen=nGenerations(); gen>=split_gen; --gen) {
+			vessel_deviation = std::max(vessel_deviation,
+			        integration_helper->integrateRange(worker, Vessel::Artery, first, last));
+			vessel_deviation = std::max(vessel_deviation,
+			        integration_helper->integrateRange(worker, Vessel::Vein, first, last));
+			treePassRange(worker, TotalResistancePass, first, last);
+
+			first = (first-1)/2;
+			last = (last-1)/2;
+		}
 	}
+
+	worker_vessel_deviation[worker] = vessel_deviation;
+	worker_cap_deviation[worker] = cap_deviation;
 }
 
-bool Model::deltaR(int ideal_threads)
+int Model::localSubtreeDepth() const
 {
-	// integrate resistance of veins and arteries
-	double max_vessel_deviation = integration_helper->integrate();
-	double max_cap_deviation = integration_helper->capillaryResistances();
-	int cap_iteration = 0;
+	/* Subtrees of 16 capillaries. Their inlet and outlet pressures are
+	 * set by the rest of the tree and change little when only a few
+	 * capillaries within change.
+	 */
+	return std::min(4, nGenerations()-2);
+}
 
-	qDebug() << "   max vessel deltaR: " << max_vessel_deviation;
-	qDebug() << "   max cap deltaR:    " << max_cap_deviation;
-	while (max_cap_deviation/max_vessel_deviation > 20.0 && cap_iteration < 25) {
-		// unstable capillaries, simply adjust flow and recalculate
-		// capillaries until deviation is reduced.
-		vascPress(ideal_threads);
-		max_cap_deviation = integration_helper->capillaryResistances();
-		cap_iteration++;
+double Model::localCapillaryResistances(double threshold)
+{
+	const int depth = localSubtreeDepth();
+	const int leaf_start = startIndex(nGenerations());
+	const int n_caps = numCapillaries();
+	const double *last_delta_R = soa_active ? cap_arrays.last_delta_R : 0;
 
-		qDebug() << "    +++++  max cap deltaR: " << max_cap_deviation;
+	/* Capillary c is in the subtree of vessel ((leaf_start+c+1) >> depth)-1,
+	 * so the roots are found in order.
+	 */
+	local_roots.clear();
+	for (int i=0; i<n_caps; ++i) {
+		const double d = soa_active ? last_delta_R[i] : caps[i].last_delta_R;
+		if (d <= threshold)
+			continue;
+
+		const int root = ((leaf_start+i+1) >> depth) - 1;
+		if (local_roots.empty() || local_roots.back() != root)
+			local_roots.push_back(root);
 	}
 
-	qDebug() << "   max cap deltaR: " << max_cap_deviation;
+	// capillaries outside the subtrees keep their deviation
+	double max_cap_deviation = 0.0;
+	unsigned next_root = 0;
+	for (int i=0; i<n_caps; ++i) {
+		const int root = ((leaf_start+i+1) >> depth) - 1;
+		while (next_root < local_roots.size() && local_roots[next_root] < root)
+			++next_root;
+		if (next_root < local_roots.size() && local_roots[next_root] == root)
+			continue;
 
-	// do not end iterations when capillaries are still ununstable
-	double max_deviation = std::max(cap_iteration>0 ? Tlrns*100.0 : 0.0,
-	                                std::max(max_vessel_deviation, max_cap_deviation));
-	int estimated_progression = 10000;
-	for (double md=max_deviation; md>Tlrns && estimated_progression>0;) {
-		estimated_progression /= 2;
-		md /= 2.0;
+		const double d = soa_active ? last_delta_R[i] : caps[i].last_delta_R;
+		max_cap_deviation = std::max(max_cap_deviation, d);
 	}
-	if (prog < estimated_progression)
-		prog = estimated_progression;
 
-	return max_deviation < Tlrns;
+	qDebug() << "   local capillary subtrees:" << local_roots.size()
+	         << "of" << nElements(nGenerations()-depth);
+
+	SolverPool &pool = solverPool();
+	worker_cap_deviation.assign(pool.threadCount(), 0.0);
+
+	SolverMemberTask<Model, int> task(this, &Model::localSubtrees, depth);
+	pool.run(task, 0, local_roots.size(), 16);
+
+	return std::max(max_cap_deviation,
+	                *std::max_element(worker_cap_deviation.begin(),
+	                                  worker_cap_deviation.end()));
+}
+
+void Model::localSubtrees(int worker, int depth, int begin, int end)
+{
+	const int leaf_start = startIndex(nGenerations());
+	double cap_deviation = worker_cap_deviation[worker];
+
+	for (int n=begin; n<end; ++n) {
+		const int root = local_roots[n];
+		int first = ((root+1) << depth) - 1;
+		int last = ((root+2) << depth) - 1;
+		const int first_cap = first - leaf_start;
+		const int last_cap = last - leaf_start;
+
+		// total_R with current capillary resistances, bottom-up to the root
+		while (first >= root) {
+			treePassRange(worker, TotalResistancePass, first, last);
+			first = (first-1)/2;
+			last = (last-1)/2;
+		}
+
+		treePassRange(worker, SubtreeFlowPressPass, root, root+1);
+		cap_deviation = std::max(cap_deviation,
+		        integration_helper->resolveCapillaryRange(worker, first_cap, last_cap));
+	}
+
+	worker_cap_deviation[worker] = cap_deviation;
 }
 
 void Model::initVesselBaselineCharacteristics()
 {
+	materializeVessels();
+	const bool transient = beginSetupPool();
+
 	initVesselBaselineResistances();
 	calculateBaselineCharacteristics();
 
+	endSetupPool(transient);
+
 	/* Initialize vessel parameters */
 	const int num_arteries = numArteries();
-	for (int i=0; i<num_arteries; ++i) {
-		if (vessel_value_override[i])
-			continue;
-
-		//arteries[i].a = 0.2419 / 1.2045;
-		arteries[i].gamma = 1.84;
-		arteries[i].phi = 0.04; //0.0275 / 1.2045;
-		arteries[i].c = 0;
-		arteries[i].tone = 0;
+	for (int gen=1; gen<=nGenerations()+1; ++gen) {
+		const int start = startIndex(gen);
+		const int end = std::min(start + nElements(gen), num_arteries);
+		const int n_arteries = nElements(std::min(gen, 16));
+		const double vessel_ratio = static_cast<double>(n_arteries) /
+		                            nVessels(Vessel::Artery, gen);
+
+		for (int i=start; i<end; ++i) {
+			if (vessel_value_override[i])
+				continue;
 
-		int gen = gen_no(i);
-		int n_arteries = nElements(gen);
-		if (gen > 16)
-			n_arteries = nElements(16);
-		arteries[i].vessel_ratio = static_cast<double>(n_arteries) /
-		                        nVessels(Vessel::Artery, gen);
+			//arteries[i].a = 0.2419 / 1.2045;
+			arteries[i].gamma = 1.84;
+			arteries[i].phi = 0.04; //0.0275 / 1.2045;
+			arteries[i].c = 0;
+			arteries[i].tone = 0;
+			arteries[i].vessel_ratio = vessel_ratio;
+		}
 	}
 
 	const int num_veins = numVeins();
-	for (int i=0; i<num_veins; ++i) {
-		if (vessel_value_override[num_arteries + i])
-			continue;
+	const int first_inside = nOutsideElements();
+	for (int gen=1; gen<=nGenerations(); ++gen) {
+		const int start = startIndex(gen);
+		const int end = start + nElements(gen);
+		const double vessel_ratio = static_cast<double>(nElements(gen)) /
+		                            nVessels(Vessel::Vein, gen);
+
+		for (int i=start; i<end; ++i) {
+			if (vessel_value_override[num_arteries + i])
+				continue;
 
-		if (isOutsideLung(i)) {
-			// correct for vessels outside the lung
-			veins[i].gamma = 1.85;
-			veins[i].phi = 0.0;
-		}
-		else {
-			veins[i].gamma = 1.85;
-			veins[i].phi = 0.035;
+			if (i < first_inside) {
+				// correct for vessels outside the lung
+				veins[i].gamma = 1.85;
+				veins[i].phi = 0.0;
+			}
+			else {
+				veins[i].gamma = 1.85;
+				veins[i].phi = 0.035;
+			}
+			veins[i].tone = 0;
+			veins[i].vessel_ratio = vessel_ratio;
 		}
-		veins[i].tone = 0;
-
-		veins[i].vessel_ratio = static_cast<double>(nElements(gen_no(i))) /
-		                        nVessels(Vessel::Vein, gen_no(i));
 	}
 }
 
 void Model::initVesselBaselineResistances()
 {
+	materializeVessels();
+	const bool transient = beginSetupPool();
+
+	// baseline resistances, not a previous solution
+	cold_start = true;
+
 	CO = CI * BSA(PatHt, PatWt);
 
-	initVesselBaselineResistances(1);
+	// all generations, including corner vessels
+	for (int gen=1; gen<=nGenerations()+1; ++gen)
+		initVesselBaselineResistances(gen);
+
+	endSetupPool(transient);
 
 	// Initialize capillaries
 	const int nCapillaries = numCapillaries();
@@ -1542,20 +2510,46 @@ void Model::initVesselBaselineResistances()
 	}
 }
 
+/* Values shared by all elements of a generation */
+struct Model::BaselineGeneration
+{
+	int start_index;
+	bool is_corner_vessel;
+
+	double art_length, art_d, art_R, art_volume;
+	double vein_length, vein_d, vein_R, vein_volume;
+
+	// GPz = (vessel_no*gpz_step + gpz_offset - 1)/gpz_scale
+	int gp_elements; // vessel_no is taken modulo, if not 0
+	double gpz_step, gpz_offset, gpz_scale;
+};
+
 void Model::initVesselBaselineResistances(int gen)
 {
 	// Get starting index and number of elements in the generation
-	int start_index = startIndex( gen );
+	BaselineGeneration g;
+	g.start_index = startIndex( gen );
 	int num_elements = nElements( gen );
 
-	bool is_corner_vessel = (gen == 17);
-	if (is_corner_vessel) {
+	g.is_corner_vessel = (gen == 17);
+	if (g.is_corner_vessel) {
 		num_elements = nElements(16);
 	}
-	int n = num_elements + start_index;
 
-	// Initialize elements in Arteries and Veins
-	const int n_arteries = numArteries();
+	/* calculate baseline vessel diameters from resistances
+	 *
+	 * Initially blood is assumed to have a normal Hct of 0.45 and
+	 * a normal viscosity of 3.2 (the units are centiPoise).
+	 *
+	 * From the equations R=8*Pi*Mi*L/A^2
+	 *
+	 * One can calculate baseline vessel cross-sectional area using
+	 * the following relationship:
+	 *
+	 * R(baseline)*8000=8*pi*3.2*L/A(baseline)^2
+	 *
+	 * Apart from GPz, these are the same for the whole generation.
+	 */
 	const double art_ratio = num_elements/(double)nVessels(Vessel::Artery, gen);
 	const double vein_ratio = num_elements/(double)nVessels(Vessel::Vein, gen);
 	const double Mi = 3.2; // viscosity constatant
@@ -1563,94 +2557,161 @@ void Model::initVesselBaselineResistances(int gen)
 	const double Kra_factor = Kr*art_ratio;
 	const double Krv_factor = Kr*vein_ratio;
 
-	for( int i=start_index; i<n; i++ ){
-		int vessel_no = i - start_index;
-
-		/* calculate baseline vessel diameters from resistances
-		 *
-		 * Initially blood is assumed to have a normal Hct of 0.45 and
-		 * a normal viscosity of 3.2 (the units are centiPoise).
-		 *
-		 * From the equations R=8*Pi*Mi*L/A^2
-		 *
-		 * One can calculate baseline vessel cross-sectional area using
-		 * the following relationship:
-		 *
-		 * R(baseline)*8000=8*pi*3.2*L/A(baseline)^2
-		 */
+	g.art_d = 1e4 * PA_diam * measuredDiameterRatio(Vessel::Artery, gen);
+	g.art_length = 1e4 * PA_EVL * measuredLengthRatio(Vessel::Artery, gen);
+	g.art_R = Kra_factor*g.art_length/sqr(sqr(g.art_d));
+	g.art_volume = 1e-9 * M_PI/4.0*g.art_d*g.art_d*g.art_length / art_ratio;
+
+	g.vein_d = 1e4 * PV_diam * measuredDiameterRatio(Vessel::Vein, gen);
+	g.vein_length = 1e4 * PV_EVL * measuredLengthRatio(Vessel::Vein, gen);
+	g.vein_R = Krv_factor*g.vein_length/sqr(sqr(g.vein_d));
+	g.vein_volume = 1e-9 * M_PI/4.0*g.vein_d*g.vein_d*g.vein_length / vein_ratio;
+
+	// GP was calculated with GP=0 being top of lung
+	// then corrected based on transducer position
+	// GPz is a fraction of lung height
+	int gp_gen = gen;
+	int effective_ngen = 16-1;
+	g.gp_elements = 0;
+	if (gen > 1) {
+		gp_gen--;
+		g.gp_elements = nElements(gp_gen);
+	}
+
+	g.gpz_step = exp((effective_ngen-gp_gen+1)*M_LN2);
+	g.gpz_offset = exp((effective_ngen-gp_gen)*M_LN2);
+	g.gpz_scale = exp((effective_ngen)*M_LN2) - 2;
+
+	SolverMemberTask<Model, const BaselineGeneration*> task(
+	        this, &Model::baselineResistanceRange, &g);
+	solverPool().run(task, g.start_index, g.start_index+num_elements, 2048);
+}
 
+void Model::baselineResistanceRange(int worker, const BaselineGeneration *g,
+                                    int begin, int end)
+{
+	Q_UNUSED(worker);
+
+	const int n_arteries = numArteries();
+	const int corner_offset = nElements(16);
+
+	for (int i=begin; i<end; i++) {
 		if (!vessel_value_override[i]) {
-			const double art_d = 1e4 * PA_diam * measuredDiameterRatio(Vessel::Artery, gen);
-			arteries[i].length = 1e4 * PA_EVL * measuredLengthRatio(Vessel::Artery, gen);
-			arteries[i].D = art_d;
-			arteries[i].R = Kra_factor*arteries[i].length/sqr(sqr(art_d));
+			arteries[i].length = g->art_length;
+			arteries[i].D = g->art_d;
+			arteries[i].R = g->art_R;
 			arteries[i].viscosity_factor = 1.0;
-			arteries[i].volume = 1e-9 * M_PI/4.0*art_d*art_d*arteries[i].length / art_ratio;
+			arteries[i].volume = g->art_volume;
 		}
 
-		if (!is_corner_vessel && !vessel_value_override[n_arteries+i]) {
-			const double vein_d = 1e4 * PV_diam * measuredDiameterRatio(Vessel::Vein, gen);
-			veins[i].length = 1e4 * PV_EVL * measuredLengthRatio(Vessel::Vein, gen);
-			veins[i].D = vein_d;
-			veins[i].R = Krv_factor*veins[i].length/sqr(sqr(vein_d));
+		if (g->is_corner_vessel) {
+			// last generation is set up already
+			arteries[i].GPz = arteries[i-corner_offset].GPz;
+			continue;
+		}
+
+		if (!vessel_value_override[n_arteries+i]) {
+			veins[i].length = g->vein_length;
+			veins[i].D = g->vein_d;
+			veins[i].R = g->vein_R;
 			veins[i].viscosity_factor = 1.0;
-			veins[i].volume = 1e-9 * M_PI/4.0*vein_d*vein_d*veins[i].length / vein_ratio;
-		}
-
-		if (!is_corner_vessel) {
-			// GP was calculated with GP=0 being top of lung
-			// then corrected based on transducer position
-			// GPz is a fraction of lung height
-			int gp_gen = gen;
-			int effective_ngen = 16-1;
-			if (gen > 1) {
-				gp_gen--;
-				vessel_no %= nElements(gp_gen);
-			}
+			veins[i].volume = g->vein_volume;
+		}
 
-			const double GPz = (vessel_no*exp((effective_ngen-gp_gen+1)*M_LN2)+
-			                 exp((effective_ngen-gp_gen)*M_LN2)-1) /
-			                (exp((effective_ngen)*M_LN2) - 2);
+		int vessel_no = i - g->start_index;
+		if (g->gp_elements > 0)
+			vessel_no %= g->gp_elements;
 
-			if (!vessel_value_override[i])
-				arteries[i].GPz = GPz;
-			if (!vessel_value_override[n_arteries+i])
-				veins[i].GPz = GPz;
-		}
-		else {
-			arteries[i].GPz = arteries[i-nElements(16)].GPz;
-		}
-	}
+		const double GPz = (vessel_no*g->gpz_step + g->gpz_offset - 1) /
+		                   g->gpz_scale;
 
-	// Initialize more generations, if they exist, including corner vessels
-	if( gen <= nGenerations())
-		initVesselBaselineResistances(gen+1);
+		if (!vessel_value_override[i])
+			arteries[i].GPz = GPz;
+		if (!vessel_value_override[n_arteries+i])
+			veins[i].GPz = GPz;
+	}
 }
 
+/* Values shared by all elements of a lung */
+struct Model::BaselineLung
+{
+	double height;
+	double Vc, Vd, a, b, V0;
+
+	double lengthFactor(double Ptp) const {
+		double V = a + b/(1+exp((Vc - Ptp)/Vd));
+		return cbrt(V / V0);
+	}
+};
+
 void Model::calculateBaselineCharacteristics()
 {
 	/* This function corrects for transducer position and
 	 * calculates vessel Ppl and vessel Ptp based on transducer position
 	 * as well as global Ppl and Pal
 	 */
+	BaselineLung lungs[2];
+	for (int lung_no=0; lung_no<2; ++lung_no) {
+		BaselineLung &l = lungs[lung_no];
+		double cd = exp(Vc[lung_no]/Vd[lung_no]);
+
+		l.height = LungHt[lung_no];
+		l.Vc = Vc[lung_no];
+		l.Vd = Vd[lung_no];
+		l.a = (Vm[lung_no]*(1+cd)-Vtlc[lung_no])/cd;
+		l.b = Vtlc[lung_no]-l.a;
+		l.V0 = l.a + l.b/(1+exp(Vc[lung_no]/Vd[lung_no]));
+	}
+
+	materializeVessels();
+	const bool transient = beginSetupPool();
+	SolverPool &pool = solverPool();
+
+	SolverMemberTask<Model, const BaselineLung*> task(
+	        this, &Model::baselineCharacteristicsRange, lungs);
+	pool.run(task, 0, numArteries(), 2048);
+
+	// Initialize capillaries, from the GP of their arteries
+	SolverMemberTask<Model, int> cap_task(
+	        this, &Model::baselineCapillaryRange, startIndex(16));
+	pool.run(cap_task, 0, numCapillaries(), 2048);
+
+	endSetupPool(transient);
+	modified_flag = true;
+}
+
+void Model::baselineCharacteristicsRange(int worker, const BaselineLung *lungs,
+                                         int begin, int end)
+{
+	Q_UNUSED(worker);
 
-	const int num_arteries = numArteries();
 	const int num_veins = numVeins();
-	for (int i=0; i<num_arteries; ++i) {
-		Vessel &art = arteries[i];
-		int gen = gen_no(i);
-		int start_idx = startIndex(gen);
-		int lung_no = lungSide(gen, i-start_idx);
+	const int first_inside = nOutsideElements();
+
+	int gen = gen_no(begin);
+	int gen_end = startIndex(gen+1);
+	int right_start = startIndex(gen) + nElements(gen)/2;
 
+	for (int i=begin; i<end; ++i) {
+		if (i == gen_end) {
+			++gen;
+			gen_end = startIndex(gen+1);
+			right_start = startIndex(gen) + nElements(gen)/2;
+		}
+
+		const BaselineLung &lung = lungs[i < right_start ? LeftLung : RightLung];
+		const bool outside = i < first_inside;
+
+		Vessel &art = arteries[i];
 		switch (trans_pos) {
 		case Top:
-			art.GP = -art.GPz*LungHt[lung_no];
+			art.GP = -art.GPz*lung.height;
 			break;
 		case Middle:
-			art.GP = LungHt[lung_no]/2 - art.GPz*LungHt[lung_no];
+			art.GP = lung.height/2 - art.GPz*lung.height;
 			break;
 		case Bottom:
-			art.GP = LungHt[lung_no]-art.GPz*LungHt[lung_no];
+			art.GP = lung.height-art.GPz*lung.height;
 			break;
 		}
 
@@ -1661,79 +2722,71 @@ void Model::calculateBaselineCharacteristics()
 		if (art.Ptp < 0)
 			art.Ptp = 0;
 
-		if (isOutsideLung(i)) {
-			art.length_factor = 1.0;
-		}
-		else {
-			art.length_factor = lengthFactor(art, lung_no);
-		}
-	}
+		art.length_factor = outside ? 1.0 : lung.lengthFactor(art.Ptp);
 
-	for (int i=0; i<num_veins; ++i) {
+		// corner vessels have no veins
+		if (i >= num_veins)
+			continue;
+
+		/* Veins share GPz with the arteries at the same position,
+		 * unless either is overridden.
+		 */
 		Vessel &vein = veins[i];
-		int gen = gen_no(i);
-		int start_idx = startIndex(gen);
-		int lung_no = lungSide(gen, i-start_idx);
+		if (vein.GPz == art.GPz) {
+			vein.GP = art.GP;
+			vein.Ppl = art.Ppl;
+			vein.Ptp = art.Ptp;
+			vein.length_factor = art.length_factor;
+			continue;
+		}
 
 		switch (trans_pos) {
 		case Top:
-			vein.GP = -vein.GPz*LungHt[lung_no];
+			vein.GP = -vein.GPz*lung.height;
 			break;
 		case Middle:
-			vein.GP = LungHt[lung_no]/2 - vein.GPz*LungHt[lung_no];
+			vein.GP = lung.height/2 - vein.GPz*lung.height;
 			break;
 		case Bottom:
-			vein.GP = LungHt[lung_no]-vein.GPz*LungHt[lung_no];
+			vein.GP = lung.height-vein.GPz*lung.height;
 			break;
 		}
 
-		// for every 1 cmH2O GP, Ppl changes by 0.55
 		vein.Ppl = Ppl - 0.55*vein.GP;
 		vein.Ptp = Pal - vein.Ppl;
 
 		if (vein.Ptp < 0)
 			vein.Ptp = 0;
 
-		if (isOutsideLung(i)) {
-			vein.length_factor = 1.0;
-		}
-		else {
-			vein.length_factor = lengthFactor(vein, lung_no);
-		}
+		vein.length_factor = outside ? 1.0 : lung.lengthFactor(vein.Ptp);
 	}
+}
 
-	// Initialize capillaries
-	const int num_capillaries = numCapillaries();
-	const int start_offset = startIndex(16);
+void Model::baselineCapillaryRange(int worker, int start_offset, int begin, int end)
+{
+	Q_UNUSED(worker);
 
-	for (int i=0; i<num_capillaries; i++) {
-		Capillary cap = caps[i];
-		cap.Ho = 2.5;
-		cap.open_state = Capillary_Auto;
+	const int cap_offset = numArteries() + numVeins();
 
-		const Vessel &connected_vessel = arteries[i+start_offset];
-		if (vessel_value_override[num_arteries + num_veins + i])
+	for (int i=begin; i<end; i++) {
+		if (vessel_value_override[cap_offset + i])
 			continue;
 
-		double cap_ppl = Ppl - 0.55*connected_vessel.GP;
+		Capillary &cap = caps[i];
+		cap.Ho = 2.5;
+		cap.open_state = Capillary_Auto;
+
+		double cap_ppl = Ppl - 0.55*arteries[i+start_offset].GP;
 		double cap_ptp = Pal - cap_ppl;
 		cap.Alpha = 0.073+0.2*exp(-0.141*cap_ptp);
 
-		setCapillary(i, cap, false);
+		// as setCapillary(), without touching vessel_value_override
+		cap.F = 1.0 + 25*cap.Alpha;
+		cap.F3 = cap.F*cap.F*cap.F;
+		cap.F4 = cap.F*cap.F*cap.F*cap.F;
 	}
 }
 
-double Model::lengthFactor(const Vessel &v, int lung_no) const
-{
-	double cd = exp(Vc[lung_no]/Vd[lung_no]);
-	double a = (Vm[lung_no]*(1+cd)-Vtlc[lung_no])/cd;
-	double b = Vtlc[lung_no]-a;
-
-	double V = a + b/(1+exp((Vc[lung_no] - v.Ptp)/Vd[lung_no]));
-	double V0 = a + b/(1+exp(Vc[lung_no]/Vd[lung_no]));
-	return cbrt(V / V0);
-}
-
 bool Model::initDb(QSqlDatabase &db) const
 {
 	static const QList<QStringList> stms = QList<QStringList>()
@@ -1849,7 +2902,7 @@ bool Model::saveDb(QSqlDatabase &db, int offset, QProgressDialog *progress)
 		int n_elements = (type==1 ? numArteries() : numVeins());
 		for (int n=0; n<n_elements; ++n) {
 			const int override_offset = (type==1 ? n : numArteries()+n);
-			const Vessel &v = (type==1 ? arteries[n] : veins[n]);
+			const Vessel &v = (type==1 ? art_store.at(n) : vein_store.at(n));
 
 			if (!vessel_value_override[override_offset])
 				continue;
@@ -1913,7 +2966,7 @@ bool Model::saveDb(QSqlDatabase &db, int offset, QProgressDialog *progress)
 
 	for (int n=0; n<n_caps; ++n) {
 		const int override_offset = numArteries() + numVeins() + n;
-		const Capillary &cap = caps[n];
+		const Capillary &cap = cap_store.at(n);
 
 		if (!vessel_value_override[override_offset])
 			continue;
@@ -1980,6 +3033,8 @@ bool Model::loadDb(QSqlDatabase &db, int offset, QProgressDialog *progress)
 	/* Assumption: progress is to advance 1000 steps during execution of this function */
 	QSqlQuery q(db);
 
+	materializeVessels();
+
 	// load values
 	QMap<QString,double> values;
 
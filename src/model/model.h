@@ -20,7 +20,11 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include "cowarray.h"
 #include "disease.h"
+#include "solverpool.h"
+#include "vesselstorage.h"
+#include <QByteArray>
 #include <QPair>
 
 /* Defined in model.cpp, used by integration helper. OpenCL code assuses
@@ -98,6 +102,7 @@ extern bool operator==(const struct Vessel &a, const struct Vessel &b);
 extern bool operator==(const struct Capillary &a, const struct Capillary &b);
 
 class AbstractIntegrationHelper;
+class AndersonMixer;
 class QProgressDialog;
 class QSqlDatabase;
 class QString;
@@ -134,7 +139,36 @@ public:
 	enum Transducer { Top, Middle, Bottom };
 	enum Gender { Male, Female };
 
-	enum IntegralType { SegmentedVesselFlow, RigidVesselFlow, NavierStokes };
+	/* AdaptiveVesselFlow integrates along the vessel like
+	 * SegmentedVesselFlow, with segment lengths chosen per vessel from an
+	 * error estimate instead of nSums equal segments. Values are stored in
+	 * settings and model files.
+	 */
+	enum IntegralType { SegmentedVesselFlow, RigidVesselFlow, NavierStokes,
+	                    AdaptiveVesselFlow };
+
+	/* Layout of the solver state during calc(). Vessel and Capillary
+	 * structures remain the canonical storage in either case.
+	 */
+	enum StorageLayout { ArrayOfStructures, StructureOfArrays };
+
+	/* Outer iteration of calc(). Anderson acceleration mixes resistances
+	 * of the previous iterations to approach the fixed point faster.
+	 */
+	enum Acceleration { NoAcceleration, AndersonAcceleration };
+
+	/* Arithmetic of the vectorised segmented vessel integration. Mixed
+	 * calculates segments in float and sums them in double. Other
+	 * integral types and the scalar code always use double.
+	 */
+	enum Precision { DoublePrecision, SinglePrecision, MixedPrecision };
+
+	// per-generation passes over the vessel tree, see treePass()
+	enum TreePass {
+		TotalResistancePass, FlowPressPass,
+		BlockedPressBackwardPass, BlockedPressForwardPass,
+		SubtreeFlowPressPass // whole subtrees of the given vessels
+	};
 
 	Model( Transducer, IntegralType type );
 	Model(const Model &other);
@@ -146,6 +180,56 @@ public:
 	void setIntegralType(IntegralType);
 	IntegralType integralType() const { return integral_type; }
 
+	void setStorageLayout(StorageLayout layout) { storage_layout = layout; }
+	StorageLayout storageLayout() const { return storage_layout; }
+
+	// number of solver threads used by calc(), 0 for automatic
+	void setSolverThreads(int n) { solver_threads = n; }
+	int solverThreads() const { return solver_threads; }
+
+	// parallel phases of the last calc(), not copied with the model
+	const SolverPool::Statistics& solverStatistics() const { return solver_stats; }
+
+	// vessel, capillary and solver array buffers of the model while calculating
+	qint64 memoryFootprint() const;
+
+	/* Integrate resistances and accumulate total_R in a single bottom-up
+	 * sweep over subtrees, when the integration helper supports it.
+	 */
+	void setFusedSweep(bool fused) { fused_sweep = fused; }
+	bool fusedSweep() const { return fused_sweep; }
+
+	void setAcceleration(Acceleration a) { outer_acceleration = a; }
+	Acceleration acceleration() const { return outer_acceleration; }
+
+	void setPrecision(Precision p) { solver_precision = p; }
+	Precision precision() const { return solver_precision; }
+
+	/* Only re-integrate elements whose resistance, flow or pressures
+	 * still change. Convergence is confirmed by integrating all elements.
+	 * Off by default.
+	 */
+	void setActiveSet(bool enabled) { active_set = enabled; }
+	bool activeSet() const { return active_set; }
+
+	/* Re-solve unstable capillaries within their enclosing subtrees, with
+	 * the subtree inlet and outlet pressures held fixed, instead of
+	 * recalculating flow and pressure of the whole tree. Off by default.
+	 */
+	void setLocalCapillarySolve(bool local) { local_capillary_solve = local; }
+	bool localCapillarySolve() const { return local_capillary_solve; }
+
+	/* Start calc() with a coarse solve, in which only the first n
+	 * generations vary laterally. Below generation n, all vessels of a
+	 * generation within the same subtree, and the capillaries under it,
+	 * take the resistances of the first of them. The converged coarse
+	 * state is the starting point of the full solve. It is skipped when
+	 * the model starts from a previous solution. 0, the default, disables
+	 * it.
+	 */
+	void setCoarseGenerations(int n) { coarse_generations = n; }
+	int coarseGenerations() const { return coarse_generations; }
+
 	// Number of generations in the model
 	int nGenerations() const { return 16; }
 
@@ -213,6 +297,7 @@ public:
 	int numVeins() const { return nElements(); }
 	int numCapillaries() const { return nElements(nGenerations()); }
 
+	// iterations of the last calc(), including those of the coarse solve
 	int numIterations() const { return n_iterations; }
 
 	// get and set data
@@ -236,6 +321,29 @@ public:
 	// does actual calculations
 	virtual int calc( int max_iter = 100 ); // returns number of iterations
 
+	/* Starts the next calc() from the converged state of a model with
+	 * nearby parameters, instead of the baseline resistances. With
+	 * before, resistances are extrapolated linearly, in log(R), from
+	 * before to previous by step_ratio times their difference.
+	 */
+	void warmStart(const Model &previous, const Model *before=0, double step_ratio=1.0);
+
+	/* Compressed vessel and capillary resistances of a calculated model.
+	 * Restoring them into a model with the same inputs warm starts its
+	 * next calc() from that solution. Returns false if state is not of a
+	 * model with the same number of elements.
+	 */
+	QByteArray resistanceState() const;
+	bool restoreResistanceState(const QByteArray &state);
+
+	/* SHA-1 of everything calc() depends on: inputs, the input fields of
+	 * vessels and capillaries and their overrides, diseases, solver
+	 * options, calibration values and the morphometry table. Results and
+	 * the resistances a calculation starts from are not part of it, so
+	 * models with equal hashes converge to the same solution.
+	 */
+	virtual QByteArray inputHash() const;
+
 	int calculationErrors() const;
 
 	// load/save state to a database
@@ -274,22 +382,87 @@ protected:
 	static double calculatePressure0(const Vessel &v);
 	void getParameters();
 	// void getKz();
-	void vascPress(int ideal_threads);
+	void vascPress();
 	bool openCapillaryCheck();
 
-	double totalResistance(int i, int ideal_threads);
 	double partialR(Vessel::Type type, int i);
-	void calculateChildrenFlowPress(int i, int ideal_threads);
+
+	/* Tree passes, one generation at a time. Each generation is split
+	 * in ranges processed in parallel by treePass() on the solver pool.
+	 */
+	void totalResistance();
+	void calculateChildrenFlowPress();
+	void treePass(TreePass pass, int gen);
+	void treePassRange(int worker, TreePass pass, int begin, int end);
+
+	void materializeVessels(); // private, contiguous vessel arrays
+	void updateVesselPointers();
+
+	bool beginSolverArrays(); // scatters state to arrays, if layout permits
+	void endSolverArrays();   // gathers state back to vessels
+
+	// threads of the current calculation, created on first use
+	SolverPool& solverPool();
+	void releaseSolverPool();
 
 	double calcDeltaCapillaryResistance();
-	bool deltaR(int ideal_threads);
+	bool deltaR();
+
+	/* Fused alternative to integrate(), capillaryResistances() and
+	 * totalResistance(). Subtrees rooted at fusedSplitGeneration() are
+	 * swept bottom-up in parallel, the generations above them last.
+	 */
+	int fusedSplitGeneration();
+	void fusedResistances(double &max_vessel_deviation, double &max_cap_deviation);
+	void fusedSubtrees(int worker, int split_gen, int begin, int end);
+
+	/* Local alternative to vascPress() and capillaryResistances() for
+	 * unstable capillaries. Capillaries with deltaR above threshold select
+	 * the subtrees rooted localSubtreeDepth() generations above them.
+	 * Flow and pressure of each subtree are recalculated from its fixed
+	 * inlet and outlet pressures, and all its capillaries are re-solved.
+	 * Returns the maximum capillary deltaR.
+	 */
+	int localSubtreeDepth() const;
+	double localCapillaryResistances(double threshold);
+	void localSubtrees(int worker, int depth, int begin, int end);
+
+	/* Coarse solve at the start of calc(), see setCoarseGenerations().
+	 * Only the first element of each coarse group and closed elements are
+	 * integrated, and prolongateCoarse() copies their results to the
+	 * rest of the group. Returns the number of coarse iterations.
+	 */
+	int coarseCalc(int max_iter);
+	void selectCoarseElements(int level);
+	void prolongateCoarse(bool vessels, bool capillaries);
+
+	/* Logarithm of vessel and capillary resistances, as one vector of
+	 * arteries, veins and capillaries, for the Anderson mixing.
+	 */
+	void gatherLogResistances(std::vector<double> &log_R);
+	void scatterLogResistances(const std::vector<double> &log_R,
+	                           const std::vector<double> &unchanged);
+	void accelerateResistances(bool restart);
 
 	void initVesselBaselineCharacteristics();
 	void initVesselBaselineResistances();
 	void initVesselBaselineResistances(int gen);
 	void calculateBaselineCharacteristics();
 
-	double lengthFactor(const Vessel &v, int lung_no) const;
+	/* Baseline setup is done one generation at a time. Constants of a
+	 * generation or a lung are evaluated once by the calling thread and
+	 * the elements are then processed in ranges on the solver pool.
+	 * Setup outside of calc() releases a pool it had to create, so idle
+	 * models do not keep the solver threads.
+	 */
+	struct BaselineGeneration;
+	struct BaselineLung;
+	void baselineResistanceRange(int worker, const BaselineGeneration *g, int begin, int end);
+	void baselineCharacteristicsRange(int worker, const BaselineLung *lungs, int begin, int end);
+	void baselineCapillaryRange(int worker, int start_offset, int begin, int end);
+	void parameterRange(int worker, int first_inside, int begin, int end);
+	bool beginSetupPool();
+	void endSetupPool(bool transient);
 
 	virtual bool initDb(QSqlDatabase &db) const;
 	virtual bool saveDb(QSqlDatabase &db, int offset, QProgressDialog *progress);
@@ -311,21 +484,55 @@ private:
 	Gender pat_gender;
 
 	std::vector<bool> vessel_value_override; // [arts + veins + caps]
+
+	/* Vessels and capillaries are shared with clones until written. The
+	 * arrays below are readable whenever they are not 0, and writable
+	 * after materializeVessels(), which bulk updates call first.
+	 */
+	CowArray<Vessel> art_store, vein_store;
+	CowArray<Capillary> cap_store;
 	Vessel *arteries, *veins;
 	Capillary *caps;
 
+	// solver state when soa_active, only allocated during calc()
+	StorageLayout storage_layout;
+	bool soa_active;
+	VesselArrays art_arrays, vein_arrays;
+	CapillaryArrays cap_arrays;
+
 	bool modified_flag; // used by isModified() function
 	int abort_calculation;
 	bool model_reset;
 
 	int prog; // progress is set 0-10000
 	AbstractIntegrationHelper *integration_helper;
+	SolverPool *solver_pool;
+	int solver_threads;
+	SolverPool::Statistics solver_stats;
+
+	bool fused_sweep;
+	bool total_R_current; // total_R already includes current R, from fused sweep
+	std::vector<double> worker_vessel_deviation, worker_cap_deviation;
+
+	Acceleration outer_acceleration;
+	Precision solver_precision;
+
+	bool active_set;
+	bool active_full_pass; // next deltaR() integrates all elements
+	bool local_capillary_solve;
+	std::vector<int> local_roots; // subtrees of localCapillaryResistances()
+	int coarse_generations;
+	int coarse_level; // generations of the coarse solve while it runs, else 0
+	bool cold_start; // baseline resistances, cleared by calc(), warmStart() and restoreResistanceState()
+	AndersonMixer *anderson; // only during calc()
+	std::vector<double> anderson_x, anderson_g;
 
 	double BSA_ratio; // BSAz()/BSA()
 
 	/* Calibration constants */
 	double Krc_factor;
 	double cv_diam_ratio;
+	double ideal_BSA; // BSAz(), of the calibrated height and weight
 
 	IntegralType integral_type;
 };
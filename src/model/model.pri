@@ -1,15 +1,43 @@
 SOURCES += \
+	$${SRC_DIR}/model/anderson.cpp \
 	$${SRC_DIR}/model/asyncrangemodelhelper.cpp \
 	$${SRC_DIR}/model/compromisemodel.cpp \
 	$${SRC_DIR}/model/disease.cpp \
 	$${SRC_DIR}/model/model.cpp \
-	$${SRC_DIR}/model/range.cpp
+	$${SRC_DIR}/model/modelbufferpool.cpp \
+	$${SRC_DIR}/model/modelsummary.cpp \
+	$${SRC_DIR}/model/morphometry.cpp \
+	$${SRC_DIR}/model/precisioncheck.cpp \
+	$${SRC_DIR}/model/range.cpp \
+	$${SRC_DIR}/model/solutioncache.cpp \
+	$${SRC_DIR}/model/solverpool.cpp \
+	$${SRC_DIR}/model/sweepjournal.cpp \
+	$${SRC_DIR}/model/sweepscheduler.cpp \
+	$${SRC_DIR}/model/vesselstorage.cpp
 
 HEADERS += \
+	$${SRC_DIR}/model/anderson.h \
 	$${SRC_DIR}/model/asyncrangemodelhelper.h \
 	$${SRC_DIR}/model/compromisemodel.h \
+	$${SRC_DIR}/model/cowarray.h \
 	$${SRC_DIR}/model/disease.h \
 	$${SRC_DIR}/model/model.h \
-	$${SRC_DIR}/model/range.h
+	$${SRC_DIR}/model/modelbufferpool.h \
+	$${SRC_DIR}/model/modelsummary.h \
+	$${SRC_DIR}/model/morphometry.h \
+	$${SRC_DIR}/model/morphometry_table.h \
+	$${SRC_DIR}/model/precisioncheck.h \
+	$${SRC_DIR}/model/range.h \
+	$${SRC_DIR}/model/solutioncache.h \
+	$${SRC_DIR}/model/solverpool.h \
+	$${SRC_DIR}/model/sweepjournal.h \
+	$${SRC_DIR}/model/sweepscheduler.h \
+	$${SRC_DIR}/model/vesselstorage.h \
+	$${SRC_DIR}/model/vmath.h
+
+# "make morphometry" regenerates the built-in table after data/vessel.ini changes
+morphometry.target = morphometry
+morphometry.commands = ruby $$PWD/../../ini2h < $$PWD/../../data/vessel.ini > $$PWD/morphometry_table.h
+QMAKE_EXTRA_TARGETS += morphometry
 
 include(integrationhelper/integrationhelper.pri)
@@ -0,0 +1,160 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QtGlobal>
+#include <algorithm>
+#include "../common.h"
+#include "dbsettings.h"
+#include "modelbufferpool.h"
+
+Q_GLOBAL_STATIC(ModelBufferPool, modelBufferPool)
+
+ModelBufferPool::ModelBufferPool()
+{
+	memory_budget = static_cast<qint64>(DbSettings::value(settings_model_memory_budget, 0).toInt()) << 20;
+}
+
+ModelBufferPool::~ModelBufferPool()
+{
+	trim();
+}
+
+ModelBufferPool* ModelBufferPool::instance()
+{
+	return modelBufferPool();
+}
+
+void* ModelBufferPool::allocate(qint64 bytes)
+{
+	ModelBufferPool *pool = instance();
+	return pool ? pool->take(bytes) : allocateCachelineAligned(static_cast<int>(bytes));
+}
+
+void ModelBufferPool::release(void *buffer, qint64 bytes)
+{
+	if (buffer == 0)
+		return;
+
+	ModelBufferPool *pool = instance();
+	if (pool)
+		pool->put(buffer, bytes);
+	else
+		freeAligned(buffer);
+}
+
+void ModelBufferPool::setBudget(qint64 bytes)
+{
+	QMutexLocker l(&lock);
+	memory_budget = std::max<qint64>(bytes, 0);
+	freeKept(keepLimit());
+}
+
+qint64 ModelBufferPool::budget() const
+{
+	QMutexLocker l(&lock);
+	return memory_budget;
+}
+
+ModelBufferPool::Statistics ModelBufferPool::statistics() const
+{
+	QMutexLocker l(&lock);
+	return stats;
+}
+
+void ModelBufferPool::logStatistics() const
+{
+	const Statistics s = statistics();
+	const qint64 n = s.hits + s.misses;
+
+	qDebug() << "Model buffer pool:" << s.hits << "of" << n << "allocations reused"
+	         << "(" << (n ? 100.0*s.hits/n : 0.0) << "% ), high water"
+	         << (s.high_water >> 20) << "MB, kept" << (s.kept >> 20) << "MB";
+}
+
+void ModelBufferPool::trim()
+{
+	QMutexLocker l(&lock);
+	freeKept(0);
+}
+
+void* ModelBufferPool::take(qint64 bytes)
+{
+	QMutexLocker l(&lock);
+
+	void *buffer = 0;
+	std::multimap<qint64, void*>::iterator i = kept_buffers.find(bytes);
+	if (i != kept_buffers.end()) {
+		buffer = i->second;
+		kept_buffers.erase(i);
+		stats.kept -= bytes;
+		stats.hits++;
+	}
+	else {
+		// make room for the new buffer first
+		if (memory_budget > 0)
+			freeKept(std::max<qint64>(0, memory_budget - stats.in_use - bytes));
+
+		buffer = allocateCachelineAligned(static_cast<int>(bytes));
+		if (buffer == 0 && !kept_buffers.empty()) {
+			freeKept(0);
+			buffer = allocateCachelineAligned(static_cast<int>(bytes));
+		}
+
+		if (buffer == 0)
+			return 0;
+		stats.misses++;
+	}
+
+	stats.in_use += bytes;
+	stats.high_water = std::max(stats.high_water, stats.in_use + stats.kept);
+	return buffer;
+}
+
+void ModelBufferPool::put(void *buffer, qint64 bytes)
+{
+	QMutexLocker l(&lock);
+
+	stats.in_use -= bytes;
+	kept_buffers.insert(std::make_pair(bytes, buffer));
+	stats.kept += bytes;
+	freeKept(keepLimit());
+}
+
+qint64 ModelBufferPool::keepLimit() const
+{
+	if (memory_budget > 0)
+		return std::max<qint64>(0, std::min<qint64>(max_keep, memory_budget - stats.in_use));
+
+	return max_keep;
+}
+
+void ModelBufferPool::freeKept(qint64 max_kept)
+{
+	// largest buffers first
+	while (stats.kept > max_kept && !kept_buffers.empty()) {
+		std::multimap<qint64, void*>::iterator i = --kept_buffers.end();
+
+		freeAligned(i->second);
+		stats.kept -= i->first;
+		kept_buffers.erase(i);
+	}
+}
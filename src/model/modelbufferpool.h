@@ -0,0 +1,91 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MODELBUFFERPOOL_H
+#define MODELBUFFERPOOL_H
+
+#include <QMutex>
+#include <map>
+
+/* Process-wide pool of the large model buffers: vessel and capillary
+ * storage and the solver arrays of calc().
+ *
+ * Released buffers are kept and handed out again for the same size, so
+ * models created and destroyed by range calculations, CompromiseModel or
+ * CalibrateDlg reuse memory instead of allocating and faulting it in each
+ * time. Buffers in use and kept count against a memory budget. Kept
+ * buffers are freed to stay within it, and callers starting new work, like
+ * SweepScheduler, check the budget first. Allocations themselves are never
+ * refused because of the budget, only when memory is exhausted.
+ */
+class ModelBufferPool
+{
+public:
+	struct Statistics
+	{
+		qint64 hits, misses; // allocations served from kept buffers, or not
+		qint64 in_use;       // bytes of buffers handed out
+		qint64 kept;         // bytes of released buffers kept for reuse
+		qint64 high_water;   // largest in_use + kept
+
+		Statistics() : hits(0), misses(0), in_use(0), kept(0), high_water(0) {}
+	};
+
+	// use instance()
+	ModelBufferPool();
+	~ModelBufferPool();
+
+	// 0 while the process exits
+	static ModelBufferPool* instance();
+
+	/* Cacheline aligned buffer, or 0 if memory is exhausted. Buffers
+	 * allocated during exit bypass the pool.
+	 */
+	static void* allocate(qint64 bytes);
+	static void release(void *buffer, qint64 bytes);
+
+	/* Bytes of buffers in use and kept, 0 for no budget. Up to max_keep
+	 * bytes of released buffers are kept within the budget.
+	 */
+	void setBudget(qint64 bytes);
+	qint64 budget() const;
+
+	Statistics statistics() const;
+	void logStatistics() const;
+	void trim(); // frees all kept buffers
+
+private:
+	ModelBufferPool(const ModelBufferPool&);
+	ModelBufferPool& operator=(const ModelBufferPool&);
+
+	void* take(qint64 bytes);
+	void put(void *buffer, qint64 bytes);
+	void freeKept(qint64 max_kept); // with lock held
+	qint64 keepLimit() const;
+
+	enum { max_keep = 256 << 20 };
+
+	mutable QMutex lock;
+	std::multimap<qint64, void*> kept_buffers; // by size
+	qint64 memory_budget;
+	Statistics stats;
+};
+
+#endif // MODELBUFFERPOOL_H
@@ -0,0 +1,208 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QDataStream>
+#include <algorithm>
+#include "modelsummary.h"
+
+double ModelSummary::result(Model::DataType type) const
+{
+	if (type < 0 || type >= NumResults)
+		return 0.0;
+
+	return results[type];
+}
+
+ModelSummary ModelSummary::fromModel(const Model &model, int n_iterations, int point)
+{
+	ModelSummary s;
+
+	s.point = point;
+	s.iterations = n_iterations;
+	s.calculation_errors = model.calculationErrors();
+	s.n_generations = model.nGenerations();
+	s.transducer_pos = model.transducerPos();
+
+	for (int i=0; i<NumResults; ++i)
+		s.results[i] = model.getResult(static_cast<Model::DataType>(i));
+
+	double max_delta_r = 0.0, sum_delta_r = 0.0;
+	int n_elements = 0;
+	for (int gen=1; gen<=s.n_generations; ++gen) {
+		const int n_elem = model.nElements(gen);
+
+		for (int i=0; i<n_elem; ++i) {
+			const double art = model.artery(gen, i).last_delta_R;
+			const double vein = model.vein(gen, i).last_delta_R;
+
+			max_delta_r = std::max(max_delta_r, std::max(art, vein));
+			sum_delta_r += art + vein;
+		}
+		n_elements += 2*n_elem;
+	}
+
+	const int n_cap = model.numCapillaries();
+	for (int i=0; i<n_cap; ++i) {
+		const double cap = model.capillary(i).last_delta_R;
+
+		max_delta_r = std::max(max_delta_r, cap);
+		sum_delta_r += cap;
+	}
+	n_elements += n_cap;
+
+	s.max_delta_r = max_delta_r;
+	s.mean_delta_r = sum_delta_r / n_elements;
+	return s;
+}
+
+ModelSummary ModelSummary::invalid()
+{
+	ModelSummary s;
+
+	s.point = -1;
+	s.iterations = 0;
+	s.calculation_errors = 0;
+	s.n_generations = 0;
+	s.transducer_pos = Model::Middle;
+	s.max_delta_r = s.mean_delta_r = 0.0;
+	std::fill(s.results, s.results+NumResults, 0.0);
+
+	return s;
+}
+
+ModelSummaryList::ModelSummaryList()
+{
+}
+
+ModelSummaryList::ModelSummaryList(const Model &base_model,
+                                   const QList<Model::DataType> &input_types,
+                                   int n_points)
+        : records(n_points, ModelSummary::invalid()), input_types(input_types)
+{
+	const DiseaseList &diseases = base_model.diseases();
+	const int n_diseases = diseases.size();
+	for (int disease_no=0; disease_no<n_diseases; ++disease_no) {
+		const Disease &d = diseases.at(disease_no);
+		const int n_params = d.paramCount();
+
+		for (int param_no=0; param_no<n_params; ++param_no)
+			disease_labels << d.name() + "." + d.parameterName(param_no);
+	}
+
+	disease_values.resize(n_points*disease_labels.size());
+	inputs.resize(n_points*input_types.size());
+}
+
+int ModelSummaryList::validCount() const
+{
+	int n = 0;
+	for (int i=0; i<records.size(); ++i)
+		if (records[i].isValid())
+			n++;
+
+	return n;
+}
+
+void ModelSummaryList::set(const ModelSummary &summary, const Model &model)
+{
+	const int point = summary.point;
+	records[point] = summary;
+
+	double *values = disease_values.data() + point*disease_labels.size();
+	const DiseaseList &diseases = model.diseases();
+	const int n_diseases = diseases.size();
+	for (int disease_no=0; disease_no<n_diseases; ++disease_no) {
+		const Disease &d = diseases.at(disease_no);
+		const int n_params = d.paramCount();
+
+		for (int param_no=0; param_no<n_params; ++param_no)
+			*values++ = d.parameterValue(param_no);
+	}
+
+	for (int i=0; i<input_types.size(); ++i)
+		inputs[point*input_types.size() + i] = model.getResult(input_types[i]);
+}
+
+QByteArray ModelSummaryList::pointRecord(int point) const
+{
+	const ModelSummary &s = records.at(point);
+	QByteArray record;
+	QDataStream out(&record, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_6);
+
+	out << static_cast<qint32>(s.point) << static_cast<qint32>(s.iterations)
+	    << static_cast<qint32>(s.calculation_errors) << static_cast<qint32>(s.n_generations)
+	    << static_cast<qint32>(s.transducer_pos) << s.max_delta_r << s.mean_delta_r
+	    << static_cast<quint32>(ModelSummary::NumResults);
+	for (int i=0; i<ModelSummary::NumResults; ++i)
+		out << s.results[i];
+
+	const int n_params = disease_labels.size();
+	out << disease_values.mid(point*n_params, n_params)
+	    << inputs.mid(point*input_types.size(), input_types.size());
+	return record;
+}
+
+int ModelSummaryList::setPointRecord(const QByteArray &record, int point)
+{
+	QDataStream in(record);
+	in.setVersion(QDataStream::Qt_4_6);
+
+	ModelSummary s;
+	qint32 record_point, iterations, errors, n_generations, transducer_pos;
+	quint32 n_results;
+	in >> record_point >> iterations >> errors >> n_generations >> transducer_pos
+	   >> s.max_delta_r >> s.mean_delta_r >> n_results;
+	if (in.status() != QDataStream::Ok || n_results != ModelSummary::NumResults)
+		return -1;
+
+	for (int i=0; i<ModelSummary::NumResults; ++i)
+		in >> s.results[i];
+
+	QVector<double> params, point_inputs;
+	in >> params >> point_inputs;
+
+	s.point = point >= 0 ? point : record_point;
+	if (in.status() != QDataStream::Ok || s.point < 0 || s.point >= records.size() ||
+	    params.size() != disease_labels.size() || point_inputs.size() != input_types.size())
+		return -1;
+
+	s.iterations = iterations;
+	s.calculation_errors = errors;
+	s.n_generations = n_generations;
+	s.transducer_pos = static_cast<Model::Transducer>(transducer_pos);
+	records[s.point] = s;
+
+	std::copy(params.begin(), params.end(),
+	          disease_values.begin() + s.point*disease_labels.size());
+	std::copy(point_inputs.begin(), point_inputs.end(),
+	          inputs.begin() + s.point*input_types.size());
+	return s.point;
+}
+
+double ModelSummaryList::diseaseParameter(int point, int param) const
+{
+	return disease_values.at(point*disease_labels.size() + param);
+}
+
+double ModelSummaryList::input(int point, int n) const
+{
+	return inputs.at(point*input_types.size() + n);
+}
@@ -0,0 +1,96 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MODELSUMMARY_H
+#define MODELSUMMARY_H
+
+#include <QList>
+#include <QStringList>
+#include <QVector>
+#include "model.h"
+
+/* Scalar results of one calculated range point. Plain data, so a sweep
+ * stores them in a single array. Disease parameters and range inputs vary
+ * in number and are stored by ModelSummaryList.
+ */
+struct ModelSummary
+{
+	enum { NumResults = Model::Vtlc_R_value+1 };
+
+	int point;              // index in range order, -1 if not calculated
+	int iterations;         // Model::calc() return value
+	int calculation_errors;
+	int n_generations;
+	Model::Transducer transducer_pos;
+
+	// last_delta_R of vessels and capillaries, as in the convergence summary
+	double max_delta_r, mean_delta_r;
+
+	double results[NumResults]; // Model::getResult() of each DataType
+
+	bool isValid() const { return point >= 0; }
+	double result(Model::DataType type) const;
+
+	static ModelSummary fromModel(const Model &model, int n_iterations, int point);
+	static ModelSummary invalid();
+};
+
+/* Summaries of the points of a range calculation, indexed by point, with
+ * their disease parameter values and range input values. Points that were
+ * not calculated have invalid summaries.
+ */
+class ModelSummaryList
+{
+public:
+	ModelSummaryList();
+	ModelSummaryList(const Model &base_model, const QList<Model::DataType> &input_types,
+	                 int n_points);
+
+	int size() const { return records.size(); }
+	int validCount() const;
+
+	const ModelSummary& at(int point) const { return records.at(point); }
+
+	// stores summary of model, with the model's disease parameters and inputs
+	void set(const ModelSummary &summary, const Model &model);
+	/* Summary, disease parameters and inputs of point as a record for
+	 * SweepJournal and SolutionCache. setPointRecord() stores a record as
+	 * point, or as the point it was made from if point is -1, and returns
+	 * the point, or -1 if the record is invalid or of other ranges.
+	 */
+	QByteArray pointRecord(int point) const;
+	int setPointRecord(const QByteArray &record, int point=-1);
+
+	// "Disease.parameter" labels, same for all points
+	const QStringList& diseaseParameterLabels() const { return disease_labels; }
+	double diseaseParameter(int point, int param) const;
+
+	const QList<Model::DataType>& inputTypes() const { return input_types; }
+	double input(int point, int n) const;
+
+private:
+	QVector<ModelSummary> records;
+	QStringList disease_labels;
+	QVector<double> disease_values; // disease_labels.size() per point
+	QList<Model::DataType> input_types;
+	QVector<double> inputs;         // input_types.size() per point
+};
+
+#endif // MODELSUMMARY_H
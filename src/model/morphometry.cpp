@@ -0,0 +1,113 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QDebug>
+#include <QFile>
+#include <QSettings>
+#include "../common.h"
+#include "dbsettings.h"
+#include "morphometry.h"
+#include "morphometry_table.h"
+
+class MorphometryOverride
+{
+public:
+	MorphometryOverride();
+
+	bool valid;
+	MorphometryTable table;
+};
+
+MorphometryOverride::MorphometryOverride()
+{
+	const QString path = DbSettings::value(settings_morphometry_file).toString();
+
+	valid = !path.isEmpty() && Morphometry::load(path, table);
+	if (valid)
+		qDebug() << "Vessel morphometry from" << path;
+}
+
+Q_GLOBAL_STATIC(MorphometryOverride, morphometryOverride)
+
+const MorphometryTable& Morphometry::table()
+{
+	const MorphometryOverride *o = morphometryOverride();
+	if (o != 0 && o->valid)
+		return o->table;
+
+	return builtin_morphometry;
+}
+
+const MorphometryTable& Morphometry::builtinTable()
+{
+	return builtin_morphometry;
+}
+
+static bool loadSection(const QSettings &s, const QString &section, double *values)
+{
+	for (int i=0; i<MorphometryTable::Generations; ++i) {
+		bool ok;
+		values[i] = s.value(section + "/gen_" + QString::number(i+1)).toDouble(&ok);
+		if (!ok || values[i] <= 0) {
+			qDebug() << "Invalid or missing morphometry value" << section
+			         << "generation" << i+1;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool loadSection(const QSettings &s, const QString &section, int *values)
+{
+	for (int i=0; i<MorphometryTable::Generations; ++i) {
+		bool ok;
+		values[i] = s.value(section + "/gen_" + QString::number(i+1)).toInt(&ok);
+		if (!ok || values[i] <= 0) {
+			qDebug() << "Invalid or missing morphometry value" << section
+			         << "generation" << i+1;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Morphometry::load(const QString &path, MorphometryTable &table)
+{
+	if (!QFile::exists(path)) {
+		qDebug() << "Morphometry file" << path << "does not exist";
+		return false;
+	}
+
+	const QSettings s(path, QSettings::IniFormat);
+	MorphometryTable t;
+
+	if (!loadSection(s, "artery_diameter_ratios", t.artery_diameter_ratio) ||
+	    !loadSection(s, "vein_diameter_ratios", t.vein_diameter_ratio) ||
+	    !loadSection(s, "artery_length_ratios", t.artery_length_ratio) ||
+	    !loadSection(s, "vein_length_ratios", t.vein_length_ratio) ||
+	    !loadSection(s, "artery_number", t.artery_number) ||
+	    !loadSection(s, "vein_number", t.vein_number))
+		return false;
+
+	table = t;
+	return true;
+}
@@ -0,0 +1,56 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MORPHOMETRY_H
+#define MORPHOMETRY_H
+
+#include <QString>
+
+/* Measured vessel numbers and diameter and length ratios of each
+ * generation, from Huang (1996), see data/vessel.ini.
+ */
+struct MorphometryTable
+{
+	enum { Generations = 16 };
+
+	double artery_diameter_ratio[Generations];
+	double vein_diameter_ratio[Generations];
+	double artery_length_ratio[Generations];
+	double vein_length_ratio[Generations];
+	int artery_number[Generations];
+	int vein_number[Generations];
+};
+
+/* The built-in table is compiled from data/vessel.ini by ini2h. The file
+ * named by settings_morphometry_file, in the same format, overrides it.
+ * It is read once, on first use of table(), and is shared read-only by all
+ * models, so models can be created on any thread without further I/O.
+ */
+class Morphometry
+{
+public:
+	static const MorphometryTable& table();
+	static const MorphometryTable& builtinTable();
+
+	// false, and table unchanged, if the file is missing or incomplete
+	static bool load(const QString &path, MorphometryTable &table);
+};
+
+#endif // MORPHOMETRY_H
@@ -0,0 +1,43 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Generated from data/vessel.ini by ini2h. Do not edit, run
+ * "make morphometry" instead.
+ */
+
+static const MorphometryTable builtin_morphometry = {
+	// artery_diameter_ratios
+	{ 1.0, 0.636942675, 0.315889138, 0.179032536, 0.116629368, 0.075314168, 0.067137201, 0.033138234,
+	  0.021948700, 0.014632467, 0.009468067, 0.006455500, 0.004174557, 0.002410054, 0.001549320, 0.000860733 },
+	// vein_diameter_ratios
+	{ 1.0, 0.636942675, 0.424792147, 0.287778263, 0.196435675, 0.141433686, 0.097726748, 0.069734665,
+	  0.044198027, 0.030447530, 0.018661389, 0.011295051, 0.006384159, 0.003290298, 0.001522376, 0.000883961 },
+	// artery_length_ratios
+	{ 1.0, 0.506, 0.714, 0.5194, 0.3614, 0.247, 0.1316, 0.0746,
+	  0.0562, 0.0384, 0.0216, 0.0136, 0.009, 0.0072, 0.0052, 0.0044 },
+	// vein_length_ratios
+	{ 1.0, 0.7136, 0.6998, 0.3898, 0.5298, 0.358, 0.2956, 0.2248,
+	  0.1356, 0.0958, 0.0584, 0.03, 0.0212, 0.0076, 0.0042, 0.0026 },
+	// artery_number
+	{ 1, 2, 7, 43, 127, 450, 1724, 6225,
+	  22004, 86020, 285772, 674169, 2256846, 5101903, 14057197, 51205812 },
+	// vein_number
+	{ 1, 2, 4, 11, 31, 63, 143, 435,
+	  1067, 3721, 15567, 73025, 453051, 2166333, 8494245, 39823553 }
+};
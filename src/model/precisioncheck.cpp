@@ -0,0 +1,212 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include "common.h"
+#include "dbsettings.h"
+#include "disease.h"
+#include "opencl.h"
+#include "precisioncheck.h"
+
+PrecisionCheck::PrecisionCheck(double tolerance)
+        : tol(tolerance)
+{
+}
+
+double PrecisionCheck::defaultTolerance()
+{
+	return DbSettings::value(settings_precision_tolerance, 1e-4).toDouble();
+}
+
+const char* PrecisionCheck::valueName(Value v)
+{
+	switch (v) {
+	case PAPm:
+		return "PAPm";
+	case Rus:
+		return "Rus";
+	case Rm:
+		return "Rm";
+	case Rds:
+		return "Rds";
+	case Volume:
+		return "volume";
+	case CapillaryVolume:
+		return "capillary volume";
+	case n_values:
+		break;
+	}
+
+	return "unknown";
+}
+
+void PrecisionCheck::modelValues(const Model &m, double *values)
+{
+	values[PAPm] = m.getResult(Model::PAP_value);
+	values[Rus] = m.getResult(Model::Rus_value);
+	values[Rm] = m.getResult(Model::Rm_value);
+	values[Rds] = m.getResult(Model::Rds_value);
+
+	// corner vessels follow the last generation of arteries
+	double volume = 0.0;
+	for (int gen=1; gen<=m.nGenerations()+1; ++gen) {
+		const int n = m.nElements(std::min(gen, m.nGenerations()));
+		for (int i=0; i<n; ++i) {
+			volume += m.artery(gen, i).volume;
+			if (gen <= m.nGenerations())
+				volume += m.vein(gen, i).volume;
+		}
+	}
+	values[Volume] = volume;
+
+	/* With sheet flow, H^4 falls linearly along the capillary, so the mean
+	 * height is 4/5*(Hin^5 - Hout^5)/(Hin^4 - Hout^4).
+	 */
+	double cap_volume = 0.0;
+	for (int i=0; i<m.numCapillaries(); ++i) {
+		const Capillary &c = m.capillary(i);
+		if (c.open_state == Capillary_Closed)
+			continue;
+
+		const double in4 = std::pow(c.Hin, 4), out4 = std::pow(c.Hout, 4);
+		if (in4 - out4 > 1e-12*in4)
+			cap_volume += 0.8*(in4*c.Hin - out4*c.Hout)/(in4 - out4);
+		else
+			cap_volume += c.Hin;
+	}
+	values[CapillaryVolume] = cap_volume;
+}
+
+bool PrecisionCheck::isApplicable()
+{
+	return !cl->isAvailable() || !DbSettings::value(settings_opencl_enabled, true).toBool();
+}
+
+bool PrecisionCheck::checkPrecisionSetting()
+{
+	const int precision = DbSettings::value(settings_solver_precision,
+	                                        Model::DoublePrecision).toInt();
+	if (precision == Model::DoublePrecision || !isApplicable() ||
+	    DbSettings::value(settings_precision_checked, Model::DoublePrecision).toInt() == precision)
+		return true;
+
+	qDebug() << "First use of a reduced solver precision, checking it";
+
+	PrecisionCheck check;
+	check.run();
+	if (check.passed(static_cast<Model::Precision>(precision))) {
+		DbSettings::setValue(settings_precision_checked, precision);
+		return true;
+	}
+
+	qWarning() << "Reduced solver precision failed the precision check, using double precision";
+	DbSettings::setValue(settings_solver_precision, static_cast<int>(Model::DoublePrecision));
+	return false;
+}
+
+bool PrecisionCheck::run()
+{
+	results.clear();
+
+	if (!isApplicable()) {
+		qWarning() << "Precision modes only apply to the CPU solver, disable OpenCL to check them";
+		return false;
+	}
+
+	// the baseline, without disease, is the first case
+	std::vector<Model*> models;
+	std::vector<QString> names;
+	models.push_back(new Model(Model::Middle, Model::SegmentedVesselFlow));
+	names.push_back("Baseline");
+
+	const DiseaseList diseases = Disease::allDiseases();
+	for (DiseaseList::const_iterator i=diseases.begin(); i!=diseases.end(); ++i) {
+		if (i->id() >= 0 || i->paramCount() < 1)
+			continue;
+
+		Disease d = *i;
+		d.setParameter(0, 50.0);
+
+		Model *m = new Model(Model::Middle, Model::SegmentedVesselFlow);
+		m->addDisease(d);
+		models.push_back(m);
+		names.push_back(d.name());
+	}
+
+	const Model::Precision modes[] = { Model::SinglePrecision, Model::MixedPrecision };
+	bool passed = true;
+
+	for (unsigned n=0; n<models.size(); ++n) {
+		Model *reference = models[n]->clone();
+		reference->setPrecision(Model::DoublePrecision);
+		reference->calc();
+
+		for (unsigned p=0; p<sizeof(modes)/sizeof(modes[0]); ++p) {
+			Model *m = models[n]->clone();
+			m->setPrecision(modes[p]);
+			m->calc();
+
+			Case c;
+			c.name = names[n];
+			c.precision = modes[p];
+			c.error = 0.0;
+			modelValues(*reference, c.reference);
+			modelValues(*m, c.value);
+
+			for (int v=0; v<n_values; ++v) {
+				const double err = std::fabs(c.value[v] - c.reference[v]) /
+				                   std::fabs(c.reference[v]);
+				c.error = std::max(c.error, std::isnan(err) ? 1.0 : err);
+			}
+
+			const bool ok = c.error <= tol;
+			passed = passed && ok;
+			results.push_back(c);
+
+			qDebug() << (ok ? "PASS" : "FAIL") << c.name
+			         << (modes[p] == Model::MixedPrecision ? "mixed" : "single")
+			         << "max relative error:" << c.error;
+			delete m;
+		}
+
+		delete reference;
+		delete models[n];
+	}
+
+	qDebug() << "Precision check" << (passed ? "passed" : "failed")
+	         << "with tolerance" << tol;
+	return passed;
+}
+
+bool PrecisionCheck::passed(Model::Precision precision) const
+{
+	bool found = false;
+
+	for (std::vector<Case>::const_iterator i=results.begin(); i!=results.end(); ++i) {
+		if (i->precision != precision)
+			continue;
+		if (!(i->error <= tol))
+			return false;
+		found = true;
+	}
+
+	return found;
+}
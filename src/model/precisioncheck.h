@@ -0,0 +1,83 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PRECISIONCHECK_H
+#define PRECISIONCHECK_H
+
+#include <QString>
+#include <vector>
+#include "model.h"
+
+/* Regression check of the reduced precision modes of the CPU solver,
+ * see Model::setPrecision(). The baseline model and each built-in
+ * disease, at 50% compromise, are solved in double precision and in the
+ * single and mixed precision modes. PAPm, Rus, Rm, Rds, the total
+ * vessel volume, including corner vessels, and the capillary sheet volume
+ * of every case must agree with double precision within the relative
+ * tolerance.
+ */
+class PrecisionCheck
+{
+public:
+	/* Capillaries have no volume in ul, as the sheet area is not part of
+	 * the model. CapillaryVolume is their volume per unit area, the mean
+	 * sheet height, summed over the open capillaries.
+	 */
+	enum Value { PAPm, Rus, Rm, Rds, Volume, CapillaryVolume, n_values };
+
+	struct Case
+	{
+		QString name;
+		Model::Precision precision;
+		double reference[n_values]; // double precision
+		double value[n_values];
+		double error; // largest relative difference of the values
+	};
+
+	explicit PrecisionCheck(double tolerance=defaultTolerance());
+
+	// settings_precision_tolerance, 1e-4 if not set
+	static double defaultTolerance();
+	static const char* valueName(Value v);
+
+	// precision modes only apply to the CPU solver
+	static bool isApplicable();
+
+	/* Runs the check when the solver precision setting is a reduced
+	 * precision mode that has not been checked yet, and falls back to
+	 * double precision if it fails. Returns false then.
+	 */
+	static bool checkPrecisionSetting();
+
+	// returns true if all cases are within tolerance
+	bool run();
+	// after run(), true if all cases of the precision mode are within tolerance
+	bool passed(Model::Precision precision) const;
+
+	double tolerance() const { return tol; }
+	const std::vector<Case>& cases() const { return results; }
+
+private:
+	static void modelValues(const Model &m, double *values);
+
+	double tol;
+	std::vector<Case> results;
+};
+
+#endif // PRECISIONCHECK_H
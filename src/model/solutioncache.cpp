@@ -0,0 +1,283 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <algorithm>
+#include "solutioncache.h"
+
+namespace {
+
+const quint32 cache_version = 1;
+const char entry_suffix[] = ".solution";
+
+}
+
+Q_GLOBAL_STATIC(SolutionCache, solutionCache)
+
+SolutionCache::SolutionCache()
+{
+	limit = 0;
+	use_clock = 0;
+	temp_files = 0;
+}
+
+SolutionCache* SolutionCache::instance()
+{
+	return solutionCache();
+}
+
+QByteArray SolutionCache::key(const char *kind, const QByteArray &model_hash, const QByteArray &data)
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	const QByteArray version = QByteArray::number(cache_version);
+
+	hash.addData(version);
+	hash.addData(kind);
+	hash.addData(model_hash);
+	hash.addData(data);
+	return hash.result();
+}
+
+bool SolutionCache::open(const QString &directory, qint64 size_limit)
+{
+	QMutexLocker l(&lock);
+
+	dir.clear();
+	limit = 0;
+	entries.clear();
+	use_order.clear();
+	stats = Statistics();
+
+	if (size_limit <= 0)
+		return false;
+
+	if (!QDir().mkpath(directory)) {
+		qDebug() << "Solution cache: cannot create" << directory;
+		return false;
+	}
+
+	dir = directory;
+	limit = size_limit;
+
+	// oldest first, so the last used entries get the highest use
+	const QFileInfoList files = QDir(dir).entryInfoList(QStringList() << QString("*") + entry_suffix,
+	                                                    QDir::Files, QDir::Time | QDir::Reversed);
+	for (int i=0; i<files.size(); ++i) {
+		const QByteArray key = QByteArray::fromHex(files[i].completeBaseName().toLatin1());
+		if (key.isEmpty())
+			continue;
+
+		Entry e;
+		e.size = files[i].size();
+		e.last_use = ++use_clock;
+		entries.insert(key, e);
+		use_order.insert(e.last_use, key);
+		stats.bytes += e.size;
+	}
+	removeFiles(evict(limit));
+
+	qDebug() << "Solution cache" << dir << "has" << entries.size() << "entries,"
+	         << (stats.bytes >> 10) << "kB";
+	return true;
+}
+
+bool SolutionCache::isOpen() const
+{
+	QMutexLocker l(&lock);
+	return limit > 0;
+}
+
+bool SolutionCache::find(const QByteArray &key, QByteArray &value)
+{
+	QString path;
+	qint64 size;
+
+	{
+		QMutexLocker l(&lock);
+		if (limit <= 0)
+			return false;
+
+		Entries::const_iterator i = entries.find(key);
+		if (i == entries.end()) {
+			stats.misses++;
+			return false;
+		}
+
+		path = entryPath(key);
+		size = i.value().size;
+	}
+
+	QFile f(path);
+	const bool opened = f.open(QIODevice::ReadWrite);
+	if (opened) {
+		value = f.readAll();
+
+		// rewriting the first byte updates the modification time, the use
+		// order seen by the next session
+		if (!value.isEmpty() && f.seek(0))
+			f.write(value.constData(), 1);
+		f.close();
+	}
+
+	QMutexLocker l(&lock);
+	Entries::iterator i = entries.find(key);
+
+	if (!opened || value.size() != size) {
+		// unless the entry was replaced meanwhile
+		const bool dropped = i != entries.end() && i.value().size == size && drop(key);
+		stats.misses++;
+		l.unlock();
+
+		if (dropped)
+			QFile::remove(path);
+		return false;
+	}
+
+	if (i != entries.end())
+		touch(i);
+	stats.hits++;
+	return true;
+}
+
+void SolutionCache::insert(const QByteArray &key, const QByteArray &value)
+{
+	QString path, tmp_path;
+
+	{
+		QMutexLocker l(&lock);
+		if (limit <= 0 || value.size() > limit)
+			return;
+
+		path = entryPath(key);
+		tmp_path = path + ".tmp" + QString::number(++temp_files);
+	}
+
+	// written in full before it replaces the entry
+	QFile f(tmp_path);
+	if (!f.open(QIODevice::WriteOnly) || f.write(value) != value.size()) {
+		qDebug() << "Solution cache: cannot write" << f.fileName();
+		f.close();
+		f.remove();
+		return;
+	}
+	f.close();
+
+	QFile::remove(path);
+	if (!QFile::rename(tmp_path, path)) {
+		QFile::remove(tmp_path);
+		return;
+	}
+
+	QMutexLocker l(&lock);
+	drop(key);
+
+	Entry e;
+	e.size = value.size();
+	e.last_use = 0;
+	Entries::iterator i = entries.insert(key, e);
+	touch(i);
+	stats.bytes += e.size;
+	stats.inserts++;
+
+	// the new entry is the most recently used one, and is kept
+	const QStringList evicted = evict(limit);
+	l.unlock();
+
+	removeFiles(evicted);
+}
+
+void SolutionCache::remove(const QByteArray &key)
+{
+	QMutexLocker l(&lock);
+	if (!drop(key))
+		return;
+
+	const QString path = entryPath(key);
+	l.unlock();
+
+	QFile::remove(path);
+}
+
+SolutionCache::Statistics SolutionCache::statistics() const
+{
+	QMutexLocker l(&lock);
+	return stats;
+}
+
+void SolutionCache::logStatistics() const
+{
+	const Statistics s = statistics();
+	const int n = s.hits + s.misses;
+
+	qDebug() << "Solution cache:" << s.hits << "hits of" << n << "lookups"
+	         << "(" << (n ? 100.0*s.hits/n : 0.0) << "% )," << s.inserts << "inserts,"
+	         << s.evictions << "evictions," << (s.bytes >> 10) << "kB";
+}
+
+QString SolutionCache::entryPath(const QByteArray &key) const
+{
+	return QDir(dir).filePath(QString(key.toHex()) + entry_suffix);
+}
+
+void SolutionCache::touch(Entries::iterator i)
+{
+	use_order.remove(i.value().last_use);
+	i.value().last_use = ++use_clock;
+	use_order.insert(i.value().last_use, i.key());
+}
+
+bool SolutionCache::drop(const QByteArray &key)
+{
+	Entries::iterator i = entries.find(key);
+	if (i == entries.end())
+		return false;
+
+	use_order.remove(i.value().last_use);
+	stats.bytes -= i.value().size;
+	entries.erase(i);
+	return true;
+}
+
+QStringList SolutionCache::evict(qint64 max_bytes)
+{
+	QStringList paths;
+
+	// least recently used first
+	while (stats.bytes > max_bytes && !use_order.isEmpty()) {
+		const QByteArray key = use_order.begin().value();
+
+		paths << entryPath(key);
+		drop(key);
+		stats.evictions++;
+	}
+
+	return paths;
+}
+
+void SolutionCache::removeFiles(const QStringList &paths)
+{
+	for (int i=0; i<paths.size(); ++i)
+		QFile::remove(paths[i]);
+}
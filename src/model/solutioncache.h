@@ -0,0 +1,104 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SOLUTIONCACHE_H
+#define SOLUTIONCACHE_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+/* Persistent cache of calculated solutions, keyed by a hash of all inputs
+ * of the calculation, see Model::inputHash() and key().
+ *
+ * Each entry is a file in the cache directory, named by its key, and is
+ * written to a temporary file first so a crash never leaves a partial
+ * entry. The least recently used entries are removed to stay within the
+ * size limit. Using an entry touches its file, so the order is kept
+ * between sessions.
+ *
+ * The cache is disabled until open() is called. All functions are thread
+ * safe. Entry files are read and written without holding the lock, so
+ * concurrent lookups only wait for each other to update the index.
+ */
+class SolutionCache
+{
+public:
+	struct Statistics
+	{
+		int hits, misses, inserts, evictions;
+		qint64 bytes; // size of all entries
+
+		Statistics() : hits(0), misses(0), inserts(0), evictions(0), bytes(0) {}
+	};
+
+	// use instance()
+	SolutionCache();
+
+	// 0 while the process exits
+	static SolutionCache* instance();
+
+	// key of calculation kind with model_hash and its further inputs in data
+	static QByteArray key(const char *kind, const QByteArray &model_hash,
+	                      const QByteArray &data=QByteArray());
+
+	// size_limit 0 disables the cache
+	bool open(const QString &directory, qint64 size_limit);
+	bool isOpen() const;
+
+	bool find(const QByteArray &key, QByteArray &value);
+	void insert(const QByteArray &key, const QByteArray &value);
+	void remove(const QByteArray &key); // entry that turned out unusable
+
+	Statistics statistics() const;
+	void logStatistics() const;
+
+private:
+	SolutionCache(const SolutionCache&);
+	SolutionCache& operator=(const SolutionCache&);
+
+	struct Entry
+	{
+		qint64 size;
+		quint64 last_use;
+	};
+
+	typedef QMap<QByteArray, Entry> Entries;
+
+	// with the lock held
+	QString entryPath(const QByteArray &key) const;
+	void touch(Entries::iterator i);
+	bool drop(const QByteArray &key);
+	QStringList evict(qint64 max_bytes); // returns the files to remove
+
+	static void removeFiles(const QStringList &paths);
+
+	mutable QMutex lock;
+	QString dir;
+	qint64 limit;
+	quint64 use_clock, temp_files;
+	Entries entries;
+	QMap<quint64, QByteArray> use_order; // last_use -> key, least recent first
+	Statistics stats;
+};
+
+#endif // SOLUTIONCACHE_H
@@ -0,0 +1,207 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include "solverpool.h"
+
+class SolverWorker : public QThread
+{
+public:
+	SolverWorker(SolverPool *pool, int worker) : pool(pool), worker(worker) {}
+
+protected:
+	virtual void run() { pool->workerLoop(worker); }
+
+private:
+	SolverPool *pool;
+	int worker;
+};
+
+SolverPool::SolverPool(int n_threads)
+        : n_workers(n_threads > 0 ? n_threads : std::max(1, QThread::idealThreadCount()))
+{
+	phase = 0;
+	quit = false;
+	task = 0;
+	range_begin = range_end = 0;
+	chunk_size = 1;
+	pending_chunks = 0;
+	phase_done_ns = 0;
+	clock.start();
+
+	for (int i=0; i<n_workers; ++i) {
+		Deque *d = new Deque;
+		d->front = d->back = 0;
+		d->first_chunk_ns = -1;
+		deques.push_back(d);
+	}
+
+	// worker 0 is the thread calling run()
+	for (int i=1; i<n_workers; ++i) {
+		workers.push_back(new SolverWorker(this, i));
+		workers.back()->start();
+	}
+}
+
+SolverPool::~SolverPool()
+{
+	phase_lock.lock();
+	quit = true;
+	phase_start.wakeAll();
+	phase_lock.unlock();
+
+	for (unsigned i=0; i<workers.size(); ++i) {
+		workers[i]->wait();
+		delete workers[i];
+	}
+
+	for (unsigned i=0; i<deques.size(); ++i)
+		delete deques[i];
+}
+
+void SolverPool::run(SolverTask &t, int begin, int end, int chunk)
+{
+	if (end <= begin)
+		return;
+
+	const qint64 start_ns = clock.nsecsElapsed();
+	const int n_chunks = (end - begin + chunk - 1) / chunk;
+
+	stats.phases++;
+	if (n_workers == 1 || n_chunks == 1) {
+		t.process(0, begin, end);
+		stats.run_ns += clock.nsecsElapsed() - start_ns;
+		return;
+	}
+
+	phase_lock.lock();
+	task = &t;
+	range_begin = begin;
+	range_end = end;
+	chunk_size = chunk;
+	pending_chunks = n_chunks;
+
+	for (int i=0; i<n_workers; ++i) {
+		Deque *d = deques[i];
+		QMutexLocker deque_lock(&d->lock);
+		d->front = static_cast<qint64>(n_chunks)*i/n_workers;
+		d->back = static_cast<qint64>(n_chunks)*(i+1)/n_workers;
+		d->first_chunk_ns = -1;
+	}
+
+	++phase;
+	phase_start.wakeAll();
+	phase_lock.unlock();
+
+	processChunks(0);
+
+	phase_lock.lock();
+	while (pending_chunks.fetchAndAddOrdered(0) != 0)
+		phase_done.wait(&phase_lock);
+	const qint64 done_ns = phase_done_ns;
+	phase_lock.unlock();
+
+	/* Dispatch overhead is the time until the last participating worker
+	 * started its first chunk, plus the time from completion of the last
+	 * chunk until run() returns.
+	 */
+	const qint64 end_ns = clock.nsecsElapsed();
+	qint64 wake_ns = 0;
+	for (int i=0; i<n_workers; ++i) {
+		QMutexLocker deque_lock(&deques[i]->lock);
+		if (deques[i]->first_chunk_ns >= 0)
+			wake_ns = std::max(wake_ns, deques[i]->first_chunk_ns - start_ns);
+	}
+
+	stats.run_ns += end_ns - start_ns;
+	stats.dispatch_ns += wake_ns + (end_ns - done_ns);
+}
+
+void SolverPool::workerLoop(int worker)
+{
+	int seen_phase = 0;
+
+	for (;;) {
+		phase_lock.lock();
+		while (phase == seen_phase && !quit)
+			phase_start.wait(&phase_lock);
+
+		if (quit) {
+			phase_lock.unlock();
+			return;
+		}
+
+		seen_phase = phase;
+		phase_lock.unlock();
+
+		processChunks(worker);
+	}
+}
+
+void SolverPool::processChunks(int worker)
+{
+	int chunk;
+
+	while (takeChunk(worker, chunk)) {
+		const int begin = range_begin + chunk*chunk_size;
+		const int end = std::min(begin + chunk_size, range_end);
+		task->process(worker, begin, end);
+
+		if (pending_chunks.fetchAndAddOrdered(-1) == 1) {
+			QMutexLocker lock(&phase_lock);
+			phase_done_ns = clock.nsecsElapsed();
+			phase_done.wakeAll();
+		}
+	}
+}
+
+bool SolverPool::takeChunk(int worker, int &chunk)
+{
+	// own deque first, from the front
+	Deque *own = deques[worker];
+	own->lock.lock();
+	if (own->front < own->back) {
+		chunk = own->front++;
+		if (own->first_chunk_ns < 0)
+			own->first_chunk_ns = clock.nsecsElapsed();
+		own->lock.unlock();
+		return true;
+	}
+	own->lock.unlock();
+
+	// then steal from the back of others
+	for (int i=1; i<n_workers; ++i) {
+		Deque *victim = deques[(worker+i) % n_workers];
+		QMutexLocker lock(&victim->lock);
+
+		if (victim->front < victim->back) {
+			chunk = --victim->back;
+			lock.unlock();
+
+			QMutexLocker own_lock(&own->lock);
+			if (own->first_chunk_ns < 0)
+				own->first_chunk_ns = clock.nsecsElapsed();
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,131 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOLVERPOOL_H
+#define SOLVERPOOL_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+
+class SolverWorker;
+
+/* Work item of a SolverPool phase. process() is called concurrently for
+ * disjoint ranges. worker is in [0, SolverPool::threadCount()) and is
+ * unique among concurrently running calls, so it can index per-worker
+ * results without locking.
+ */
+class SolverTask
+{
+public:
+	virtual ~SolverTask() {}
+	virtual void process(int worker, int begin, int end) = 0;
+};
+
+// SolverTask calling (obj->*f)(worker, arg, begin, end)
+template<class T, class Arg>
+class SolverMemberTask : public SolverTask
+{
+public:
+	typedef void (T::*Function)(int worker, Arg arg, int begin, int end);
+
+	SolverMemberTask(T *obj, Function f, Arg arg) : obj(obj), f(f), arg(arg) {}
+	virtual void process(int worker, int begin, int end) { (obj->*f)(worker, arg, begin, end); }
+
+private:
+	T *obj;
+	Function f;
+	Arg arg;
+};
+
+/* Threads used by a single Model::calc() for all its parallel phases:
+ * vessel integration, capillaries and the tree passes.
+ *
+ * run() is a phase. The range is split into chunks, and each worker starts
+ * with an equal contiguous share of the chunks in its own deque. Workers
+ * take chunks from the front of their deque and, once it is empty, steal
+ * from the back of other deques. run() returns when all chunks are
+ * processed, so consecutive phases are separated by a barrier. The calling
+ * thread is worker 0. Between phases the other workers sleep on a wait
+ * condition.
+ *
+ * Only one thread may call run() at a time.
+ */
+class SolverPool
+{
+public:
+	struct Statistics
+	{
+		int phases;
+		qint64 run_ns;      // total time spent in run()
+		qint64 dispatch_ns; // wake-up and barrier latency part of run_ns
+
+		Statistics() : phases(0), run_ns(0), dispatch_ns(0) {}
+	};
+
+	// n_threads < 1 uses QThread::idealThreadCount()
+	explicit SolverPool(int n_threads=0);
+	~SolverPool();
+
+	int threadCount() const { return n_workers; }
+
+	void run(SolverTask &task, int begin, int end, int chunk_size);
+
+	const Statistics& statistics() const { return stats; }
+	void resetStatistics() { stats = Statistics(); }
+
+protected:
+	friend class SolverWorker;
+
+	void workerLoop(int worker);
+	void processChunks(int worker);
+	bool takeChunk(int worker, int &chunk);
+
+private:
+	SolverPool(const SolverPool&);
+	SolverPool& operator=(const SolverPool&);
+
+	struct Deque
+	{
+		QMutex lock;
+		int front, back; // chunks [front, back)
+		qint64 first_chunk_ns; // start of first chunk in phase, or -1
+	};
+
+	const int n_workers;
+	std::vector<SolverWorker*> workers;
+	std::vector<Deque*> deques;
+
+	// current phase, published under phase_lock
+	QMutex phase_lock;
+	QWaitCondition phase_start, phase_done;
+	int phase;
+	bool quit;
+	SolverTask *task;
+	int range_begin, range_end, chunk_size;
+	QAtomicInt pending_chunks;
+	qint64 phase_done_ns;
+
+	QElapsedTimer clock;
+	Statistics stats;
+};
+
+#endif // SOLVERPOOL_H
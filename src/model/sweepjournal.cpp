@@ -0,0 +1,259 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSqlDatabase>
+#include "../common.h"
+#include "dbsettings.h"
+#include "modelsummary.h"
+#include "sweepjournal.h"
+
+namespace {
+
+const char journal_magic[] = "BLMJ";
+const quint32 journal_version = 2;
+const int record_header_size = 6; // quint32 length, quint16 checksum
+const quint32 max_record_size = 64 << 20;
+
+QByteArray journalHeader(const QByteArray &key, int n_points)
+{
+	QByteArray header;
+	QDataStream out(&header, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_6);
+
+	out.writeRawData(journal_magic, 4);
+	out << journal_version << key << static_cast<qint32>(n_points);
+	return header;
+}
+
+// payload of a record, the point and its state
+QByteArray pointPayload(const QByteArray &point_record, const QByteArray &state)
+{
+	QByteArray payload;
+	QDataStream out(&payload, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_6);
+
+	out << point_record << state;
+	return payload;
+}
+
+bool readPayload(const QByteArray &payload, QByteArray &point_record, QByteArray &state)
+{
+	QDataStream in(payload);
+	in.setVersion(QDataStream::Qt_4_6);
+
+	in >> point_record >> state;
+	return in.status() == QDataStream::Ok;
+}
+
+}
+
+SweepJournal::SweepJournal()
+        : dir(directory()),
+          store_states(DbSettings::value(settings_sweep_journal_states, false).toBool())
+{
+	complete = false;
+	n_points = 0;
+	restored_points = 0;
+}
+
+SweepJournal::~SweepJournal()
+{
+	close();
+}
+
+QByteArray SweepJournal::key(const QByteArray &model_hash,
+                             const QList<QPair<Model::DataType, Range> > &ranges,
+                             bool warm_start)
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_6);
+
+	out << journal_version << model_hash << warm_start;
+	for (int i=0; i<ranges.size(); ++i) {
+		out << static_cast<qint32>(ranges[i].first);
+
+		const QList<double> values = ranges[i].second.sequence();
+		out << static_cast<qint32>(values.size());
+		for (int n=0; n<values.size(); ++n)
+			out << values[n];
+	}
+
+	hash.addData(data);
+	return hash.result();
+}
+
+QString SweepJournal::directory()
+{
+	const QString settings_file = QSqlDatabase::database(settings_db).databaseName();
+	return QFileInfo(settings_file).absolutePath() + QLatin1String("/journals");
+}
+
+bool SweepJournal::open(const QByteArray &key, ModelSummaryList &summaries)
+{
+	QMutexLocker l(&lock);
+
+	if (file.isOpen())
+		file.close();
+	complete = false;
+	n_points = summaries.size();
+	restored_points = 0;
+	state_records.clear();
+
+	if (!QDir().mkpath(dir)) {
+		qDebug() << "Sweep journal: cannot create" << dir;
+		return false;
+	}
+
+	file.setFileName(QDir(dir).filePath(QString(key.toHex()) + ".journal"));
+	if (!file.open(QIODevice::ReadWrite)) {
+		qDebug() << "Sweep journal: cannot open" << file.fileName();
+		return false;
+	}
+
+	const QByteArray header = journalHeader(key, n_points);
+	if (file.read(header.size()) != header) {
+		// new journal, or not readable as one
+		if (!file.resize(0) || file.write(header) != header.size() || !file.flush()) {
+			qDebug() << "Sweep journal: cannot write" << file.fileName();
+			file.close();
+			return false;
+		}
+	}
+
+	qint64 offset = header.size();
+	QByteArray payload;
+
+	while (readRecord(offset, payload)) {
+		QByteArray point_record, state;
+		int point = -1;
+
+		if (readPayload(payload, point_record, state))
+			point = summaries.setPointRecord(point_record);
+		if (point >= 0 && !state.isEmpty())
+			state_records.insert(point, offset);
+
+		offset += record_header_size + payload.size();
+	}
+	restored_points = summaries.validCount();
+
+	// record cut short by a crash
+	if (offset < file.size()) {
+		qDebug() << "Sweep journal: dropped incomplete record of" << file.size()-offset << "bytes";
+		file.resize(offset);
+	}
+	file.seek(file.size());
+
+	qDebug() << "Sweep journal" << file.fileName() << "restored" << restored_points
+	         << "of" << n_points << "points";
+	return true;
+}
+
+bool SweepJournal::isOpen() const
+{
+	QMutexLocker l(&lock);
+	return file.isOpen();
+}
+
+void SweepJournal::close()
+{
+	QMutexLocker l(&lock);
+
+	if (file.isOpen())
+		file.close();
+	if (complete && !file.remove())
+		qDebug() << "Sweep journal: cannot remove" << file.fileName();
+	complete = false;
+	state_records.clear();
+}
+
+void SweepJournal::setComplete()
+{
+	QMutexLocker l(&lock);
+	complete = file.isOpen();
+}
+
+bool SweepJournal::append(int point, const QByteArray &point_record, const QByteArray &state)
+{
+	const QByteArray payload = pointPayload(point_record, state);
+
+	QByteArray record;
+	QDataStream rec(&record, QIODevice::WriteOnly);
+	rec << static_cast<quint32>(payload.size()) << qChecksum(payload.constData(), payload.size());
+	record.append(payload);
+
+	QMutexLocker l(&lock);
+	if (!file.isOpen())
+		return false;
+
+	const qint64 offset = file.size();
+	if (!file.seek(offset) || file.write(record) != record.size() || !file.flush()) {
+		qDebug() << "Sweep journal: cannot write" << file.fileName() << ", journal closed";
+		file.close();
+		return false;
+	}
+
+	if (!state.isEmpty())
+		state_records.insert(point, offset);
+	return true;
+}
+
+QByteArray SweepJournal::state(int point)
+{
+	QMutexLocker l(&lock);
+
+	QMap<int, qint64>::const_iterator i = state_records.find(point);
+	if (i == state_records.end())
+		return QByteArray();
+
+	QByteArray payload, point_record, state;
+	if (!readRecord(i.value(), payload) || !readPayload(payload, point_record, state))
+		return QByteArray();
+
+	return state;
+}
+
+bool SweepJournal::readRecord(qint64 offset, QByteArray &payload)
+{
+	if (!file.seek(offset))
+		return false;
+
+	const QByteArray header = file.read(record_header_size);
+	if (header.size() != record_header_size)
+		return false;
+
+	QDataStream in(header);
+	quint32 length;
+	quint16 checksum;
+	in >> length >> checksum;
+	if (length > max_record_size)
+		return false;
+
+	payload = file.read(length);
+	return payload.size() == static_cast<int>(length) &&
+	       qChecksum(payload.constData(), length) == checksum;
+}
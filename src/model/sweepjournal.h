@@ -0,0 +1,105 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SWEEPJOURNAL_H
+#define SWEEPJOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include "model.h"
+#include "range.h"
+
+class ModelSummaryList;
+
+/* Append-only file of the calculated points of a range calculation.
+ * Points are written as they finish, so results are on disk while the
+ * calculation runs, and calculating the same ranges on the same model
+ * again, after a cancel or a crash, only calculates the missing points.
+ *
+ * Each record is one point: its summary, disease parameters and inputs,
+ * and optionally the compressed resistances of the model, see
+ * Model::resistanceState(). Records are length prefixed and checksummed,
+ * and flushed once written. A record cut short by a crash is dropped when
+ * the journal is opened again.
+ *
+ * Journals are named by key() in the journals directory next to the
+ * settings database. A journal is removed once its calculation completes,
+ * so only journals of interrupted calculations are kept. Create journals
+ * in the GUI thread, they read settings.
+ */
+class SweepJournal
+{
+public:
+	SweepJournal();
+	~SweepJournal();
+
+	// key of the calculation of ranges on a model with Model::inputHash() model_hash
+	static QByteArray key(const QByteArray &model_hash,
+	                      const QList<QPair<Model::DataType, Range> > &ranges,
+	                      bool warm_start);
+	static QString directory();
+
+	/* Opens the journal of key, or creates it, and sets the points it
+	 * contains in summaries. Returns false if the file cannot be used.
+	 */
+	bool open(const QByteArray &key, ModelSummaryList &summaries);
+	bool isOpen() const;
+	void close(); // removes the file if complete
+
+	/* All points are calculated and their results kept by the caller. The
+	 * journal stays readable until it is closed.
+	 */
+	void setComplete();
+
+	int restoredPoints() const { return restored_points; }
+
+	// whether points are written with their resistances, settings_sweep_journal_states
+	bool storesStates() const { return store_states; }
+
+	/* Writes point_record, ModelSummaryList::pointRecord() of point, with
+	 * state if not empty. Thread safe. Returns false on write errors, after
+	 * which the journal is closed.
+	 */
+	bool append(int point, const QByteArray &point_record, const QByteArray &state);
+
+	// resistance state written with point, or empty. Thread safe.
+	QByteArray state(int point);
+
+private:
+	SweepJournal(const SweepJournal&);
+	SweepJournal& operator=(const SweepJournal&);
+
+	bool readRecord(qint64 offset, QByteArray &payload);
+
+	const QString dir;
+	const bool store_states;
+	bool complete;
+
+	mutable QMutex lock;
+	QFile file;
+	int n_points, restored_points;
+	QMap<int, qint64> state_records; // point -> record offset
+};
+
+#endif // SWEEPJOURNAL_H
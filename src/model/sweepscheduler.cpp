@@ -0,0 +1,227 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QMutexLocker>
+#include <algorithm>
+#include "modelbufferpool.h"
+#include "sweepscheduler.h"
+
+// weight of the latest point in the moving averages
+static const double sample_weight = 0.25;
+
+static void addSample(double &average, double value, bool first)
+{
+	average = first ? value : average + sample_weight*(value - average);
+}
+
+SweepScheduler::SweepScheduler(int n_points, int n_lanes, int n_threads)
+        : n_points(n_points),
+          n_lanes(std::max(1, std::min(n_lanes, n_points))),
+          n_threads(std::max(n_threads, this->n_lanes))
+{
+	taken = 0;
+	running = 0;
+	aborted = false;
+	active_lanes = this->n_lanes;
+	memory_lanes = this->n_lanes;
+
+	samples = 0;
+	dispatch_samples = 0;
+	serial_ns = 0.0;
+	work_ns = 0.0;
+	dispatch_ns = 0.0;
+
+	for (int i=0; i<this->n_lanes; ++i) {
+		Share s;
+		s.front = static_cast<qint64>(n_points)*i/this->n_lanes;
+		s.back = static_cast<qint64>(n_points)*(i+1)/this->n_lanes;
+		shares.push_back(s);
+	}
+	stopped.resize(this->n_lanes, false);
+}
+
+int SweepScheduler::activeLanes() const
+{
+	QMutexLocker l(&lock);
+	return active_lanes;
+}
+
+int SweepScheduler::nextPoint(int lane, int &threads)
+{
+	QMutexLocker l(&lock);
+
+	while (!aborted && taken < n_points && lane < memory_lanes && lane >= active_lanes)
+		lanes_changed.wait(&lock);
+
+	if (aborted || taken >= n_points || lane >= memory_lanes)
+		return -1;
+
+	Share &own = shares[lane];
+	if (own.front >= own.back) {
+		int victim = 0;
+		for (int i=1; i<n_lanes; ++i)
+			if (shares[i].back-shares[i].front > shares[victim].back-shares[victim].front)
+				victim = i;
+
+		Share &v = shares[victim];
+		own.back = v.back;
+		own.front = v.back - (v.back - v.front + 1)/2;
+		v.back = own.front;
+	}
+
+	const int point = own.front++;
+	++taken;
+	++running;
+
+	threads = std::max(1, n_threads / std::min(active_lanes, pointsLeft()));
+	return point;
+}
+
+void SweepScheduler::pointDone(int threads, qint64 wall_ns, const SolverPool::Statistics &stats)
+{
+	QMutexLocker l(&lock);
+	--running;
+
+	const bool first = (samples == 0);
+	addSample(serial_ns, std::max<qint64>(0, wall_ns - stats.run_ns), first);
+	addSample(work_ns, static_cast<double>(stats.run_ns - stats.dispatch_ns)*threads, first);
+	++samples;
+
+	if (threads > 1)
+		addSample(dispatch_ns, stats.dispatch_ns, dispatch_samples++ == 0);
+
+	checkMemory();
+	updateActiveLanes();
+	lanes_changed.wakeAll();
+}
+
+void SweepScheduler::pointSkipped()
+{
+	QMutexLocker l(&lock);
+	--running;
+	lanes_changed.wakeAll();
+}
+
+bool SweepScheduler::pointFailed(int lane)
+{
+	QMutexLocker l(&lock);
+	--running;
+	--taken;
+	--shares[lane].front;
+
+	bool last_lane = true;
+	for (int i=0; i<n_lanes; ++i)
+		if (i != lane && !stopped[i])
+			last_lane = false;
+
+	if (last_lane) {
+		aborted = true;
+		lanes_changed.wakeAll();
+		return false;
+	}
+
+	if (memory_lanes > 1) {
+		--memory_lanes;
+		active_lanes = std::min(active_lanes, memory_lanes);
+	}
+	lanes_changed.wakeAll();
+
+	// retry once the memory is free
+	for (int i=memory_lanes; lane<memory_lanes && i<n_lanes; ++i)
+		while (!stopped[i] && !aborted)
+			lanes_changed.wait(&lock);
+
+	return true;
+}
+
+void SweepScheduler::laneStopped(int lane)
+{
+	QMutexLocker l(&lock);
+	stopped[lane] = true;
+	lanes_changed.wakeAll();
+}
+
+void SweepScheduler::setLaneMemory(qint64 bytes)
+{
+	ModelBufferPool *pool = ModelBufferPool::instance();
+	if (pool == 0 || pool->budget() == 0 || bytes <= 0)
+		return;
+
+	QMutexLocker l(&lock);
+
+	// buffers in use now belong to models outside of the sweep
+	const qint64 available = pool->budget() - pool->statistics().in_use;
+	memory_lanes = static_cast<int>(std::max<qint64>(1, std::min<qint64>(n_lanes, available/bytes)));
+	active_lanes = std::min(active_lanes, memory_lanes);
+
+	// before any point is taken, so lanes still get contiguous shares
+	if (taken == 0)
+		for (int i=0; i<n_lanes; ++i) {
+			shares[i].front = static_cast<qint64>(n_points)*std::min(i, memory_lanes)/memory_lanes;
+			shares[i].back = static_cast<qint64>(n_points)*std::min(i+1, memory_lanes)/memory_lanes;
+		}
+}
+
+void SweepScheduler::abort()
+{
+	QMutexLocker l(&lock);
+	aborted = true;
+	lanes_changed.wakeAll();
+}
+
+void SweepScheduler::checkMemory()
+{
+	ModelBufferPool *pool = ModelBufferPool::instance();
+	if (pool == 0 || memory_lanes == 1)
+		return;
+
+	// wait until the lanes stopped before have freed their models
+	for (int i=memory_lanes; i<n_lanes; ++i)
+		if (!stopped[i])
+			return;
+
+	const qint64 budget = pool->budget();
+	if (budget > 0 && pool->statistics().in_use > budget)
+		--memory_lanes;
+}
+
+void SweepScheduler::updateActiveLanes()
+{
+	const int max_lanes = std::max(1, std::min(std::min(n_lanes, memory_lanes), pointsLeft()));
+
+	double best_rate = 0.0;
+	for (int lanes=1; lanes<=max_lanes; ++lanes)
+		best_rate = std::max(best_rate, pointRate(lanes));
+
+	int lanes = 1;
+	while (lanes < max_lanes && pointRate(lanes) < 0.95*best_rate)
+		++lanes;
+
+	active_lanes = lanes;
+}
+
+// estimated points per ns with the given number of concurrent points
+double SweepScheduler::pointRate(int lanes) const
+{
+	const int threads = std::max(1, n_threads/lanes);
+	const double point_ns = serial_ns + work_ns/threads + (threads > 1 ? dispatch_ns : 0.0);
+
+	return point_ns > 0.0 ? lanes/point_ns : 0.0;
+}
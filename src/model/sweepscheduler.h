@@ -0,0 +1,116 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SWEEPSCHEDULER_H
+#define SWEEPSCHEDULER_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+#include "solverpool.h"
+
+/* Distributes the points of a range calculation between lanes that each
+ * calculate one model at a time, and splits the solver threads between
+ * the models calculated concurrently.
+ *
+ * As in SolverPool, every lane starts with an equal contiguous share of
+ * the points and takes them in order, so consecutive points of a lane can
+ * warm start from each other. A lane that runs out of points takes the
+ * back half of the largest remaining share.
+ *
+ * The number of active lanes follows the measured cost of finished points.
+ * Time outside solver pool phases is serial and only overlaps between
+ * lanes. Time in the phases is also divided between the threads of a
+ * model, less the dispatch overhead. The fewest lanes within 5% of the
+ * best estimated point rate are used, and never more than points left, so
+ * that the last points of a sweep get all threads. Until the first point
+ * finishes, all lanes are active.
+ *
+ * Lanes are also limited to those whose models fit in the ModelBufferPool
+ * budget. If the buffers in use exceed the budget after a point, the last
+ * lane stops and frees its models, and its points go to the other lanes.
+ * The budget is not a hard limit, so a lane can still run out of memory,
+ * which also stops the last lane, see pointFailed().
+ */
+class SweepScheduler
+{
+public:
+	SweepScheduler(int n_points, int n_lanes, int n_threads);
+
+	int laneCount() const { return n_lanes; }
+	int activeLanes() const;
+
+	/* Next point of lane, or -1 when all points are taken or after abort().
+	 * Waits while the lane is inactive. threads is the number of solver
+	 * threads to calculate the point with.
+	 */
+	int nextPoint(int lane, int &threads);
+
+	// reports a point from nextPoint() as calculated, see Model::solverStatistics()
+	void pointDone(int threads, qint64 wall_ns, const SolverPool::Statistics &stats);
+	// reports a point from nextPoint() that needed no calculation
+	void pointSkipped();
+
+	/* Reports that lane ran out of memory calculating its point from
+	 * nextPoint(), after freeing its models. The point is taken again and
+	 * the last lane stops. Waits until the stopped lanes have freed their
+	 * models. Returns false, and aborts, if no other lane is left.
+	 */
+	bool pointFailed(int lane);
+
+	// lane has freed its models after nextPoint() returned -1
+	void laneStopped(int lane);
+
+	// memory used by the models of a lane, limits the lanes to the pool budget
+	void setLaneMemory(qint64 bytes);
+
+	void abort();
+
+private:
+	SweepScheduler(const SweepScheduler&);
+	SweepScheduler& operator=(const SweepScheduler&);
+
+	void updateActiveLanes();
+	void checkMemory();
+	double pointRate(int lanes) const;
+	int pointsLeft() const { return n_points - taken + running; }
+
+	struct Share
+	{
+		int front, back; // points [front, back)
+	};
+
+	const int n_points, n_lanes, n_threads;
+
+	mutable QMutex lock;
+	QWaitCondition lanes_changed;
+	std::vector<Share> shares;
+	std::vector<bool> stopped; // see laneStopped()
+	int active_lanes, memory_lanes, taken, running;
+	bool aborted;
+
+	// moving averages of finished points
+	int samples, dispatch_samples;
+	double serial_ns;   // outside of solver pool phases
+	double work_ns;     // in solver pool phases, summed over threads
+	double dispatch_ns; // overhead of phases with more than one thread
+};
+
+#endif // SWEEPSCHEDULER_H
@@ -0,0 +1,267 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "model.h"
+#include "modelbufferpool.h"
+#include "vesselstorage.h"
+
+namespace {
+
+/* Each field array starts on a 256-byte boundary, same as the
+ * Vessel and Capillary structures in the AoS storage.
+ */
+inline int fieldStride(int n)
+{
+	const int doubles_per_line = 256/sizeof(double);
+	return (n + doubles_per_line - 1) & ~(doubles_per_line - 1);
+}
+
+const int n_vessel_fields = 24;
+const int n_capillary_fields = 11; // open_state uses one double field
+
+}
+
+VesselArrays::VesselArrays()
+        : buffer(0), n_elements(0)
+{
+	release();
+}
+
+VesselArrays::~VesselArrays()
+{
+	release();
+}
+
+bool VesselArrays::allocate(int n)
+{
+	if (buffer && n == n_elements)
+		return true;
+
+	release();
+
+	const int stride = fieldStride(n);
+	buffer = (double*)ModelBufferPool::allocate(bufferBytes(n));
+	if (buffer == 0)
+		return false;
+
+	n_elements = n;
+
+	double *p = buffer;
+	D = p; p += stride;
+	gamma = p; p += stride;
+	phi = p; p += stride;
+	tone = p; p += stride;
+	GP = p; p += stride;
+	Ppl = p; p += stride;
+	pressure_0 = p; p += stride;
+	perivascular_press_a = p; p += stride;
+	perivascular_press_b = p; p += stride;
+	perivascular_press_c = p; p += stride;
+	perivascular_press_d = p; p += stride;
+	length = p; p += stride;
+	vessel_ratio = p; p += stride;
+
+	R = p; p += stride;
+	total_R = p; p += stride;
+	last_delta_R = p; p += stride;
+	flow = p; p += stride;
+	pressure_in = p; p += stride;
+	pressure_out = p; p += stride;
+
+	D_calc = p; p += stride;
+	Dmin = p; p += stride;
+	Dmax = p; p += stride;
+	volume = p; p += stride;
+	viscosity_factor = p; p += stride;
+
+	return true;
+}
+
+qint64 VesselArrays::bufferBytes(int n)
+{
+	return static_cast<qint64>(sizeof(double))*fieldStride(n)*n_vessel_fields;
+}
+
+void VesselArrays::release()
+{
+	if (buffer)
+		ModelBufferPool::release(buffer, bufferBytes(n_elements));
+
+	buffer = 0;
+	n_elements = 0;
+
+	D = gamma = phi = tone = 0;
+	GP = Ppl = pressure_0 = 0;
+	perivascular_press_a = perivascular_press_b = 0;
+	perivascular_press_c = perivascular_press_d = 0;
+	length = vessel_ratio = 0;
+	R = total_R = last_delta_R = 0;
+	flow = pressure_in = pressure_out = 0;
+	D_calc = Dmin = Dmax = volume = viscosity_factor = 0;
+}
+
+void VesselArrays::scatter(const Vessel *v, int n)
+{
+	for (int i=0; i<n; ++i) {
+		D[i] = v[i].D;
+		gamma[i] = v[i].gamma;
+		phi[i] = v[i].phi;
+		tone[i] = v[i].tone;
+		GP[i] = v[i].GP;
+		Ppl[i] = v[i].Ppl;
+		pressure_0[i] = v[i].pressure_0;
+		perivascular_press_a[i] = v[i].perivascular_press_a;
+		perivascular_press_b[i] = v[i].perivascular_press_b;
+		perivascular_press_c[i] = v[i].perivascular_press_c;
+		perivascular_press_d[i] = v[i].perivascular_press_d;
+		length[i] = v[i].length;
+		vessel_ratio[i] = v[i].vessel_ratio;
+
+		R[i] = v[i].R;
+		total_R[i] = v[i].total_R;
+		last_delta_R[i] = v[i].last_delta_R;
+		flow[i] = v[i].flow;
+		pressure_in[i] = v[i].pressure_in;
+		pressure_out[i] = v[i].pressure_out;
+
+		D_calc[i] = v[i].D_calc;
+		Dmin[i] = v[i].Dmin;
+		Dmax[i] = v[i].Dmax;
+		volume[i] = v[i].volume;
+		viscosity_factor[i] = v[i].viscosity_factor;
+	}
+}
+
+void VesselArrays::gather(Vessel *v, int n) const
+{
+	/* Only D (closed vessels), solver state and outputs are modified
+	 * during calculations, other inputs are not copied back.
+	 */
+	for (int i=0; i<n; ++i) {
+		v[i].D = D[i];
+
+		v[i].R = R[i];
+		v[i].total_R = total_R[i];
+		v[i].last_delta_R = last_delta_R[i];
+		v[i].flow = flow[i];
+		v[i].pressure_in = pressure_in[i];
+		v[i].pressure_out = pressure_out[i];
+
+		v[i].D_calc = D_calc[i];
+		v[i].Dmin = Dmin[i];
+		v[i].Dmax = Dmax[i];
+		v[i].volume = volume[i];
+		v[i].viscosity_factor = viscosity_factor[i];
+	}
+}
+
+
+CapillaryArrays::CapillaryArrays()
+        : buffer(0), n_elements(0)
+{
+	release();
+}
+
+CapillaryArrays::~CapillaryArrays()
+{
+	release();
+}
+
+bool CapillaryArrays::allocate(int n)
+{
+	if (buffer && n == n_elements)
+		return true;
+
+	release();
+
+	const int stride = fieldStride(n);
+	buffer = (double*)ModelBufferPool::allocate(bufferBytes(n));
+	if (buffer == 0)
+		return false;
+
+	n_elements = n;
+
+	double *p = buffer;
+	Ho = p; p += stride;
+	Alpha = p; p += stride;
+	Krc = p; p += stride;
+	open_state = reinterpret_cast<int*>(p); p += stride;
+
+	R = p; p += stride;
+	last_delta_R = p; p += stride;
+	flow = p; p += stride;
+	pressure_in = p; p += stride;
+	pressure_out = p; p += stride;
+	Hin = p; p += stride;
+	Hout = p; p += stride;
+
+	return true;
+}
+
+qint64 CapillaryArrays::bufferBytes(int n)
+{
+	return static_cast<qint64>(sizeof(double))*fieldStride(n)*n_capillary_fields;
+}
+
+void CapillaryArrays::release()
+{
+	if (buffer)
+		ModelBufferPool::release(buffer, bufferBytes(n_elements));
+
+	buffer = 0;
+	n_elements = 0;
+
+	Ho = Alpha = Krc = 0;
+	open_state = 0;
+	R = last_delta_R = flow = 0;
+	pressure_in = pressure_out = 0;
+	Hin = Hout = 0;
+}
+
+void CapillaryArrays::scatter(const Capillary *c, int n)
+{
+	for (int i=0; i<n; ++i) {
+		Ho[i] = c[i].Ho;
+		Alpha[i] = c[i].Alpha;
+		Krc[i] = c[i].Krc;
+		open_state[i] = static_cast<int>(c[i].open_state);
+
+		R[i] = c[i].R;
+		last_delta_R[i] = c[i].last_delta_R;
+		flow[i] = c[i].flow;
+		pressure_in[i] = c[i].pressure_in;
+		pressure_out[i] = c[i].pressure_out;
+		Hin[i] = c[i].Hin;
+		Hout[i] = c[i].Hout;
+	}
+}
+
+void CapillaryArrays::gather(Capillary *c, int n) const
+{
+	for (int i=0; i<n; ++i) {
+		c[i].R = R[i];
+		c[i].last_delta_R = last_delta_R[i];
+		c[i].flow = flow[i];
+		c[i].pressure_in = pressure_in[i];
+		c[i].pressure_out = pressure_out[i];
+		c[i].Hin = Hin[i];
+		c[i].Hout = Hout[i];
+	}
+}
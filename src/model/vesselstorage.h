@@ -0,0 +1,216 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VESSELSTORAGE_H
+#define VESSELSTORAGE_H
+
+#include <QtGlobal>
+
+struct Vessel;
+struct Capillary;
+
+struct VesselRef;
+struct CapillaryRef;
+
+/* Structure-of-arrays copy of the vessel fields that are read or written
+ * on every solver iteration. Each field is a separate, cacheline aligned
+ * array so the tree passes and the integration helpers only stream the
+ * data they actually use.
+ *
+ * Cold fields (Ptp, GPz, length_factor, partial_R, etc.) are not part of
+ * the arrays and are not touched while the arrays are in use.
+ */
+class VesselArrays
+{
+public:
+	VesselArrays();
+	~VesselArrays();
+
+	bool allocate(int n); // returns false on allocation failure
+	void release();
+
+	static qint64 bufferBytes(int n); // memory used by arrays of n elements
+
+	bool isAllocated() const { return buffer != 0; }
+	int size() const { return n_elements; }
+
+	// copy all hot fields from Vessel structures
+	void scatter(const Vessel *v, int n);
+	// copy fields modified by the solver back to the Vessel structures
+	void gather(Vessel *v, int n) const;
+
+	inline VesselRef at(int i);
+
+	// solver inputs
+	double *D, *gamma, *phi, *tone;
+	double *GP, *Ppl, *pressure_0;
+	double *perivascular_press_a, *perivascular_press_b;
+	double *perivascular_press_c, *perivascular_press_d;
+	double *length, *vessel_ratio;
+
+	// solver state
+	double *R, *total_R, *last_delta_R;
+	double *flow, *pressure_in, *pressure_out;
+
+	// solver outputs
+	double *D_calc, *Dmin, *Dmax, *volume, *viscosity_factor;
+
+private:
+	VesselArrays(const VesselArrays&);
+	VesselArrays& operator=(const VesselArrays&);
+
+	double *buffer;
+	int n_elements;
+};
+
+class CapillaryArrays
+{
+public:
+	CapillaryArrays();
+	~CapillaryArrays();
+
+	bool allocate(int n); // returns false on allocation failure
+	void release();
+
+	static qint64 bufferBytes(int n); // memory used by arrays of n elements
+
+	bool isAllocated() const { return buffer != 0; }
+	int size() const { return n_elements; }
+
+	void scatter(const Capillary *c, int n);
+	void gather(Capillary *c, int n) const;
+
+	inline CapillaryRef at(int i);
+
+	// solver inputs
+	double *Ho, *Alpha, *Krc;
+	int *open_state; // CapillaryState enum
+
+	// solver state
+	double *R, *last_delta_R, *flow;
+	double *pressure_in, *pressure_out;
+	double *Hin, *Hout;
+
+private:
+	CapillaryArrays(const CapillaryArrays&);
+	CapillaryArrays& operator=(const CapillaryArrays&);
+
+	double *buffer;
+	int n_elements;
+};
+
+/* Single element of the arrays, with the same member names as Vessel and
+ * Capillary. This allows solver code to be written once, as a template,
+ * for both storage layouts.
+ */
+struct VesselRef
+{
+	VesselRef(VesselArrays &a, int i)
+	        : D(a.D[i]), gamma(a.gamma[i]), phi(a.phi[i]), tone(a.tone[i]),
+	          GP(a.GP[i]), Ppl(a.Ppl[i]), pressure_0(a.pressure_0[i]),
+	          perivascular_press_a(a.perivascular_press_a[i]),
+	          perivascular_press_b(a.perivascular_press_b[i]),
+	          perivascular_press_c(a.perivascular_press_c[i]),
+	          perivascular_press_d(a.perivascular_press_d[i]),
+	          length(a.length[i]), vessel_ratio(a.vessel_ratio[i]),
+	          R(a.R[i]), total_R(a.total_R[i]), last_delta_R(a.last_delta_R[i]),
+	          flow(a.flow[i]),
+	          pressure_in(a.pressure_in[i]), pressure_out(a.pressure_out[i]),
+	          D_calc(a.D_calc[i]), Dmin(a.Dmin[i]), Dmax(a.Dmax[i]),
+	          volume(a.volume[i]), viscosity_factor(a.viscosity_factor[i])
+	{}
+
+	double &D, &gamma, &phi, &tone;
+	double &GP, &Ppl, &pressure_0;
+	double &perivascular_press_a, &perivascular_press_b;
+	double &perivascular_press_c, &perivascular_press_d;
+	double &length, &vessel_ratio;
+
+	double &R, &total_R, &last_delta_R;
+	double &flow, &pressure_in, &pressure_out;
+
+	double &D_calc, &Dmin, &Dmax, &volume, &viscosity_factor;
+};
+
+struct CapillaryRef
+{
+	CapillaryRef(CapillaryArrays &a, int i)
+	        : Ho(a.Ho[i]), Alpha(a.Alpha[i]), Krc(a.Krc[i]),
+	          open_state(a.open_state[i]),
+	          R(a.R[i]), last_delta_R(a.last_delta_R[i]), flow(a.flow[i]),
+	          pressure_in(a.pressure_in[i]), pressure_out(a.pressure_out[i]),
+	          Hin(a.Hin[i]), Hout(a.Hout[i])
+	{}
+
+	double &Ho, &Alpha, &Krc;
+	int &open_state;
+
+	double &R, &last_delta_R, &flow;
+	double &pressure_in, &pressure_out;
+	double &Hin, &Hout;
+};
+
+VesselRef VesselArrays::at(int i) { return VesselRef(*this, i); }
+CapillaryRef CapillaryArrays::at(int i) { return CapillaryRef(*this, i); }
+
+/* Element access by index for code templated over both storage layouts.
+ * reference is Vessel& or Capillary& for the structures and VesselRef or
+ * CapillaryRef for the arrays.
+ */
+template<class T>
+struct ElementPointer
+{
+	typedef T& reference;
+
+	ElementPointer(T *p) : ptr(p) {}
+	reference operator[](int i) const { return ptr[i]; }
+
+	T *ptr;
+};
+
+template<class Arrays, class Ref>
+struct ArraysPointer
+{
+	typedef Ref reference;
+
+	ArraysPointer(Arrays &a) : arrays(&a) {}
+	reference operator[](int i) const { return arrays->at(i); }
+
+	Arrays *arrays;
+};
+
+// element list[i] of another accessor
+template<class Pointer>
+struct IndexedPointer
+{
+	typedef typename Pointer::reference reference;
+
+	IndexedPointer(const Pointer &p, const int *list) : p(p), list(list) {}
+	reference operator[](int i) const { return p[list[i]]; }
+
+	Pointer p;
+	const int *list;
+};
+
+typedef ElementPointer<Vessel> VesselPointer;
+typedef ElementPointer<Capillary> CapillaryPointer;
+typedef ArraysPointer<VesselArrays, VesselRef> VesselArraysPointer;
+typedef ArraysPointer<CapillaryArrays, CapillaryRef> CapillaryArraysPointer;
+
+#endif // VESSELSTORAGE_H
@@ -0,0 +1,238 @@
+/*
+ *   Bshouty Lung Model - Pulmonary Circulation Simulation
+ *    Copyright (c) 1989-2014 Zoheir Bshouty, MD, PhD, FRCPC
+ *    Copyright (c) 2011-2014 Adam Majer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMATH_H
+#define VMATH_H
+
+#include <string.h>
+#include <limits>
+
+/* Small vector math library used by the vessel and capillary solvers.
+ *
+ * The functions are templates written only in terms of arithmetic, bit
+ * operations and Traits<T>, so the same code is used for double, float
+ * and the GCC vector types of the SIMD kernels (see simdkernel_impl.h).
+ * Nothing here depends on errno or the rounding mode and none of the
+ * functions branch on their argument values.
+ *
+ * Worst case errors, measured against the C library (long double for
+ * the double versions), exhaustively for float and with 10^8 random
+ * arguments per range for double, over |x| < 709 and x in [1e-300, 1e300]:
+ *
+ *   exp(x)    double: 0.97 ulp, at x = 581.2077130289829
+ *             float:  1.03 ulp, at x = -81.44471
+ *             Results below the smallest normal number are flushed
+ *             to zero. x > 709.436 (88.376 for float) gives +inf, a
+ *             little below the real overflow threshold.
+ *   log(x)    double: 0.86 ulp, at x = 0.7069311792899703
+ *             float:  0.86 ulp, at x = 0.6999103
+ *             x < 0 gives NaN, x == 0 gives -inf. Denormal x unsupported.
+ *   pow(x,y)  Computed as exp(y*log(x)), so the relative error, derived
+ *             from the above, is about (1 + 1.4*|y*ln(x)|) ulp and grows
+ *             with the magnitude of the result exponent. x < 0 gives NaN.
+ *
+ * These errors are orders of magnitude below Tlrns, but results are not
+ * identical to the C library.
+ */
+
+/* The SIMD kernels instantiate these templates from functions compiled
+ * for a different target than the template definitions. Forcing inlining
+ * makes sure the code is generated for the caller's instruction set.
+ */
+#if defined(__GNUC__)
+#define VMATH_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define VMATH_INLINE __forceinline
+#else
+#define VMATH_INLINE inline
+#endif
+
+namespace vmath {
+
+/* Specialised for every type the functions are used with.
+ *   Scalar - element type
+ *   Int    - integer type of the same size as T, for bit manipulation
+ *   toBits(), fromBits() - reinterpret between T and Int
+ *   select(mask, a, b)   - mask ? a : b, mask is result of comparison of T
+ *   splat(s)             - T with all elements set to s
+ *   all(mask)            - true if mask is set for all elements
+ *   gather(base, idx)    - T with elements base[idx]
+ */
+template<class T> struct Traits;
+
+template<> struct Traits<double>
+{
+	typedef double Scalar;
+	typedef long long Int;
+
+	static Int toBits(double x) { Int i; memcpy(&i, &x, sizeof(i)); return i; }
+	static double fromBits(Int i) { double x; memcpy(&x, &i, sizeof(x)); return x; }
+	static double select(bool mask, double a, double b) { return mask ? a : b; }
+	static double splat(double x) { return x; }
+	static bool all(bool mask) { return mask; }
+	static double gather(const double *base, Int idx) { return base[idx]; }
+};
+
+template<> struct Traits<float>
+{
+	typedef float Scalar;
+	typedef int Int;
+
+	static Int toBits(float x) { Int i; memcpy(&i, &x, sizeof(i)); return i; }
+	static float fromBits(Int i) { float x; memcpy(&x, &i, sizeof(x)); return x; }
+	static float select(bool mask, float a, float b) { return mask ? a : b; }
+	static float splat(float x) { return x; }
+	static bool all(bool mask) { return mask; }
+	static float gather(const float *base, Int idx) { return base[idx]; }
+};
+
+// constants, per element type
+template<class S> struct Constants;
+
+template<> struct Constants<double>
+{
+	typedef long long Int;
+
+	enum { mantissa_bits = 52, exponent_bias = 1023, exp_degree = 13, log_terms = 11 };
+
+	static double roundShift() { return 6755399441055744.0; } // 1.5*2^52
+	static Int roundShiftBits() { return 0x4338000000000000LL; }
+	static Int mantissaMask() { return 0x000FFFFFFFFFFFFFLL; }
+	static Int exponentMask() { return 0x7FF0000000000000LL; }
+
+	static double log2e() { return 1.44269504088896340736; }
+	static double ln2() { return 0.693147180559945309417; }
+	static double ln2Hi() { return 6.93147180369123816490e-01; }
+	static double ln2Lo() { return 1.90821492927058770002e-10; }
+	static double sqrt2() { return 1.41421356237309504880; }
+
+	static double maxExpArg() { return 709.436; } // 1023.5*ln2
+	static double minExpArg() { return -708.396418532264106224; }
+};
+
+template<> struct Constants<float>
+{
+	typedef int Int;
+
+	enum { mantissa_bits = 23, exponent_bias = 127, exp_degree = 7, log_terms = 5 };
+
+	static float roundShift() { return 12582912.0f; } // 1.5*2^23
+	static Int roundShiftBits() { return 0x4B400000; }
+	static Int mantissaMask() { return 0x007FFFFF; }
+	static Int exponentMask() { return 0x7F800000; }
+
+	static float log2e() { return 1.44269504088896340736f; }
+	static float ln2() { return 0.693147180559945309417f; }
+	static float ln2Hi() { return 0.693359375f; }
+	static float ln2Lo() { return -2.12194440e-4f; }
+	static float sqrt2() { return 1.41421356237309504880f; }
+
+	static float maxExpArg() { return 88.376f; } // 127.5*ln2
+	static float minExpArg() { return -87.3365479f; }
+};
+
+/* exp(x) = 2^n * exp(r), |r| <= ln2/2, exp(r) by Taylor series in Horner
+ * form. n is rounded with the 1.5*2^52 shift, which also leaves n in the
+ * low bits of the shifted value, so 2^n is built without any conversion.
+ */
+template<class T>
+VMATH_INLINE T exp(T x)
+{
+	typedef Traits<T> tr;
+	typedef typename tr::Scalar S;
+	typedef Constants<S> c;
+	typedef typename tr::Int I;
+
+	const S inv_fact[] = {
+	        S(1.0), S(1.0), S(1.0/2), S(1.0/6), S(1.0/24), S(1.0/120),
+	        S(1.0/720), S(1.0/5040), S(1.0/40320), S(1.0/362880),
+	        S(1.0/3628800), S(1.0/39916800), S(1.0/479001600),
+	        S(1.0/6227020800.0) };
+
+	const T t = x*c::log2e() + c::roundShift();
+	const T n = t - c::roundShift();
+	T r = x - n*c::ln2Hi();
+	r = r - n*c::ln2Lo();
+
+	// 1 + (r + r^2*q) keeps the rounding error of the terms below the last addition
+	T q = r*inv_fact[c::exp_degree] + inv_fact[c::exp_degree-1];
+	for (int i=c::exp_degree-2; i>=2; --i)
+		q = q*r + inv_fact[i];
+	const T p = S(1) + (r + r*r*q);
+
+	I bits = tr::toBits(t) - c::roundShiftBits() + typename c::Int(c::exponent_bias);
+	T result = p * tr::fromBits(bits << int(c::mantissa_bits));
+
+	result = tr::select(x > c::maxExpArg(), tr::splat(std::numeric_limits<S>::infinity()), result);
+	result = tr::select(x < c::minExpArg(), tr::splat(S(0)), result);
+	return result;
+}
+
+/* log(x) = e*ln2 + log(m), m in [sqrt(1/2), sqrt(2)), and
+ * log(m) = 2*atanh(s), s = (m-1)/(m+1), |s| < 0.1716
+ */
+template<class T>
+VMATH_INLINE T log(T x)
+{
+	typedef Traits<T> tr;
+	typedef typename tr::Scalar S;
+	typedef Constants<S> c;
+	typedef typename tr::Int I;
+
+	const I bits = tr::toBits(x);
+	const I e_bits = ((bits & c::exponentMask()) >> int(c::mantissa_bits)) -
+	                 typename c::Int(c::exponent_bias);
+	T m = tr::fromBits((bits & c::mantissaMask()) |
+	                   (typename c::Int(c::exponent_bias) << int(c::mantissa_bits)));
+
+	// exponent converted to floating point with the same shift trick
+	T e = tr::fromBits(e_bits + c::roundShiftBits()) - c::roundShift();
+
+	const T large = m*S(0.5);
+	e = tr::select(m > c::sqrt2(), T(e + S(1)), e);
+	m = tr::select(m > c::sqrt2(), large, m);
+
+	// m-1 is exact, and f - f^2/2 + s*(f^2/2 + R) adds the small terms first
+	const T f = m - S(1);
+	const T s = f / (S(2) + f);
+	const T z = s*s;
+	const T hfsq = S(0.5)*f*f;
+	T R = tr::splat(S(2) / S(2*c::log_terms - 1));
+	for (int i=c::log_terms-2; i>=1; --i)
+		R = R*z + S(2) / S(2*i + 1);
+	R = R*z;
+
+	T result = e*c::ln2Hi() - ((hfsq - (s*(hfsq + R) + e*c::ln2Lo())) - f);
+
+	result = tr::select(x == S(0), tr::splat(-std::numeric_limits<S>::infinity()), result);
+	result = tr::select(x < S(0), tr::splat(std::numeric_limits<S>::quiet_NaN()), result);
+	result = tr::select(x == std::numeric_limits<S>::infinity(), x, result);
+	result = tr::select(x != x, x, result);
+	return result;
+}
+
+template<class T>
+VMATH_INLINE T pow(T x, typename Traits<T>::Scalar y)
+{
+	return exp(log(x)*y);
+}
+
+}
+
+#endif // VMATH_H
@@ -46,9 +46,15 @@ MultiModelOutput::~MultiModelOutput()
 	delete ui;
 }
 
-void MultiModelOutput::setModels(QList<QPair<int, Model *> > data_models)
+void MultiModelOutput::setSummaries(const ModelSummaryList &point_summaries)
 {
-	models = data_models;
+	summaries = point_summaries;
+
+	rows.clear();
+	for (int i=0; i<summaries.size(); ++i)
+		if (summaries.at(i).isValid())
+			rows << i;
+
 	updateView();
 }
 
@@ -110,23 +116,23 @@ void MultiModelOutput::saveToFile()
 void MultiModelOutput::updateView()
 {
 	ui->tableWidget->clear();
-	ui->tableWidget->setRowCount(models.size());
-	if (models.size() < 1)
+	ui->tableWidget->setRowCount(rows.size());
+	if (rows.size() < 1)
 		return;
 
 	// fill in static data - assume first model is has same information
 	// as the rest
-	Model *m = models.first().second;
+	const ModelSummary *m = &summaries.at(rows.first());
 
 	ui->modelData->setColumnCount(2);
 	ui->modelData->setRowCount(2);
 
 	ui->modelData->setItem(0, 0, new QTableWidgetItem(QLatin1String("# of Generations")));
-	ui->modelData->setItem(0, 1, new QTableWidgetItem(QString::number(m->nGenerations())));
+	ui->modelData->setItem(0, 1, new QTableWidgetItem(QString::number(m->n_generations)));
 
 	ui->modelData->setItem(1, 0, new QTableWidgetItem(QLatin1String("Transducer pos.")));
 	QString trans_pos;
-	switch (m->transducerPos()) {
+	switch (m->transducer_pos) {
 	case Model::Top:
 		trans_pos = QLatin1String("Top");
 		break;
@@ -140,22 +146,24 @@ void MultiModelOutput::updateView()
 	ui->modelData->setItem(1, 1, new QTableWidgetItem(trans_pos));
 
 	ui->modelData->setItem(2, 0, new QTableWidgetItem(QLatin1String("Tolerance")));
-	ui->modelData->setItem(2, 1, new QTableWidgetItem(doubleToString(m->getResult(Model::Tlrns_value))));
+	ui->modelData->setItem(2, 1, new QTableWidgetItem(doubleToString(m->result(Model::Tlrns_value))));
 
 
 	// add iterator count
 	{
 		QList<QString> values;
 		bool all_the_same = true;
-		values.reserve(models.count());
+		values.reserve(rows.size());
+
+		for (QVector<int>::const_iterator row=rows.begin(); row!=rows.end(); ++row) {
+			const ModelSummary &s = summaries.at(*row);
 
-		for (ModelCalcList::const_iterator i=models.begin(); i!=models.end(); ++i) {
-			switch (i->first) {
+			switch (s.iterations) {
 			case -2:
 				values.append(QLatin1String("Target PAPm impossible"));
 				break;
 			default:
-				values.append(QString::number(i->first));
+				values.append(QString::number(s.iterations));
 				break;
 			}
 
@@ -167,6 +175,22 @@ void MultiModelOutput::updateView()
 		insertValue("# Iterations", values);
 	}
 
+	// add convergence
+	{
+		QList<QString> values;
+		bool all_the_same = true;
+		values.reserve(rows.size());
+
+		for (QVector<int>::const_iterator row=rows.begin(); row!=rows.end(); ++row) {
+			values.append(doubleToString(summaries.at(*row).max_delta_r*100, 3) + QChar::fromLatin1('%'));
+			all_the_same = all_the_same && values.back() == values.front();
+		}
+
+		if (all_the_same)
+			values = QList<QString>() << values.first();
+		insertValue("Max. deltaR", values);
+	}
+
 	// add calculated values
 	//
 	// NOTE: Left and Right must remain 4 characters as those are stripped
@@ -210,10 +234,10 @@ void MultiModelOutput::updateView()
 	for (QList<QPair<Model::DataType,QString> >::const_iterator i=types.begin(); i!=types.end(); ++i) {
 		QList<QString> values;
 		bool all_the_same = true;
-		values.reserve(models.count());
+		values.reserve(rows.size());
 
-		for (ModelCalcList::const_iterator m=models.begin(); m!=models.end(); ++m) {
-			values.append(doubleToString(m->second->getResult(i->first)));
+		for (QVector<int>::const_iterator row=rows.begin(); row!=rows.end(); ++row) {
+			values.append(doubleToString(summaries.at(*row).result(i->first)));
 			all_the_same = all_the_same && values.front() == values.back();
 		}
 
@@ -224,31 +248,22 @@ void MultiModelOutput::updateView()
 
 
 	// Add disease parameters
-	const DiseaseList diseases = models.first().second->diseases();
-	const int n_disesases = diseases.size();
-	for (int disease_no=0; disease_no<n_disesases; ++disease_no) {
-		const Disease &d = diseases.at(disease_no);
-		const QString disease_name = d.name();
-		const int n_params = d.paramCount();
-
-		for (int param_no=0; param_no<n_params; ++param_no) {
-			const QString param_name = d.parameterName(param_no);
-			const QString label = disease_name + "." + param_name;
-			QList<QString> values;
-			bool all_the_same = true;
-
-			values.reserve(models.size());
-			for (ModelCalcList::const_iterator m=models.begin(); m!=models.end(); ++m) {
-				double val = m->second->diseases().at(disease_no).parameterValue(param_no);
-				values.push_back(doubleToString(val));
-
-				all_the_same = all_the_same && values.back() == values.front();
-			}
+	const QStringList &disease_labels = summaries.diseaseParameterLabels();
+	for (int param=0; param<disease_labels.size(); ++param) {
+		QList<QString> values;
+		bool all_the_same = true;
 
-			if (all_the_same)
-				values = QList<QString>() << values.front();
-			insertValue(label, values);
+		values.reserve(rows.size());
+		for (QVector<int>::const_iterator row=rows.begin(); row!=rows.end(); ++row) {
+			double val = summaries.diseaseParameter(*row, param);
+			values.push_back(doubleToString(val));
+
+			all_the_same = all_the_same && values.back() == values.front();
 		}
+
+		if (all_the_same)
+			values = QList<QString>() << values.front();
+		insertValue(disease_labels.at(param), values);
 	}
 }
 
@@ -277,10 +292,11 @@ void MultiModelOutput::insertValue(QString header, const QList<QString> & values
 void MultiModelOutput::itemDoubleClicked(int row)
 {
 	qDebug("row: %d", row);
-	if (row<0 || row>=models.size())
+	if (row<0 || row>=rows.size())
 		return;
 
-	emit doubleClicked(models[row].second, models[row].first);
+	const ModelSummary &s = summaries.at(rows[row]);
+	emit pointDoubleClicked(s.point);
 }
 
 void MultiModelOutput::combineMirroredLungLabels(QList<QPair<Model::DataType, QString> > &types)
@@ -301,10 +317,10 @@ void MultiModelOutput::combineMirroredLungLabels(QList<QPair<Model::DataType, QS
 	for (QMap<Model::DataType, QPair<Model::DataType,Model::DataType> >::const_iterator i = cmap.begin(); i!=cmap.end(); i++) {
 		bool same_value = true;
 
-		for (ModelCalcList::const_iterator m=models.begin(); m!=models.end() && same_value; ++m) {
-			Model *model = m->second;
-			same_value = same_value && qFuzzyCompare(model->getResult(i->first)+1.0,
-			                                         model->getResult(i->second)+1.0);
+		for (QVector<int>::const_iterator row=rows.begin(); row!=rows.end() && same_value; ++row) {
+			const ModelSummary &s = summaries.at(*row);
+			same_value = same_value && qFuzzyCompare(s.result(i->first)+1.0,
+			                                         s.result(i->second)+1.0);
 		}
 
 		if (same_value) {
@@ -19,6 +19,7 @@
 
 #include <QDialog>
 #include "model/model.h"
+#include "model/modelsummary.h"
 
 namespace Ui {
 	class MultiModelOutput;
@@ -32,7 +33,7 @@ public:
 	MultiModelOutput(QWidget *parent);
 	~MultiModelOutput();
 
-	void setModels(ModelCalcList data_models);
+	void setSummaries(const ModelSummaryList &point_summaries);
 	QString toCSV(QChar sep = '\t') const;
 
 public slots:
@@ -49,10 +50,11 @@ protected slots:
 private:
 	void combineMirroredLungLabels(QList<QPair<Model::DataType,QString> > &types);
 
-	ModelCalcList models;
+	ModelSummaryList summaries;
+	QVector<int> rows; // calculated points
 
 	Ui::MultiModelOutput *ui;
 
 signals:
-	void doubleClicked(Model *model, int n_iters);
+	void pointDoubleClicked(int point); // see ModelSummary::point()
 };
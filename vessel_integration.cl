@@ -88,10 +88,36 @@ inline float viscosityFactor(float D, float Hct)
 	return fma(Mi45-(float)1.0, bb, (float)1.0) / 3.2;
 }
 
+/* Tabulated viscosityFactor(), see ViscosityTable. Interval index comes
+ * from the exponent and top VTABLE_BITS mantissa bits of D. vtable_n is 0
+ * if the table is not to be used.
+ */
+#define VTABLE_BITS 7
+
+inline float viscosityLookup(float D, float hct,
+                             __global const float4 *vtable, int vtable_first, int vtable_n,
+                             float vtable_excl_min, float vtable_excl_max)
+{
+	const int bits = as_int(D);
+	const int idx = (bits >> (23-VTABLE_BITS)) - vtable_first;
+
+	if (idx < 0 || idx >= vtable_n || (D >= vtable_excl_min && D < vtable_excl_max))
+		return viscosityFactor(D, hct);
+
+	const float t = as_float(((bits & ((1 << (23-VTABLE_BITS))-1)) << VTABLE_BITS) | 0x3F800000) - 1.0f;
+	const float4 c = vtable[idx];
+	return fma(fma(fma(c.w, t, c.z), t, c.y), t, c.x);
+}
+
 __kernel void singleSegmentVesselFlow(
 		int width,
 		float hct,
 		float tlrns,
+		__global const float4 *vtable,
+		int vtable_first,
+		int vtable_n,
+		float vtable_excl_min,
+		float vtable_excl_max,
 		__global struct Vessel *v,
 		__global struct Result *result)
 {
@@ -148,7 +174,8 @@ __kernel void singleSegmentVesselFlow(
 		Ptm = Pv - Px;
 		
 		D = vein.D*vein.gamma - (vein.gamma-1.0)*vein.D*exp(-Ptm*vein.phi/(vein.gamma-1.0));
-		vf = viscosityFactor(D, hct);
+		vf = viscosityLookup(D, hct, vtable, vtable_first, vtable_n,
+		                     vtable_excl_min, vtable_excl_max);
 		Rs = 128*Kr/MATH_PI * vf * vein.len / sqr(sqr(D)) * vein.vessel_ratio;
 
 		new_Pin = Pout + vein.flow * Rs;
@@ -170,6 +197,11 @@ __kernel void multiSegmentedVesselFlow(
 		int width,
                 float hct,
 		float tlrns,
+		__global const float4 *vtable,
+		int vtable_first,
+		int vtable_n,
+		float vtable_excl_min,
+		float vtable_excl_max,
                 __global struct Vessel *v, 
                 __global struct Result *result)
 {
@@ -213,7 +245,8 @@ __kernel void multiSegmentedVesselFlow(
 		const float Ptm = Pv - Px;
 
 		D = vein.D*vein.gamma - (vein.gamma-1.0)*vein.D*exp(-Ptm*vein.phi/(vein.gamma-1.0));
-		const float vf = viscosityFactor(D, hct);
+		const float vf = viscosityLookup(D, hct, vtable, vtable_first, vtable_n,
+		                                 vtable_excl_min, vtable_excl_max);
 
 		const float Rs = 128*Kr/MATH_PI * vf * dL / sqr(sqr(D)) * vein.vessel_ratio;
 